@@ -32,7 +32,19 @@
 #define DEFAULTS_GENERIC
 
 // Serial baud rate
-#define BAUD_RATE 9600 /// hardcoded 115200 for ARM LM4F120H5QR devboard
+#define BAUD_RATE 115200 ///9600 on AVR
+
+// Serial port. 0 is UART0 on PA0/PA1, which the LaunchPad routes to the debug interface's USB
+// virtual COM port. It carries no handshake lines, so only XON/XOFF flow control works there.
+// 1 is UART1 on PB0/PB1, for an external USB-serial bridge. It is the only UART of the LM4F120
+// with modem handshake, so RTS/CTS flow control (see ENABLE_RTSCTS below) requires it.
+#define SERIAL_UART 0
+
+// Serial transport. Uncomment to talk to the host through the LaunchPad's device USB connector
+// (PD4/PD5) as a USB CDC virtual serial port instead of a UART. Streaming is then no longer
+// limited by the baud rate, but by the parser and planner. BAUD_RATE, SERIAL_UART and the UART
+// flow control options are ignored. Requires linking the StellarisWare USB library (usblib).
+// #define SERIAL_USB_CDC // Default disabled. Uncomment to enable.
 
 // Define pin-assignments
 // NOTE: All step bit and direction pins must be on the same port.
@@ -78,6 +90,20 @@
 #define SPINDLE_DIRECTION_PORT  GPIO_PORTE_BASE //PORTB for AVR, GPIO_PORTB_BASE for Cortex
 #define SPINDLE_DIRECTION_BIT   5  // Uno Digital Pin 13 (NOTE: D13 can't be pulled-high input due to LED.)
 
+// Variable spindle speed. Timer0A generates a PWM signal on its CCP pin, with a duty cycle of the
+// programmed S value over the spindle max rpm ($31). With laser mode ($33) set, the duty cycle also
+// follows the speed of the motion. Comment to disable and leave only the spindle enable pin.
+#define VARIABLE_SPINDLE
+#ifdef VARIABLE_SPINDLE
+  #define SPINDLE_PWM_PERIPH       SYSCTL_PERIPH_GPIOB //defined for Cortex M4F
+  #define SPINDLE_PWM_PORT         GPIO_PORTB_BASE
+  #define SPINDLE_PWM_BIT          6  // PB6, T0CCP0 (NOTE: Tied to PD0 through R9 on the Launchpad.)
+  #define SPINDLE_PWM_PIN_CONFIG   GPIO_PB6_T0CCP0
+  #define SPINDLE_PWM_TIMER_PERIPH SYSCTL_PERIPH_TIMER0
+  #define SPINDLE_PWM_TIMER        TIMER0_BASE
+  #define SPINDLE_PWM_FREQUENCY    5000 // Hz. Not below 1221 Hz, the period has to fit the 16 bit timer.
+#endif
+
 #define COOLANT_FLOOD_PERIPH SYSCTL_PERIPH_GPIOE //defined for Cortex M4F
 #define COOLANT_FLOOD_DDR   DDRC // AVR only
 #define COOLANT_FLOOD_PORT  GPIO_PORTE_BASE //PORTC for AVR, GPIO_PORTC_BASE for Cortex
@@ -106,6 +132,17 @@
 #define PINOUT_PCMSK     PCMSK1 // Pin change interrupt register, AVR only
 #define PINOUT_MASK ((1<<PIN_RESET)|(1<<PIN_FEED_HOLD)|(1<<PIN_CYCLE_START))
 
+// RTS/CTS handshake lines, used only with ENABLE_RTSCTS on UART1. CTS is the UART's own U1CTS
+// input. RTS is a plain output driven by software, because it follows the read buffer level
+// rather than the hardware FIFO. (U1RTS on PC4 would clash with mist coolant.)
+#define RTS_PERIPH      SYSCTL_PERIPH_GPIOC //defined for Cortex M4F
+#define RTS_PORT        GPIO_PORTC_BASE
+#define RTS_BIT         6
+#define CTS_PERIPH      SYSCTL_PERIPH_GPIOC //defined for Cortex M4F
+#define CTS_PORT        GPIO_PORTC_BASE
+#define CTS_BIT         5
+#define CTS_PIN_CONFIG  GPIO_PC5_U1CTS
+
 // Define runtime command special characters. These characters are 'picked-off' directly from the
 // serial read data stream and are not passed to the grbl line execution parser. Select characters
 // that do not and must not exist in the streamed g-code program. ASCII control characters may be 
@@ -117,6 +154,33 @@
 #define CMD_CYCLE_START '~'
 #define CMD_RESET 0x18 // ctrl-x
 
+// Realtime override commands, as extended ASCII characters in the codes Grbl v1.1 uses. Feed and
+// spindle overrides step by a coarse or fine increment between their limits, in percent. Rapids
+// are switched between full, medium and low. All reset to 100% on a reset.
+// NOTE: Binary motion frames escape these characters (see protocol.h and script/pack.py).
+#define CMD_FEED_OVR_RESET 0x90
+#define CMD_FEED_OVR_COARSE_PLUS 0x91
+#define CMD_FEED_OVR_COARSE_MINUS 0x92
+#define CMD_FEED_OVR_FINE_PLUS 0x93
+#define CMD_FEED_OVR_FINE_MINUS 0x94
+#define CMD_RAPID_OVR_RESET 0x95
+#define CMD_RAPID_OVR_MEDIUM 0x96
+#define CMD_RAPID_OVR_LOW 0x97
+#define CMD_SPINDLE_OVR_RESET 0x99
+#define CMD_SPINDLE_OVR_COARSE_PLUS 0x9A
+#define CMD_SPINDLE_OVR_COARSE_MINUS 0x9B
+#define CMD_SPINDLE_OVR_FINE_PLUS 0x9C
+#define CMD_SPINDLE_OVR_FINE_MINUS 0x9D
+
+#define MAX_FEED_OVERRIDE 200 // Percent. Up to 255.
+#define MIN_FEED_OVERRIDE 10
+#define RAPID_OVERRIDE_MEDIUM 50
+#define RAPID_OVERRIDE_LOW 25
+#define MAX_SPINDLE_OVERRIDE 200
+#define MIN_SPINDLE_OVERRIDE 10
+#define OVERRIDE_COARSE_INCREMENT 10
+#define OVERRIDE_FINE_INCREMENT 1
+
 // The "Stepper Driver Interrupt" employs the Pramod Ranade inverse time algorithm to manage the
 // Bresenham line stepping algorithm. The value ISR_TICKS_PER_SECOND is the frequency(Hz) at which
 // the Ranade algorithm ticks at. Maximum step frequencies are limited by the Ranade frequency by
@@ -134,6 +198,7 @@
 // profiles and how the stepper program actually performs them. The correct value for this parameter
 // is machine dependent, so it's advised to set this only as high as needed. Approximate successful
 // values can widely range from 50 to 200 or more. Cannot be greater than ISR_TICKS_PER_SECOND/2.
+// This is also the rate of the step segments the main program prepares for the stepper interrupt.
 #define ACCELERATION_TICKS_PER_SECOND 120L 
 
 // NOTE: Make sure this value is less than 256, when adjusting both dependent parameters.
@@ -149,6 +214,28 @@
 // zero and report it to the Grbl administrators. 
 #define RANADE_MULTIPLIER 100000000.0
 
+// Adaptive Multi-Axis Step Smoothing (AMASS). At low step rates, the Bresenham line tracer only
+// steps the minor axes on some of the major axis step events, which are far apart in time. This
+// makes the minor axes step unevenly and can excite audible resonances in the motors. AMASS runs
+// the stepper interrupt a power of two faster at low step rates and scales the Bresenham counters
+// accordingly, so the minor axis steps are spread evenly in time. The level doubles the interrupt
+// rate each time the step rate falls below half of the previous cutoff, starting at the cutoff
+// below. MAX_AMASS_LEVEL bounds the over-driving, i.e. 3 runs the interrupt up to 8x faster.
+#define ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING // Comment to disable
+#define MAX_AMASS_LEVEL 3 // Integer (1-4)
+#define AMASS_CUTOFF_FREQUENCY 8000L // Step rate below which AMASS engages. Integer (Hz)
+
+// Step pulse generation by uDMA. By default, the stepper driver interrupt sets the step bits on
+// every step event and a second interrupt resets them after the pulse time, so each step costs two
+// interrupts. With this option, a Timer1 interrupt traces the step events into a ring of port words
+// at STEP_DMA_SERVICE_FREQUENCY, and the uDMA streams them to the stepping port on Timer2 timeouts.
+// The step pulse ends with a port word of its own, so there is no pulse reset interrupt. Each step
+// takes two ring entries, and the ring is kept two service periods ahead, so the default ring
+// covers step rates up to about 90kHz. STEP_PULSE_DELAY is not supported with this option.
+// #define STEP_PULSE_DMA // Default disabled. Uncomment to enable.
+#define STEP_DMA_RING_SIZE 96 // Port words in the ring. Integer (8-127)
+#define STEP_DMA_SERVICE_FREQUENCY 4000L // Ring refill interrupt rate. Integer (Hz)
+
 // Minimum planner junction speed. Sets the default minimum speed the planner plans for at the end
 // of the buffer and all stops. This should not be much greater than zero and should only be changed
 // if unwanted behavior is observed on a user's machine when running at very slow speeds.
@@ -161,16 +248,9 @@
 // NOTE: Compute by (desired_step_rate/60) * RANADE_MULTIPLIER/ISR_TICKS_PER_SECOND. (mm/min)
 #define MINIMUM_STEP_RATE 1000L // Integer (mult*mm/isr_tic)
 
-// Minimum stepper rate. Only used by homing at this point. May be removed in later releases.
+// Minimum stepper rate. The step segments never run slower.
 #define MINIMUM_STEPS_PER_MINUTE 800 // (steps/min) - Integer value only
 
-// Time delay increments performed during a dwell. The default value is set at 50ms, which provides
-// a maximum time delay of roughly 55 minutes, more than enough for most any application. Increasing
-// this delay will increase the maximum dwell time linearly, but also reduces the responsiveness of 
-// run-time command executions, like status reports, since these are performed between each dwell 
-// time step. Also, keep in mind that the Arduino delay timer is not very accurate for long delays.
-#define DWELL_TIME_STEP 50 // Integer (1-255) (milliseconds)
-
 // If homing is enabled, homing init lock sets Grbl into an alarm state upon power up. This forces
 // the user to perform the homing cycle (or override the locks) before doing anything else. This is
 // mainly a safety feature to remind the user to home, since position is unknown to Grbl.
@@ -202,6 +282,10 @@
 // greater.
 #define N_HOMING_LOCATE_CYCLE 2 // Integer (1-128)
 
+// Longest distance the homing cycle moves an axis to find its limit switch, or to leave it. Homing
+// fails with an alarm if an axis has not reached its switch state by then.
+#define HOMING_MAX_TRAVEL 2000.0 // Float (mm)
+
 // Number of blocks Grbl executes upon startup. These blocks are stored in EEPROM, where the size
 // and addresses are defined in settings.h. With the current settings, up to 5 startup blocks may
 // be stored and executed in order. These startup blocks would typically be used to set the g-code
@@ -222,8 +306,9 @@
 // majority of RAM that Grbl uses is based on this buffer size. Only increase if there is extra 
 // available RAM, like when re-compiling for a Teensy or Sanguino. Or decrease if the Arduino
 // begins to crash due to the lack of available RAM or if the CPU is having trouble keeping
-// up with planning new incoming motions as they are executed. 
-// #define BLOCK_BUFFER_SIZE 18  // Uncomment to override default in planner.h.
+// up with planning new incoming motions as they are executed. The LM4F120 defaults to 64 blocks;
+// 64-128 fit comfortably in its 32KB SRAM. '$P' reports the bytes per block and the total.
+// #define BLOCK_BUFFER_SIZE 64  // Uncomment to override default in planner.h.
 
 // Line buffer size from the serial input stream to be executed. Also, governs the size of 
 // each of the startup blocks, as they are each stored as a string of this size. Make sure
@@ -241,7 +326,9 @@
 // increase the receive buffer if a deeper receive buffer is needed for streaming and avaiable
 // memory allows. The send buffer primarily handles messages in Grbl. Only increase if large
 // messages are sent and Grbl begins to stall, waiting to send the rest of the message.
-// #define RX_BUFFER_SIZE 128 // Uncomment to override defaults in serial.h
+// The default read buffer is 1024 bytes (see serial.h), which holds some 30 typical lines of
+// a CAM program. Up to 4096 is reasonable on the LM4F120, which has 32KB of RAM.
+// #define RX_BUFFER_SIZE 2048 // Uncomment to override defaults in serial.h
 // #define TX_BUFFER_SIZE 64
   
 // Toggles XON/XOFF software flow control for serial communications. Not officially supported
@@ -252,8 +339,31 @@
 // As well as, older FTDI FT232RL-based Arduinos(Duemilanove) are known to work with standard
 // terminal programs since their firmware correctly manage these XON/XOFF characters. In any
 // case, please report any successes to grbl administrators!
+// On the LM4F120 both the debug USB virtual COM port and external bridges pass XON/XOFF through.
+// XOFF is sent when the read buffer is three quarters full and XON when it has drained to half.
 // #define ENABLE_XONXOFF // Default disabled. Uncomment to enable.
 
+// Toggles RTS/CTS hardware flow control. Requires SERIAL_UART 1 and a USB-serial bridge with its
+// handshake lines wired to the RTS and CTS pins defined above. RTS is deasserted at the same
+// read buffer levels as XOFF. Can be combined with ENABLE_XONXOFF.
+// #define ENABLE_RTSCTS // Default disabled. Uncomment to enable.
+
+// Echoes every received character back to the host, as this port used to. Only useful with a
+// plain terminal. It doubles the traffic on the link and streaming hosts have to filter it out.
+// Echoes are dropped, not waited for, when the transmit buffer is full.
+// #define ENABLE_ECHO // Default disabled. Uncomment to enable.
+
+// Adds the serial read buffer level, its high watermark since power-up and the number of dropped
+// echoes to the status report, e.g. ",RX:120,RXMax:768,TXDrop:0". Helps to tune RX_BUFFER_SIZE
+// and a streaming host.
+// #define REPORT_SERIAL_STATE // Default disabled. Uncomment to enable.
+
+// Times the stepper, step port reset and UART interrupts with the DWT cycle counter of the Cortex-M4
+// and records how far the stepper interrupt strays from its programmed period. '$T' prints the
+// count, minimum, mean, maximum and a histogram of each in core cycles, then starts over. Shows
+// the headroom left before raising step rates. Costs a few dozen cycles per interrupt.
+// #define ISR_PROFILE // Default disabled. Uncomment to enable.
+
 // ---------------------------------------------------------------------------------------
 
 // TODO: Install compile-time option to send numeric status codes rather than strings.
@@ -31,6 +31,7 @@
 #include "settings.h"
 #include "config.h"
 #include "planner.h"
+#include "nuts_bolts.h"
 
 static uint8_t current_coolant_mode;
 
@@ -76,11 +77,11 @@ void coolant_stop()
 }
 
 
-void coolant_run(uint8_t mode)
+// Switches the coolant outputs right away, as spindle_set_state() does the spindle
+void coolant_set_state(uint8_t mode)
 {
   if (mode != current_coolant_mode)
   { 
-    plan_synchronize(); // Ensure coolant turns on when specified in program.
     if (mode == COOLANT_FLOOD_ENABLE) { 
       #ifdef PART_LM4F120H5QR // code for ARM
         GPIOPinWrite( COOLANT_FLOOD_PORT, COOLANT_FLOOD_BIT, 0xFF );
@@ -102,3 +103,10 @@ void coolant_run(uint8_t mode)
     current_coolant_mode = mode;
   }
 }
+
+// Sets the coolant for the motion programmed from now on, as spindle_run() does the spindle
+void coolant_run(uint8_t mode)
+{
+  plan_set_coolant_mode(mode);
+  if (plan_get_current_block() == NULL && sys.state != STATE_CYCLE) { coolant_set_state(mode); }
+}
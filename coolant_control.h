@@ -34,5 +34,6 @@
 void coolant_init();
 void coolant_stop();
 void coolant_run(uint8_t mode);
+void coolant_set_state(uint8_t mode);
 
 #endif
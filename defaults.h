@@ -52,6 +52,17 @@
   #define DEFAULT_STEPPER_IDLE_LOCK_TIME 25 // msec (0-255)
   #define DEFAULT_DECIMAL_PLACES 3
   #define DEFAULT_N_ARC_CORRECTION 25
+  #define DEFAULT_ARC_TOLERANCE 0.0 // mm. Zero segments arcs by DEFAULT_MM_PER_ARC_SEGMENT.
+  #define DEFAULT_X_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_Y_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_Z_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_X_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_Y_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_Z_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_JERK 0.0 // mm/min^3. Zero ramps linearly, without S-curve.
+  #define DEFAULT_SPINDLE_MAX_RPM 1000.0 // rpm
+  #define DEFAULT_SPINDLE_MIN_RPM 0.0 // rpm
+  #define DEFAULT_LASER_MODE 0 // false
 #endif
 
 #ifdef DEFAULTS_SHERLINE_5400
@@ -83,6 +94,17 @@
   #define DEFAULT_STEPPER_IDLE_LOCK_TIME 25 // msec (0-255)
   #define DEFAULT_DECIMAL_PLACES 3
   #define DEFAULT_N_ARC_CORRECTION 25
+  #define DEFAULT_ARC_TOLERANCE 0.0 // mm. Zero segments arcs by DEFAULT_MM_PER_ARC_SEGMENT.
+  #define DEFAULT_X_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_Y_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_Z_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_X_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_Y_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_Z_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_JERK 0.0 // mm/min^3. Zero ramps linearly, without S-curve.
+  #define DEFAULT_SPINDLE_MAX_RPM 1000.0 // rpm
+  #define DEFAULT_SPINDLE_MIN_RPM 0.0 // rpm
+  #define DEFAULT_LASER_MODE 0 // false
 #endif
 
 #ifdef DEFAULTS_SHAPEOKO
@@ -117,6 +139,17 @@
   #define DEFAULT_STEPPER_IDLE_LOCK_TIME 255 // msec (0-255)
   #define DEFAULT_DECIMAL_PLACES 3
   #define DEFAULT_N_ARC_CORRECTION 25
+  #define DEFAULT_ARC_TOLERANCE 0.0 // mm. Zero segments arcs by DEFAULT_MM_PER_ARC_SEGMENT.
+  #define DEFAULT_X_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_Y_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_Z_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_X_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_Y_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_Z_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_JERK 0.0 // mm/min^3. Zero ramps linearly, without S-curve.
+  #define DEFAULT_SPINDLE_MAX_RPM 1000.0 // rpm
+  #define DEFAULT_SPINDLE_MIN_RPM 0.0 // rpm
+  #define DEFAULT_LASER_MODE 0 // false
 #endif
 
 #ifdef DEFAULTS_ZEN_TOOLWORKS_7x7
@@ -149,6 +182,17 @@
   #define DEFAULT_STEPPER_IDLE_LOCK_TIME 25 // msec (0-255)
   #define DEFAULT_DECIMAL_PLACES 3
   #define DEFAULT_N_ARC_CORRECTION 25
+  #define DEFAULT_ARC_TOLERANCE 0.0 // mm. Zero segments arcs by DEFAULT_MM_PER_ARC_SEGMENT.
+  #define DEFAULT_X_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_Y_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_Z_MAX_RATE DEFAULT_RAPID_FEEDRATE // mm/min
+  #define DEFAULT_X_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_Y_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_Z_ACCELERATION DEFAULT_ACCELERATION // mm/min^2
+  #define DEFAULT_JERK 0.0 // mm/min^3. Zero ramps linearly, without S-curve.
+  #define DEFAULT_SPINDLE_MAX_RPM 1000.0 // rpm
+  #define DEFAULT_SPINDLE_MIN_RPM 0.0 // rpm
+  #define DEFAULT_LASER_MODE 0 // false
 #endif
 
 #endif
@@ -37,6 +37,9 @@
 // Declare gc extern struct
 parser_state_t gc;
 
+static int32_t frame_position[N_AXIS]; // Last frame target in micrometers, work coordinates
+static uint8_t frame_synced;           // Bitflag of axes whose frame_position is valid
+
 #define FAIL(status) gc.status_code = status;
 
 static int next_statement(char *letter, float *float_ptr, char *line, uint8_t *char_counter);
@@ -77,16 +80,37 @@ static float to_millimeters(float value)
 
 // Executes one line of 0-terminated G-Code. The line is assumed to contain only uppercase
 // characters and signed floating point values (no whitespace). Comments and block delete
-// characters have been removed. All units and positions are converted and exported to grbl's
-// internal functions in terms of (mm, mm/min) and absolute machine coordinates, respectively.
-uint8_t gc_execute_line(char *line) 
+// characters have been removed. Used for the startup lines, streamed lines are split into
+// words as they are received by protocol_process().
+uint8_t gc_execute_line(char *line)
+{
+  static gc_block_t block;
+  uint8_t char_counter = 0;
+  gc.status_code = STATUS_OK;
+  block.count = 0;
+  while (block.count < MAX_BLOCK_WORDS &&
+         next_statement(&block.word[block.count].letter, &block.word[block.count].value, line, &char_counter)) {
+    block.count++;
+  }
+  if (block.count == MAX_BLOCK_WORDS && line[char_counter] != 0) { FAIL(STATUS_OVERFLOW); }
+  block.status_code = gc.status_code;
+  return(gc_execute_block(&block));
+}
+
+// Executes one block of G-Code words. All units and positions are converted and exported to
+// grbl's internal functions in terms of (mm, mm/min) and absolute machine coordinates,
+// respectively.
+uint8_t gc_execute_block(gc_block_t *block)
 {
 
   // If in alarm state, don't process. Immediately return with error.
   // NOTE: Might not be right place for this, but also prevents $N storing during alarm.
   if (sys.state == STATE_ALARM) { return(STATUS_ALARM_LOCK); }
- 
-  uint8_t char_counter = 0;  
+
+  // Errors splitting the line into words fail the whole block, before any mode changes.
+  if (block->status_code) { return(block->status_code); }
+
+  uint8_t word_counter;
   char letter;
   float value;
   int int_value;
@@ -97,6 +121,7 @@ uint8_t gc_execute_line(char *line)
   float inverse_feed_rate = -1; // negative inverse_feed_rate means no inverse_feed_rate specified
   uint8_t absolute_override = false; // true(1) = absolute motion for this block only {G53}
   uint8_t non_modal_action = NON_MODAL_NONE; // Tracks the actions of modal group 0 (non-modal)
+  uint8_t blend_path = false; // true(1) = G64 in block, continuous path mode
   
   float target[N_AXIS], offset[N_AXIS];
   clear_vector(target); // XYZ(ABC) axes parameters.
@@ -107,7 +132,9 @@ uint8_t gc_execute_line(char *line)
   /* Pass 1: Commands and set all modes. Check for modal group violations.
      NOTE: Modal group numbers are defined in Table 4 of NIST RS274-NGC v3, pg.20 */
   uint8_t group_number = MODAL_GROUP_NONE;
-  while(next_statement(&letter, &value, line, &char_counter)) {
+  for (word_counter = 0; word_counter < block->count; word_counter++) {
+    letter = block->word[word_counter].letter;
+    value = block->word[word_counter].value;
     int_value = trunc(value);
     switch(letter) {
       case 'G':
@@ -120,6 +147,7 @@ uint8_t gc_execute_line(char *line)
           case 93: case 94: group_number = MODAL_GROUP_5; break;
           case 20: case 21: group_number = MODAL_GROUP_6; break;
           case 54: case 55: case 56: case 57: case 58: case 59: group_number = MODAL_GROUP_12; break;
+          case 61: case 64: group_number = MODAL_GROUP_13; break;
         }          
         // Set 'G' commands
         switch(int_value) {
@@ -148,6 +176,8 @@ uint8_t gc_execute_line(char *line)
           case 54: case 55: case 56: case 57: case 58: case 59:
             gc.coord_select = int_value-54;
             break;
+          case 61: blend_path = false; break;
+          case 64: blend_path = true; break;
           case 80: gc.motion_mode = MOTION_MODE_CANCEL; break;
           case 90: gc.absolute_mode = true; break;
           case 91: gc.absolute_mode = false; break;
@@ -206,8 +236,9 @@ uint8_t gc_execute_line(char *line)
      for different commands. Each will be converted to their proper value upon execution. */
   float p = 0.0, r = 0.0;
   uint8_t l = 0;
-  char_counter = 0;
-  while(next_statement(&letter, &value, line, &char_counter)) {
+  for (word_counter = 0; word_counter < block->count; word_counter++) {
+    letter = block->word[word_counter].letter;
+    value = block->word[word_counter].value;
     switch(letter) {
       case 'G': case 'M': case 'N': break; // Ignore command statements and line numbers
       case 'F': 
@@ -224,8 +255,7 @@ uint8_t gc_execute_line(char *line)
       case 'R': r = to_millimeters(value); break;
       case 'S': 
         if (value < 0) { FAIL(STATUS_INVALID_STATEMENT); } // Cannot be negative
-        // TBD: Spindle speed not supported due to PWM issues, but may come back once resolved.
-        // gc.spindle_speed = value;
+        gc.spindle_speed = value;
         break;
       case 'T': 
         if (value < 0) { FAIL(STATUS_INVALID_STATEMENT); } // Cannot be negative
@@ -251,8 +281,8 @@ uint8_t gc_execute_line(char *line)
   if (sys.state != STATE_CHECK_MODE) { 
     //  ([M6]: Tool change should be executed here.)
 
-    // [M3,M4,M5]: Update spindle state
-    spindle_run(gc.spindle_direction);
+    // [M3,M4,M5,S]: Update spindle state
+    spindle_run(gc.spindle_direction, gc.spindle_speed);
   
     // [*M7,M8,M9]: Update coolant state
     coolant_run(gc.coolant_mode);
@@ -264,6 +294,22 @@ uint8_t gc_execute_line(char *line)
     if (!(settings_read_coord_data(gc.coord_select,coord_data))) { return(STATUS_SETTING_READ_FAIL); } 
     memcpy(gc.coord_system,coord_data,sizeof(coord_data));
   }
+
+  // [G61,G64]: Path control mode. G64 blends corners within the P tolerance. Without P, the corners
+  // are blended for the best speed, only bounded by the line lengths. The P word belongs to G4 or
+  // G10 instead, if one is in the block.
+  if ( bit_istrue(modal_group_words,bit(MODAL_GROUP_13)) ) {
+    if (blend_path) {
+      if (p < 0 || (p > 0 && (non_modal_action == NON_MODAL_DWELL ||
+                              non_modal_action == NON_MODAL_SET_COORDINATE_DATA))) {
+        return(STATUS_INVALID_STATEMENT);
+      }
+      gc.path_tolerance = (p > 0) ? to_millimeters(p) : SOME_LARGE_VALUE;
+    } else {
+      gc.path_tolerance = 0.0;
+    }
+    plan_set_blend_tolerance(gc.path_tolerance);
+  }
   
   // [G4,G10,G28,G30,G92,G92.1]: Perform dwell, set coordinate system data, homing, or set axis offsets.
   // NOTE: These commands are in the same modal group, hence are mutually exclusive. G53 is in this
@@ -323,14 +369,14 @@ uint8_t gc_execute_line(char *line)
             target[i] = gc.position[i];
           }
         }
-        mc_line(target[X_AXIS], target[Y_AXIS], target[Z_AXIS], settings.default_seek_rate, false);
+        mc_line(target[X_AXIS], target[Y_AXIS], target[Z_AXIS], settings.default_seek_rate, PLAN_RAPID);
       }
       // Retreive G28/30 go-home position data (in machine coordinates) from EEPROM
       float coord_data[N_AXIS];
       uint8_t home_select = SETTING_INDEX_G28;
       if (non_modal_action == NON_MODAL_GO_HOME_1) { home_select = SETTING_INDEX_G30; }
       if (!settings_read_coord_data(home_select,coord_data)) { return(STATUS_SETTING_READ_FAIL); }
-      mc_line(coord_data[X_AXIS], coord_data[Y_AXIS], coord_data[Z_AXIS], settings.default_seek_rate, false);
+      mc_line(coord_data[X_AXIS], coord_data[Y_AXIS], coord_data[Z_AXIS], settings.default_seek_rate, PLAN_RAPID);
       memcpy(gc.position, coord_data, sizeof(coord_data)); // gc.position[] = coord_data[];
       axis_words = 0; // Axis words used. Lock out from motion modes by clearing flags.
       break;
@@ -404,7 +450,7 @@ uint8_t gc_execute_line(char *line)
         break;
       case MOTION_MODE_SEEK:
         if (!axis_words) { FAIL(STATUS_INVALID_STATEMENT);} 
-        else { mc_line(target[X_AXIS], target[Y_AXIS], target[Z_AXIS], settings.default_seek_rate, false); }
+        else { mc_line(target[X_AXIS], target[Y_AXIS], target[Z_AXIS], settings.default_seek_rate, PLAN_RAPID); }
         break;
       case MOTION_MODE_LINEAR:
         // TODO: Inverse time requires F-word with each statement. Need to do a check. Also need
@@ -545,6 +591,7 @@ uint8_t gc_execute_line(char *line)
   // M0,M1,M2,M30: Perform non-running program flow actions. During a program pause, the buffer may 
   // refill and can only be resumed by the cycle start run-time command.
   if (gc.program_flow) {
+    mc_arc_finish(); // An arc in this block is only partly buffered yet.
     plan_synchronize(); // Finish all remaining buffered motions. Program paused when complete.
     sys.auto_start = false; // Disable auto cycle start. Forces pause until cycle start issued.
     
@@ -557,6 +604,110 @@ uint8_t gc_execute_line(char *line)
   return(gc.status_code);
 }
 
+void gc_begin_frames()
+{
+  uint8_t i;
+  for (i=0; i<N_AXIS; i++) {
+    frame_position[i] = lround((gc.position[i]-gc.coord_system[i]-gc.coord_offset[i])*1000);
+  }
+  frame_synced = bit(X_AXIS)|bit(Y_AXIS)|bit(Z_AXIS);
+}
+
+// CRC-16-CCITT, bitwise. A frame followed by its own CRC leaves zero.
+static uint16_t frame_crc(uint8_t *data, uint8_t length)
+{
+  uint16_t crc = 0xffff;
+  uint8_t k;
+  while (length--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (k=0; k<8; k++) { crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1); }
+  }
+  return(crc);
+}
+
+// Reads the next little-endian field of a frame and moves past it.
+static int32_t frame_field(uint8_t **data, uint8_t wide)
+{
+  uint8_t *p = *data;
+  if (wide) {
+    *data += 4;
+    return((int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24)));
+  }
+  *data += 2;
+  return((int16_t)(p[0] | (p[1] << 8)));
+}
+
+// Executes one binary motion frame. The target, arc offsets and feed are already in the units
+// the motion control takes, so the frame goes straight to mc_line() or mc_arc() without any of
+// the modal group handling of gc_execute_block().
+uint8_t gc_execute_frame(uint8_t *frame, uint8_t length)
+{
+  if (length < 3 || frame_crc(frame, length)) {
+    frame_synced = 0; // A relative target may have been lost with it.
+    return(STATUS_BAD_FRAME);
+  }
+  length -= 2;
+
+  uint8_t header = frame[0];
+  if (bit_istrue(header,bit(FRAME_CONTROL_BIT))) {
+    if (header != FRAME_EXIT || length != 1) { return(STATUS_UNSUPPORTED_STATEMENT); }
+    return(STATUS_OK); // The caller leaves frame mode.
+  }
+  if (sys.state == STATE_ALARM) { return(STATUS_ALARM_LOCK); }
+
+  uint8_t motion_mode = (header >> FRAME_MOTION_BIT) & 0x03;
+  uint8_t wide = bit_istrue(header,bit(FRAME_WIDE_BIT));
+  uint8_t width = wide ? 4 : 2;
+  uint8_t axis_words = (header >> FRAME_X_BIT) & (bit(X_AXIS)|bit(Y_AXIS)|bit(Z_AXIS));
+  uint8_t i, expected = 1;
+  for (i=0; i<N_AXIS; i++) {
+    if (bit_istrue(axis_words,bit(i))) { expected += width; }
+  }
+  if (motion_mode >= MOTION_MODE_CW_ARC) { expected += 2*width; }
+  if (bit_istrue(header,bit(FRAME_FEED_BIT))) { expected += 4; }
+  if (length != expected || !axis_words) { return(STATUS_BAD_FRAME); }
+  if (!wide && (axis_words & ~frame_synced)) { return(STATUS_BAD_FRAME); } // Not resynchronized yet
+
+  float target[N_AXIS], offset[N_AXIS];
+  uint8_t *data = &frame[1];
+  for (i=0; i<N_AXIS; i++) {
+    if (bit_istrue(axis_words,bit(i))) {
+      if (wide) { frame_position[i] = frame_field(&data, wide); }
+      else { frame_position[i] += frame_field(&data, wide); }
+      target[i] = 0.001*frame_position[i] + gc.coord_system[i] + gc.coord_offset[i];
+    } else {
+      target[i] = gc.position[i]; // Not in the frame. Keep same axis position.
+    }
+  }
+  if (wide) { frame_synced |= axis_words; }
+  clear_vector(offset);
+  if (motion_mode >= MOTION_MODE_CW_ARC) {
+    offset[gc.plane_axis_0] = 0.001*frame_field(&data, wide);
+    offset[gc.plane_axis_1] = 0.001*frame_field(&data, wide);
+  }
+  if (bit_istrue(header,bit(FRAME_FEED_BIT))) {
+    gc.feed_rate = 0.001*(uint32_t)frame_field(&data, true);
+  }
+
+  gc.motion_mode = motion_mode;
+  switch (motion_mode) {
+    case MOTION_MODE_SEEK:
+      mc_line(target[X_AXIS], target[Y_AXIS], target[Z_AXIS], settings.default_seek_rate, PLAN_RAPID);
+      break;
+    case MOTION_MODE_LINEAR:
+      mc_line(target[X_AXIS], target[Y_AXIS], target[Z_AXIS], gc.feed_rate, false);
+      break;
+    default: {
+      float r = hypot(offset[gc.plane_axis_0], offset[gc.plane_axis_1]);
+      if (r == 0) { return(STATUS_INVALID_STATEMENT); }
+      mc_arc(gc.position, target, offset, gc.plane_axis_0, gc.plane_axis_1, gc.plane_axis_2,
+        gc.feed_rate, false, r, (motion_mode == MOTION_MODE_CW_ARC));
+    }
+  }
+  memcpy(gc.position, target, sizeof(target)); // gc.position[] = target[];
+  return(STATUS_OK);
+}
+
 // Parses the next statement and leaves the counter on the first character following
 // the statement. Returns 1 if there was a statements, 0 if end of string was reached
 // or there was an error (check state.status_code).
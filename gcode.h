@@ -38,6 +38,7 @@
 #define MODAL_GROUP_6 7 // [G20,G21] Units
 #define MODAL_GROUP_7 8 // [M3,M4,M5] Spindle turning
 #define MODAL_GROUP_12 9 // [G54,G55,G56,G57,G58,G59] Coordinate system selection
+#define MODAL_GROUP_13 10 // [G61,G64] Path control mode
 
 // Define command actions for within execution-type modal groups (motion, stopping, non-modal). Used
 // internally by the parser to know which command to execute.
@@ -61,6 +62,38 @@
 #define NON_MODAL_SET_COORDINATE_OFFSET 7 // G92
 #define NON_MODAL_RESET_COORDINATE_OFFSET 8 //G92.1
 
+// A g-code block split into words, a command letter with its value each. A word takes at least two
+// characters of a line, so a full line buffer holds no more than MAX_BLOCK_WORDS.
+#define MAX_BLOCK_WORDS 32
+typedef struct {
+  char letter;
+  float value;
+} gc_word_t;
+
+typedef struct {
+  uint8_t status_code;             // First error found while splitting the line into words
+  uint8_t count;                   // Number of words
+  gc_word_t word[MAX_BLOCK_WORDS];
+} gc_block_t;
+
+// Binary motion frames, streamed after '$B' instead of g-code lines. A frame carries one G0-G3
+// motion with the target in fixed-point micrometers of the work coordinate system that was active
+// at '$B', in millimeters and units per minute regardless of G20 and G93. It is laid out as
+//   header, [X] [Y] [Z], [arc offsets along the two plane axes], [feed], CRC
+// with the bracketed fields present according to the header bits below. Coordinates and offsets
+// are little-endian, either int16 relative to the previous target of the axis, or int32 absolute
+// if FRAME_WIDE_BIT is set. The feed is a uint32 in micrometers per minute and stays modal. The
+// CRC is a big-endian CRC-16-CCITT (0x1021, initial 0xffff) of everything before it. Relative
+// coordinates are refused after a frame has been lost, until an absolute one resynchronizes the
+// axis. The header bits are arranged so the common headers need no escaping (see protocol.h).
+#define FRAME_WIDE_BIT 0
+#define FRAME_X_BIT 1          // Axis bits follow in X, Y, Z order
+#define FRAME_FEED_BIT 4
+#define FRAME_MOTION_BIT 5     // Two bits, MOTION_MODE_SEEK to MOTION_MODE_CCW_ARC
+#define FRAME_CONTROL_BIT 7    // Control frame. The header is the whole payload.
+#define FRAME_EXIT 0x80        // Control frame to return to g-code lines
+#define FRAME_MAX_SIZE 27      // Header, three int32 axes, two int32 offsets, feed and CRC
+
 typedef struct {
   uint8_t status_code;             // Parser status for current block
   uint8_t motion_mode;             // {G0, G1, G2, G3, G80}
@@ -74,11 +107,12 @@ typedef struct {
 //  float seek_rate;                 // Millimeters/min. Will be used in v0.9 when axis independence is installed
   float position[3];               // Where the interpreter considers the tool to be at this point in the code
   uint8_t tool;
-//  uint16_t spindle_speed;          // RPM/100
+  float spindle_speed;             // RPM {S}
   uint8_t plane_axis_0,
           plane_axis_1,
           plane_axis_2;            // The axes of the selected plane
   uint8_t coord_select;            // Active work coordinate system number. Default: 0=G54.
+  float path_tolerance;            // Corner blending tolerance in mm. 0 = exact path {G61, G64}
   float coord_system[N_AXIS];      // Current work coordinate system (G54+). Stores offset from absolute machine
                                    // position in mm. Loaded from EEPROM when called.
   float coord_offset[N_AXIS];      // Retains the G92 coordinate offset (work coordinates) relative to
@@ -89,9 +123,18 @@ extern parser_state_t gc;
 // Initialize the parser
 void gc_init();
 
-// Execute one block of rs275/ngc/g-code
+// Execute one block of rs275/ngc/g-code, already split into words
+uint8_t gc_execute_block(gc_block_t *block);
+
+// Execute one line of rs275/ngc/g-code. Splits the line into words first.
 uint8_t gc_execute_line(char *line);
 
+// Start taking binary motion frames from the current parser position
+void gc_begin_frames();
+
+// Check and execute one binary motion frame, CRC included
+uint8_t gc_execute_frame(uint8_t *frame, uint8_t length);
+
 // Set g-code parser position. Input in steps.
 void gc_set_current_position(int32_t x, int32_t y, int32_t z);
 
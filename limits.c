@@ -40,8 +40,6 @@
 #include "limits.h"
 #include "report.h"
 
-#define MICROSECONDS_PER_ACCELERATION_TICK  (1000000/ACCELERATION_TICKS_PER_SECOND)
-
 #ifdef PART_LM4F120H5QR // code for ARM
 	void limit_interrupt( void );
 #endif
@@ -116,180 +114,102 @@ void limits_init()
 }
 
 
-// Moves all specified axes in same specified direction (positive=true, negative=false)
-// and at the homing rate. Homing is a special motion case, where there is only an 
-// acceleration followed by abrupt asynchronous stops by each axes reaching their limit 
-// switch independently. Instead of shoehorning homing cycles into the main stepper 
-// algorithm and overcomplicate things, a stripped-down, lite version of the stepper 
-// algorithm is written here. This also lets users hack and tune this code freely for
-// their own particular needs without affecting the rest of Grbl.
+// Moves the axes of the cycle mask toward their limit switches (approach) or off them at the
+// homing rate, until each has reached the switch state it looks for. The motion is one planned
+// line, so it accelerates and runs like any other motion, up to the max rate of each axis. The
+// stepper interrupt reads the limit pins on every step event and stops each axis on its own at its
+// switch, latching the position there. Status reports and resets are served meanwhile. Returns the
+// axes that never reached their switch state within HOMING_MAX_TRAVEL, or all of them on an abort.
 // NOTE: Only the abort runtime command can interrupt this process.
-static void homing_cycle(uint8_t cycle_mask, int8_t pos_dir, bool invert_pin, float homing_rate) 
+static uint8_t homing_cycle(uint8_t cycle_mask, bool approach, float homing_rate)
 {
-  // Determine governing axes with finest step resolution per distance for the Bresenham
-  // algorithm. This solves the issue when homing multiple axes that have different 
-  // resolutions without exceeding system acceleration setting. It doesn't have to be
-  // perfect since homing locates machine zero, but should create for a more consistent 
-  // and speedy homing routine.
-  // NOTE: For each axes enabled, the following calculations assume they physically move 
-  // an equal distance over each time step until they hit a limit switch, aka dogleg.
-  uint32_t steps[N_AXIS];
-  uint8_t dist = 0;
-  clear_vector(steps);
-  if (cycle_mask & (1<<X_AXIS)) { 
+  // Each axis heads for its switch in the negative direction if its homing direction mask bit is
+  // set, otherwise in the positive direction.
+  float travel = approach ? HOMING_MAX_TRAVEL : -HOMING_MAX_TRAVEL;
+  float target[N_AXIS];
+  uint8_t i, dist = 0;
+  for (i=0; i<N_AXIS; i++) { target[i] = sys.position[i]/settings.steps_per_mm[i]; }
+  if (cycle_mask & (1<<X_AXIS)) {
     dist++;
-    steps[X_AXIS] = lround(settings.steps_per_mm[X_AXIS]); 
+    if (settings.homing_dir_mask & (1<<X_DIRECTION_BIT)) { target[X_AXIS] -= travel; }
+    else { target[X_AXIS] += travel; }
   }
-  if (cycle_mask & (1<<Y_AXIS)) { 
+  if (cycle_mask & (1<<Y_AXIS)) {
     dist++;
-    steps[Y_AXIS] = lround(settings.steps_per_mm[Y_AXIS]); 
+    if (settings.homing_dir_mask & (1<<Y_DIRECTION_BIT)) { target[Y_AXIS] -= travel; }
+    else { target[Y_AXIS] += travel; }
   }
   if (cycle_mask & (1<<Z_AXIS)) {
     dist++;
-    steps[Z_AXIS] = lround(settings.steps_per_mm[Z_AXIS]);
+    if (settings.homing_dir_mask & (1<<Z_DIRECTION_BIT)) { target[Z_AXIS] -= travel; }
+    else { target[Z_AXIS] += travel; }
   }
-  uint32_t step_event_count = max(steps[X_AXIS], max(steps[Y_AXIS], steps[Z_AXIS]));  
-  
-  // To ensure global acceleration is not exceeded, reduce the governing axes nominal rate
-  // by adjusting the actual axes distance traveled per step. This is the same procedure
-  // used in the main planner to account for distance traveled when moving multiple axes.
-  // NOTE: When axis acceleration independence is installed, this will be updated to move
-  // all axes at their maximum acceleration and rate.
-  float ds = step_event_count/sqrt(dist);
 
-  // Compute the adjusted step rate change with each acceleration tick. (in step/min/acceleration_tick)
-  uint32_t delta_rate = ceil( ds*settings.acceleration/(60*ACCELERATION_TICKS_PER_SECOND));
-  
   #ifdef HOMING_RATE_ADJUST
     // Adjust homing rate so a multiple axes moves all at the homing rate independently.
     homing_rate *= sqrt(dist); // Eq. only works if axes values are 1 or 0.
   #endif
-  
-  // Nominal and initial time increment per step. Nominal should always be greater then 3
-  // usec, since they are based on the same parameters as the main stepper routine. Initial
-  // is based on the MINIMUM_STEPS_PER_MINUTE config. Since homing feed can be very slow,
-  // disable acceleration when rates are below MINIMUM_STEPS_PER_MINUTE.
-  uint32_t dt_min = lround(1000000*60/(ds*homing_rate)); // Cruising (usec/step)
-  uint32_t dt = 1000000*60/MINIMUM_STEPS_PER_MINUTE; // Initial (usec/step)
-  if (dt > dt_min) { dt = dt_min; } // Disable acceleration for very slow rates.
-      
-  // Set default out_bits. 
-  uint8_t out_bits0 = settings.invert_mask;
-  out_bits0 ^= (settings.homing_dir_mask & DIRECTION_MASK); // Apply homing direction settings
-  if (!pos_dir) { out_bits0 ^= DIRECTION_MASK; }   // Invert bits, if negative dir.
-  
-  // Initialize stepping variables
-  int32_t counter_x = -(step_event_count >> 1); // Bresenham counters
-  int32_t counter_y = counter_x;
-  int32_t counter_z = counter_x;
-  uint32_t step_delay = dt-settings.pulse_microseconds;  // Step delay after pulse
-  uint32_t step_rate = 0;  // Tracks step rate. Initialized from 0 rate. (in step/min)
-  uint32_t trap_counter = MICROSECONDS_PER_ACCELERATION_TICK/2; // Acceleration trapezoid counter
-  uint8_t out_bits;
-  uint8_t limit_state;
-  for(;;) {
-  
-    // Reset out bits. Both direction and step pins appropriately inverted and set.
-    out_bits = out_bits0;
-    
-    // Get limit pin state.
-    #ifdef PART_LM4F120H5QR // code for ARM
-      limit_state = GPIOPinRead( LIMIT_PORT, LIMIT_MASK );
-    #else // code for AVR
-      limit_state = LIMIT_PIN;
-    #endif
 
-    if (invert_pin) { limit_state ^= LIMIT_MASK; } // If leaving switch, invert to move.
-    
-    // Set step pins by Bresenham line algorithm. If limit switch reached, disable and
-    // flag for completion.
-    if (cycle_mask & (1<<X_AXIS)) {
-      counter_x += steps[X_AXIS];
-      if (counter_x > 0) {
-        if (limit_state & (1<<X_LIMIT_BIT)) { out_bits ^= (1<<X_STEP_BIT); }
-        else { cycle_mask &= ~(1<<X_AXIS); }
-        counter_x -= step_event_count;
-      }
-    }
-    if (cycle_mask & (1<<Y_AXIS)) {
-      counter_y += steps[Y_AXIS];
-      if (counter_y > 0) {
-        if (limit_state & (1<<Y_LIMIT_BIT)) { out_bits ^= (1<<Y_STEP_BIT); }
-        else { cycle_mask &= ~(1<<Y_AXIS); }
-        counter_y -= step_event_count;
-      }
-    }
-    if (cycle_mask & (1<<Z_AXIS)) {
-      counter_z += steps[Z_AXIS];
-      if (counter_z > 0) {
-        if (limit_state & (1<<Z_LIMIT_BIT)) { out_bits ^= (1<<Z_STEP_BIT); }
-        else { cycle_mask &= ~(1<<Z_AXIS); }
-        counter_z -= step_event_count;
-      }
-    }        
-    
-    // Check if we are done or for system abort
-    if (!(cycle_mask) || (sys.execute & EXEC_RESET)) { return; }
-        
-    // Perform step.
-    #ifdef PART_LM4F120H5QR // code for ARM
-      GPIOPinWrite( STEPPING_PORT, STEP_MASK, out_bits );
-      delay_us(settings.pulse_microseconds);
-      GPIOPinWrite( STEPPING_PORT, STEP_MASK, out_bits0 );
-      delay_us(step_delay);
-    #else // code for AVR
-      STEPPING_PORT = (STEPPING_PORT & ~STEP_MASK) | (out_bits & STEP_MASK);
-      delay_us(settings.pulse_microseconds);
-      STEPPING_PORT = out_bits0;
-      delay_us(step_delay);
-    #endif
-    
-    // Track and set the next step delay, if required. This routine uses another Bresenham
-    // line algorithm to follow the constant acceleration line in the velocity and time 
-    // domain. This is a lite version of the same routine used in the main stepper program.
-    if (dt > dt_min) { // Unless cruising, check for time update.
-      trap_counter += dt; // Track time passed since last update.
-      if (trap_counter > MICROSECONDS_PER_ACCELERATION_TICK) {
-        trap_counter -= MICROSECONDS_PER_ACCELERATION_TICK;
-        step_rate += delta_rate; // Increment velocity
-        dt = (1000000*60)/step_rate; // Compute new time increment
-        if (dt < dt_min) {dt = dt_min;}  // If target rate reached, cruise.
-        step_delay = dt-settings.pulse_microseconds;
-      }
-    }
+  // Plan the motion from where the last one stopped, and run it
+  plan_set_current_position(sys.position[X_AXIS], sys.position[Y_AXIS], sys.position[Z_AXIS]);
+  plan_buffer_line(target[X_AXIS], target[Y_AXIS], target[Z_AXIS], homing_rate, PLAN_NO_OVERRIDE);
+  plan_flush_line(); // Nothing to blend with. Do not hold it back in G64.
+  st_homing_start(cycle_mask, !approach);
+  while (st_homing_running()) {
+    protocol_execute_runtime(); // Prepares the step segments, reports status and checks for reset.
+    if (sys.abort) { return(cycle_mask); }
+  }
+
+  // Drop the rest of the motion. The axes stopped at their switches, short of the target.
+  st_reset();
+  plan_reset_buffer();
+  return(st_homing_axes());
+}
+
+// Waits for the limit switches to settle, serving status reports and resets meanwhile
+static void homing_debounce()
+{
+  uint16_t ms = settings.homing_debounce_delay;
+  while (ms-- && !sys.abort) {
+    delay_ms(1);
+    protocol_execute_runtime();
   }
 }
 
 
 void limits_go_home() 
 {  
-  // Enable only the steppers, not the cycle. Cycle should be inactive/complete.
-  st_wake_up();
-  
   // Search to engage all axes limit switches at faster homing seek rate.
-  homing_cycle(HOMING_SEARCH_CYCLE_0, true, false, settings.homing_seek_rate);  // Search cycle 0
+  uint8_t missed = homing_cycle(HOMING_SEARCH_CYCLE_0, true, settings.homing_seek_rate);  // Search cycle 0
   #ifdef HOMING_SEARCH_CYCLE_1
-    homing_cycle(HOMING_SEARCH_CYCLE_1, true, false, settings.homing_seek_rate);  // Search cycle 1
+    if (!missed) { missed = homing_cycle(HOMING_SEARCH_CYCLE_1, true, settings.homing_seek_rate); } // Search cycle 1
   #endif
   #ifdef HOMING_SEARCH_CYCLE_2
-    homing_cycle(HOMING_SEARCH_CYCLE_2, true, false, settings.homing_seek_rate);  // Search cycle 2
+    if (!missed) { missed = homing_cycle(HOMING_SEARCH_CYCLE_2, true, settings.homing_seek_rate); } // Search cycle 2
   #endif
-  delay_ms(settings.homing_debounce_delay); // Delay to debounce signal
+  homing_debounce();
     
   // Now in proximity of all limits. Carefully leave and approach switches in multiple cycles
   // to precisely hone in on the machine zero location. Moves at slower homing feed rate.
   int8_t n_cycle = N_HOMING_LOCATE_CYCLE;
-  while (n_cycle--) {
+  while (n_cycle-- && !missed) {
     // Leave all switches to release them. After cycles complete, this is machine zero.
-    homing_cycle(HOMING_LOCATE_CYCLE, false, true, settings.homing_feed_rate);
-    delay_ms(settings.homing_debounce_delay);
+    missed = homing_cycle(HOMING_LOCATE_CYCLE, false, settings.homing_feed_rate);
+    homing_debounce();
     
-    if (n_cycle > 0) {
+    if (n_cycle > 0 && !missed) {
       // Re-approach all switches to re-engage them.
-      homing_cycle(HOMING_LOCATE_CYCLE, true, false, settings.homing_feed_rate);
-      delay_ms(settings.homing_debounce_delay);
+      missed = homing_cycle(HOMING_LOCATE_CYCLE, true, settings.homing_feed_rate);
+      homing_debounce();
     }
   }
 
   st_go_idle(); // Call main stepper shutdown routine.  
+
+  // An axis that never found its switch leaves the machine position unknown
+  if (missed && !sys.abort) {
+    sys.state = STATE_ALARM;
+    report_alarm_message(ALARM_HOMING_FAIL);
+    mc_reset();
+  }
 }
@@ -50,6 +50,7 @@
 #include "report.h"
 #include "settings.h"
 #include "serial.h"
+#include "profile.h"
 
 // Declare system global variable structure
 system_t sys; 
@@ -66,6 +67,9 @@ int main(void)
   serial_init(); // Setup serial baud rate and interrupts
   settings_init(); // Load grbl settings from EEPROM
   st_init(); // Setup stepper pins and interrupt timers
+  #ifdef ISR_PROFILE
+    profile_init(); // Start the cycle counter
+  #endif
 
 #ifdef PART_LM4F120H5QR // ARM code
   IntMasterEnable();
@@ -86,6 +90,7 @@ int main(void)
       // Reset system.
       serial_reset_read_buffer(); // Clear serial read buffer
       plan_init(); // Clear block buffer and planner variables
+      mc_init(); // Drop any arc in progress
       gc_init(); // Set g-code parser to default state
       protocol_init(); // Clear incoming line data and execute startup lines
       spindle_init();
@@ -101,6 +106,9 @@ int main(void)
       sys.abort = false;
       sys.execute = 0;
       if (bit_istrue(settings.flags,BITFLAG_AUTO_START)) { sys.auto_start = true; }
+      sys.feed_override = 100;
+      sys.rapid_override = 100;
+      sys.spindle_override = 100;
       
       // Check for power-up and set system alarm if homing is enabled to force homing cycle
       // by setting Grbl's alarm state. Alarm locks out all g-code commands, including the
@@ -124,7 +132,12 @@ int main(void)
     }
     
     protocol_execute_runtime();
+    mc_arc_continue(); // Feed the planner from an arc in progress, if any
     protocol_process(); // ... process the serial protocol
+
+    // Nothing may follow the line held back for corner blending (G64) soon enough. Buffer it before
+    // the planner runs out of motion without it.
+    if (plan_get_block_buffer_count() < 2) { plan_flush_line(); }
     
     // When the serial protocol returns, there are no more characters in the serial read buffer to
     // be processed and executed. This indicates that individual commands are being issued or 
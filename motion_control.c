@@ -48,8 +48,9 @@
 #endif
 
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
-// unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
-// (1 minute)/feed_rate time.
+// unless PLAN_INVERSE_TIME is set in the motion flags, or a true invert_feed_rate passed for them.
+// Then the feed_rate means that the motion should be completed in (1 minute)/feed_rate time.
+// PLAN_RAPID marks a seek motion for the rapid override.
 // NOTE: This is the primary gateway to the grbl planner. All line motions, including arc line 
 // segments, must pass through this routine before being passed to the planner. The seperation of
 // mc_line and plan_buffer_line is done primarily to make backlash compensation or canned cycle
@@ -58,7 +59,7 @@
 // However, this keeps the memory requirements lower since it doesn't have to call and hold two 
 // plan_buffer_lines in memory. Grbl only has to retain the original line input variables during a
 // backlash segment(s).
-void mc_line(float x, float y, float z, float feed_rate, uint8_t invert_feed_rate)
+void mc_line(float x, float y, float z, float feed_rate, uint8_t motion_flags)
 {
   // TODO: Perform soft limit check here. Just check if the target x,y,z values are outside the 
   // work envelope. Should be straightforward and efficient. By placing it here, rather than in 
@@ -74,13 +75,16 @@ void mc_line(float x, float y, float z, float feed_rate, uint8_t invert_feed_rat
   // i.e. keep the planner independent and do the computations in the status reporting, or let
   // the planner handle the position corrections. The latter may get complicated.
 
-  // If the buffer is full: good! That means we are well ahead of the robot. 
-  // Remain in this loop until there is room in the buffer.
+  // If the buffer is full: good! That means we are well ahead of the robot.
+  // Remain in this loop until there is room in the buffer. Auto-cycle start here as well, since
+  // a streaming host may keep the serial buffer from emptying and the main loop would never do it.
   do {
     protocol_execute_runtime(); // Check for any run-time commands
     if (sys.abort) { return; } // Bail, if system abort.
-  } while ( plan_check_full_buffer() );
-  plan_buffer_line(x, y, z, feed_rate, invert_feed_rate);
+    if (!plan_check_full_buffer()) { break; }
+    if (sys.auto_start) { st_cycle_start(); }
+  } while (1);
+  plan_buffer_line(x, y, z, feed_rate, motion_flags);
 
   // If idle, indicate to the system there is now a planned block in the buffer ready to cycle 
   // start. Otherwise ignore and continue on.
@@ -98,15 +102,46 @@ void mc_line(float x, float y, float z, float feed_rate, uint8_t invert_feed_rat
 }
 
 
+// Arc being fed to the planner a few segments at a time. mc_arc() sets it up and mc_arc_continue()
+// generates the segments, so the main loop never waits on a full planner for the length of an arc.
+typedef struct {
+  float center_axis0, center_axis1; // Circle center in the plane of the arc
+  float r_axis0, r_axis1;           // Radius vector from center to the last segment end
+  float offset0, offset1;           // Offset from the arc start to the center, for arc correction
+  float cos_T, sin_T;               // Rotation matrix of one segment
+  float theta_per_segment;
+  float linear_per_segment;
+  float arc_target[3];              // End of the last segment
+  float target[3];                  // End of the arc
+  float feed_rate;
+  uint8_t invert_feed_rate;
+  uint8_t axis_0, axis_1, axis_linear;
+  uint16_t segments;                // Number of segments. Zero when no arc is in progress.
+  uint16_t i;                       // Index of the next segment
+  int8_t count;                     // Segments since the last arc correction
+} arc_t;
+static arc_t arc;
+
+void mc_init()
+{
+  arc.segments = 0;
+}
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz, 
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, isclockwise boolean. Used
 // for vector transformation direction.
 // The arc is approximated by generating a huge number of tiny, linear segments. The length of each
-// segment is configured in settings.mm_per_arc_segment.
+// segment is configured in settings.mm_per_arc_segment, or follows from the radius when a chord
+// tolerance is set in settings.arc_tolerance.
+// NOTE: Only sets up the arc and buffers the segments the planner has room for. The main loop
+// buffers the rest through mc_arc_continue() and executes no other command until it is done.
 void mc_arc(float *position, float *target, float *offset, uint8_t axis_0, uint8_t axis_1,
   uint8_t axis_linear, float feed_rate, uint8_t invert_feed_rate, float radius, uint8_t isclockwise)
 {      
+  // If in check gcode mode, there is nothing to generate. mc_line() would discard the segments.
+  if (sys.state == STATE_CHECK_MODE) { return; }
+
   float center_axis0 = position[axis_0] + offset[axis_0];
   float center_axis1 = position[axis_1] + offset[axis_1];
   float linear_travel = target[axis_linear] - position[axis_linear];
@@ -125,14 +160,24 @@ void mc_arc(float *position, float *target, float *offset, uint8_t axis_0, uint8
 
   float millimeters_of_travel = hypot(angular_travel*radius, fabs(linear_travel));
   if (millimeters_of_travel == 0.0) { return; }
-  uint16_t segments = floor(millimeters_of_travel/settings.mm_per_arc_segment);
+  uint16_t segments;
+  if (settings.arc_tolerance > 0) {
+    // Largest angle whose chord stays within arc_tolerance of the arc: r*(1-cos(theta/2)) <= tolerance.
+    // Since 1-cos(x) < x^2/2, theta = 2*sqrt(2*tolerance/r) always holds it without an acos().
+    float theta_max = M_PI;
+    if (settings.arc_tolerance < radius) { theta_max = 2*sqrtf(2*settings.arc_tolerance/radius); }
+    segments = ceilf(fabsf(angular_travel)/theta_max);
+  } else {
+    segments = floor(millimeters_of_travel/settings.mm_per_arc_segment);
+  }
+  if (segments == 0) { segments = 1; } // The last segment always goes to the target.
   // Multiply inverse feed_rate to compensate for the fact that this movement is approximated
   // by a number of discrete segments. The inverse feed_rate should be correct for the sum of
   // all segments.
   if (invert_feed_rate) { feed_rate *= segments; }
 
-  float theta_per_segment = angular_travel/segments;
-  float linear_per_segment = linear_travel/segments;
+  arc.theta_per_segment = angular_travel/segments;
+  arc.linear_per_segment = linear_travel/segments;
 
   /* Vector rotation by transformation matrix: r is the original vector, r_T is the rotated vector,
      and phi is the angle of rotation. Solution approach by Jens Geisler.
@@ -158,65 +203,114 @@ void mc_arc(float *position, float *target, float *offset, uint8_t axis_0, uint8
      without the initial overhead of computing cos() or sin(). By the time the arc needs to be applied
      a correction, the planner should have caught up to the lag caused by the initial mc_arc overhead.
      This is important when there are successive arc motions.
+
+     With a chord tolerance, segments are as long as the tolerance allows and theta_per_segment
+     easily exceeds 0.1 rad on small circles, so the rotation matrix is computed exactly instead.
+     There are few segments to generate then, which leaves time for the cos() and sin().
   */
   // Vector rotation matrix values
-  float cos_T = 1-0.5*theta_per_segment*theta_per_segment; // Small angle approximation
-  float sin_T = theta_per_segment;
+  if (settings.arc_tolerance > 0) {
+    arc.cos_T = cosf(arc.theta_per_segment);
+    arc.sin_T = sinf(arc.theta_per_segment);
+  } else {
+    arc.cos_T = 1-0.5*arc.theta_per_segment*arc.theta_per_segment; // Small angle approximation
+    arc.sin_T = arc.theta_per_segment;
+  }
 
-  float arc_target[3];
-  float sin_Ti;
+  arc.center_axis0 = center_axis0;
+  arc.center_axis1 = center_axis1;
+  arc.r_axis0 = r_axis0;
+  arc.r_axis1 = r_axis1;
+  arc.offset0 = offset[axis_0];
+  arc.offset1 = offset[axis_1];
+  arc.arc_target[axis_linear] = position[axis_linear]; // Initialize the linear axis
+  memcpy(arc.target, target, sizeof(arc.target));
+  arc.feed_rate = feed_rate;
+  arc.invert_feed_rate = invert_feed_rate;
+  arc.axis_0 = axis_0;
+  arc.axis_1 = axis_1;
+  arc.axis_linear = axis_linear;
+  arc.i = 1;
+  arc.count = 0;
+  arc.segments = segments;
+
+  mc_arc_continue();
+}
+
+// Buffers segments of the arc in progress until the planner is full or the arc is done. Never
+// waits for the planner. Returns true while the arc has segments left.
+uint8_t mc_arc_continue()
+{
   float cos_Ti;
+  float sin_Ti;
   float r_axisi;
-  uint16_t i;
-  int8_t count = 0;
 
-  // Initialize the linear axis
-  arc_target[axis_linear] = position[axis_linear];
+  while (arc.segments) {
+    if (sys.abort) { return(false); } // Bail mid-circle on system abort. The reset clears the arc.
+    if (plan_check_full_buffer()) {
+      // Keep the steppers going while the arc waits, as mc_line() does in its wait loop.
+      if (sys.auto_start) { st_cycle_start(); }
+      return(true);
+    }
 
-  for (i = 1; i<segments; i++) { // Increment (segments-1)
+    if (arc.i == arc.segments) {
+      // Ensure last segment arrives at target location.
+      arc.segments = 0;
+      mc_line(arc.target[X_AXIS], arc.target[Y_AXIS], arc.target[Z_AXIS], arc.feed_rate, arc.invert_feed_rate);
+      break;
+    }
 
-    if (count < settings.n_arc_correction) {
+    if (arc.count < settings.n_arc_correction) {
       // Apply vector rotation matrix
-      r_axisi = r_axis0*sin_T + r_axis1*cos_T;
-      r_axis0 = r_axis0*cos_T - r_axis1*sin_T;
-      r_axis1 = r_axisi;
-      count++;
+      r_axisi = arc.r_axis0*arc.sin_T + arc.r_axis1*arc.cos_T;
+      arc.r_axis0 = arc.r_axis0*arc.cos_T - arc.r_axis1*arc.sin_T;
+      arc.r_axis1 = r_axisi;
+      arc.count++;
     } else {
       // Arc correction to radius vector. Computed only every n_arc_correction increments.
       // Compute exact location by applying transformation matrix from initial radius vector(=-offset).
-      cos_Ti = cos(i*theta_per_segment);
-      sin_Ti = sin(i*theta_per_segment);
-      r_axis0 = -offset[axis_0]*cos_Ti + offset[axis_1]*sin_Ti;
-      r_axis1 = -offset[axis_0]*sin_Ti - offset[axis_1]*cos_Ti;
-      count = 0;
+      cos_Ti = cos(arc.i*arc.theta_per_segment);
+      sin_Ti = sin(arc.i*arc.theta_per_segment);
+      arc.r_axis0 = -arc.offset0*cos_Ti + arc.offset1*sin_Ti;
+      arc.r_axis1 = -arc.offset0*sin_Ti - arc.offset1*cos_Ti;
+      arc.count = 0;
     }
 
     // Update arc_target location
-    arc_target[axis_0] = center_axis0 + r_axis0;
-    arc_target[axis_1] = center_axis1 + r_axis1;
-    arc_target[axis_linear] += linear_per_segment;
-    mc_line(arc_target[X_AXIS], arc_target[Y_AXIS], arc_target[Z_AXIS], feed_rate, invert_feed_rate);
+    arc.arc_target[arc.axis_0] = arc.center_axis0 + arc.r_axis0;
+    arc.arc_target[arc.axis_1] = arc.center_axis1 + arc.r_axis1;
+    arc.arc_target[arc.axis_linear] += arc.linear_per_segment;
+    arc.i++;
+    mc_line(arc.arc_target[X_AXIS], arc.arc_target[Y_AXIS], arc.arc_target[Z_AXIS], arc.feed_rate,
+      arc.invert_feed_rate);
+  }
+  return(false);
+}
+
+// Returns true while an arc is being fed to the planner.
+uint8_t mc_arc_pending() { return(arc.segments != 0); }
 
-    // Bail mid-circle on system abort. Runtime command check already performed by mc_line.
-    if (sys.abort) { return; }
+// Buffers the rest of the arc in progress, waiting for room in the planner like mc_line() does.
+void mc_arc_finish()
+{
+  while (mc_arc_continue()) {
+    protocol_execute_runtime(); // Check for any run-time commands
   }
-  // Ensure last segment arrives at target location.
-  mc_line(target[X_AXIS], target[Y_AXIS], target[Z_AXIS], feed_rate, invert_feed_rate);
 }
 
 
-// Execute dwell in seconds.
+// Execute dwell in seconds. Queued as a planner block, so the steppers time it in line with the
+// motion and the parser keeps filling the buffer behind it, as for mc_line().
 void mc_dwell(float seconds) 
 {
-   uint16_t i = floor(1000/DWELL_TIME_STEP*seconds);
-   plan_synchronize();
-   delay_ms(floor(1000*seconds-i*DWELL_TIME_STEP)); // Delay millisecond remainder
-   while (i-- > 0) {
-     // NOTE: Check and execute runtime commands during dwell every <= DWELL_TIME_STEP milliseconds.
-     protocol_execute_runtime();
-     if (sys.abort) { return; }
-     _delay_ms(DWELL_TIME_STEP); // Delay DWELL_TIME_STEP increment
-   }
+  do {
+    protocol_execute_runtime(); // Check for any run-time commands
+    if (sys.abort) { return; } // Bail, if system abort.
+    if (!plan_check_full_buffer()) { break; }
+    if (sys.auto_start) { st_cycle_start(); }
+  } while (1);
+  plan_buffer_dwell(seconds);
+  if (!sys.state) { sys.state = STATE_QUEUED; }
 }
 
 
@@ -239,8 +333,13 @@ void mc_go_home()
   if (sys.abort) { return; } // Did not complete. Alarm state set by mc_alarm.
 
   // The machine should now be homed and machine zero has been located. Upon completion, 
-  // reset system position and sync internal position vectors.
-  clear_vector_float(sys.position); // Set machine zero
+  // reset system position and sync internal position vectors. Machine zero is where the last
+  // locate cycle latched each axis leaving its switch.
+  uint8_t i;
+  for (i=0; i<N_AXIS; i++) {
+    if (HOMING_LOCATE_CYCLE & (1<<i)) { sys.position[i] -= sys.homing_latch[i]; }
+    else { sys.position[i] = 0; }
+  }
   sys_sync_current_position();
   sys.state = STATE_IDLE; // Set system state to IDLE to complete motion and indicate homed.
   
@@ -262,7 +361,8 @@ void mc_go_home()
     else { z_dir = -1; }
   }
   mc_line(x_dir*settings.homing_pulloff, y_dir*settings.homing_pulloff, 
-          z_dir*settings.homing_pulloff, settings.homing_seek_rate, false);
+          z_dir*settings.homing_pulloff, settings.homing_seek_rate, PLAN_NO_OVERRIDE);
+  plan_flush_line(); // Nothing to blend with. Do not hold it back in G64.
   st_cycle_start(); // Move it. Nothing should be in the buffer except this motion. 
   plan_synchronize(); // Make sure the motion completes.
   
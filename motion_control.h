@@ -25,18 +25,32 @@
 #include "planner.h"
 
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
-// unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
-// (1 minute)/feed_rate time.
-void mc_line(float x, float y, float z, float feed_rate, uint8_t invert_feed_rate);
+// unless PLAN_INVERSE_TIME is set in the motion flags (see planner.h). Then the feed_rate means
+// that the motion should be completed in (1 minute)/feed_rate time.
+void mc_line(float x, float y, float z, float feed_rate, uint8_t motion_flags);
 
 // Execute an arc in offset mode format. position == current xyz, target == target xyz, 
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, isclockwise boolean. Used
 // for vector transformation direction.
+// NOTE: Returns with the arc in progress. Nothing else may be buffered until mc_arc_pending() is false.
 void mc_arc(float *position, float *target, float *offset, uint8_t axis_0, uint8_t axis_1,
   uint8_t axis_linear, float feed_rate, uint8_t invert_feed_rate, float radius, uint8_t isclockwise);
+
+// Buffers more segments of the arc in progress, as many as the planner has room for. Called from
+// the main loop. Returns true while the arc has segments left.
+uint8_t mc_arc_continue();
+
+// Returns true while an arc is being fed to the planner.
+uint8_t mc_arc_pending();
+
+// Buffers the rest of the arc in progress before returning. For commands in the same block as the arc.
+void mc_arc_finish();
+
+// Drops the arc in progress. Called upon system reset.
+void mc_init();
   
-// Dwell for a specific number of seconds
+// Dwell for a specific number of seconds, queued behind the buffered motion
 void mc_dwell(float seconds);
 
 // Perform homing cycle to locate machine zero. Requires limit switches.
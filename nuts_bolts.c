@@ -30,7 +30,6 @@
 #include "gcode.h"
 #include "planner.h"
 
-#define MAX_INT_DIGITS 8 // Maximum number of digits in int32 (and float)
 ///extern float __floatunsisf (unsigned long);
 
 // Extracts a floating point value from a string. The following code is based loosely on
@@ -83,6 +82,21 @@ int read_float(char *line, uint8_t *char_counter, float *float_ptr)
   // Return if no digits have been read.
   if (!ndigit) { return(false); };
 
+  // Assign floating point value with correct sign.    
+  if (isnegative) {
+    *float_ptr = -decimal_to_float(intval, exp);
+  } else {
+    *float_ptr = decimal_to_float(intval, exp);
+  }
+
+  *char_counter = ptr - line - 1; // Set char_counter to next statement
+
+  return(true);
+}
+
+
+float decimal_to_float(uint32_t intval, int8_t exp)
+{
   // Convert integer into floating point.
   ///float fval;
   ///fval = __floatunsisf(intval);
@@ -103,17 +117,7 @@ int read_float(char *line, uint8_t *char_counter, float *float_ptr)
       } while (--exp > 0);
     }
   }
-
-  // Assign floating point value with correct sign.    
-  if (isnegative) {
-    *float_ptr = -fval;
-  } else {
-    *float_ptr = fval;
-  }
-
-  *char_counter = ptr - line - 1; // Set char_counter to next statement
-
-  return(true);
+  return(fval);
 }
 
 
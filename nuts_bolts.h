@@ -39,6 +39,8 @@
 #define MM_PER_INCH (25.40)
 #define INCH_PER_MM (0.0393701)
 
+#define SOME_LARGE_VALUE 1.0E+38f // Initial value of a search for the minimum of float values
+
 // Useful macros
 #define clear_vector(a) memset(a, 0, sizeof(a))
 #define clear_vector_float(a) memset(a, 0.0, sizeof(float)*N_AXIS)
@@ -65,7 +67,7 @@
 #define EXEC_RESET          bit(4) // bitmask 00010000
 #define EXEC_ALARM          bit(5) // bitmask 00100000
 #define EXEC_CRIT_EVENT     bit(6) // bitmask 01000000
-// #define                  bit(7) // bitmask 10000000
+#define EXEC_OVERRIDE       bit(7) // bitmask 10000000
 
 // Define system state bit map. The state variable primarily tracks the individual functions
 // of Grbl to manage each without overlapping. It is also used as a messaging flag for
@@ -87,8 +89,13 @@ typedef struct {
   volatile uint8_t execute;      // Global system runtime executor bitflag variable. See EXEC bitmasks.
   //replaced position of auto_start to avoid LM4F120 issue with non-word-aligned addressing of 16-bit and 32-bit variables
   uint8_t auto_start;            // Planner auto-start flag. Toggled off during feed hold. Defaulted by settings.
+  uint8_t feed_override;         // Feed rate override in percent. Set by the override commands.
+  uint8_t rapid_override;        // Rapid (seek) rate override in percent
+  uint8_t spindle_override;      // Spindle speed override in percent
   int32_t position[N_AXIS];      // Real-time machine (aka home) position vector in steps. 
                                  // NOTE: This may need to be a volatile variable, if problems arise.   
+  int32_t homing_latch[N_AXIS];  // Machine position in steps at which the homing cycle last found
+                                 // the limit switch state of each axis
 } system_t;
 extern system_t sys;
 
@@ -97,6 +104,14 @@ extern system_t sys;
 // a pointer to the result variable. Returns true when it succeeds
 int read_float(char *line, uint8_t *char_counter, float *float_ptr);
 
+// Maximum number of decimal digits accumulated into an integer by read_float() and the line
+// tokenizer. Further digits are dropped.
+#define MAX_INT_DIGITS 8
+
+// Converts the digits of a decimal number, accumulated into an integer, and its power of ten
+// exponent into floating point.
+float decimal_to_float(uint32_t intval, int8_t exp);
+
 // Delays variable-defined milliseconds. Compiler compatibility fix for _delay_ms().
 void delay_ms(uint16_t ms);
 
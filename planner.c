@@ -31,9 +31,25 @@
 #include "config.h"
 #include "protocol.h"
 
+// Entry and exit factors of calculate_trapezoid_for_block() in fixed point, Q32 below 1.0
+#define TRAPEZOID_FACTOR_BITS 32
+#define TRAPEZOID_FACTOR_ONE 4294967296.0f
+
+// G64 corner blending. Corners the junction speed takes at full speed anyway (cos > 0.95) and
+// corners sharper than BLEND_MAX_ANGLE radians are left as they are. The fillet is cut into chords
+// turning by BLEND_SEGMENT_ANGLE radians each, but no more than BLEND_MAX_SEGMENTS chords.
+#define BLEND_MIN_COS 0.95f
+#define BLEND_MAX_ANGLE 2.4f
+#define BLEND_SEGMENT_ANGLE 0.3f
+#define BLEND_MAX_SEGMENTS 6
+#if BLOCK_BUFFER_SIZE < 2*(BLEND_MAX_SEGMENTS+2)
+  #error "BLOCK_BUFFER_SIZE is too small to blend corners"
+#endif
+
 static block_t block_buffer[BLOCK_BUFFER_SIZE];  // A ring buffer for motion instructions
 static volatile uint8_t block_buffer_head;       // Index of the next block to be pushed
 static volatile uint8_t block_buffer_tail;       // Index of the block to process now
+static uint8_t block_buffer_planned;             // Index of the last block with a final entry speed
 static uint8_t next_buffer_head;                 // Index of the next buffer head
 
 // Define planner variables
@@ -43,6 +59,15 @@ typedef struct {
                                    // i.e. arcs, canned cycles, and backlash compensation.
   float previous_unit_vec[3];     // Unit vector of previous path line segment
   float previous_nominal_speed;   // Nominal speed of previous path line segment
+  float blend_tolerance;          // Deviation from the corners allowed in mm (G64). Zero for exact path (G61).
+  uint8_t line_held;              // True while the last line is held back to blend it with the next one
+  float line_start[3];            // Start of the held line in mm, where the fillet of its start corner ends
+  float line_end[3];              // End of the held line in mm, or of the last line buffered
+  float line_feed_rate;           // Feed rate of the held line in mm/min
+  uint8_t line_flags;             // Motion flags of the held line
+  int8_t spindle_direction;       // Spindle direction of the blocks buffered from now on
+  float spindle_speed;            // Spindle speed of the blocks buffered from now on in rpm
+  uint8_t coolant_mode;           // Coolant mode of the blocks buffered from now on
 } planner_t;
 
 static planner_t pl;
@@ -66,92 +91,110 @@ static uint8_t prev_block_index(uint8_t block_index)
 }
 
 
-// Calculates the distance (not time) it takes to accelerate from initial_rate to target_rate using the
-// given acceleration:
-static float estimate_acceleration_distance(float initial_rate, float target_rate, float acceleration)
+// S-curve ramps. With a jerk setting, the acceleration of a ramp rises at the jerk to at most the
+// block acceleration, holds there and falls back at the jerk. Rising and falling take a speed change
+// of corner = acceleration^2/jerk between them. A ramp with a smaller speed change peaks below the
+// block acceleration. Its speed curve is symmetric about its middle, so it covers its mean speed
+// times its duration. With a corner of zero, both are those of the linear ramp. The same functions
+// serve speeds in mm/min and step rates in step/min.
+static float ramp_duration(float acceleration, float corner, float speed_change)
 {
-  return( (target_rate*target_rate-initial_rate*initial_rate)/(2*acceleration) );
+  if (speed_change >= corner) { return((speed_change+corner)/acceleration); }
+  return(2*sqrtf(speed_change*corner)/acceleration);
 }
 
+static float ramp_distance(float acceleration, float corner, float from_speed, float to_speed)
+{
+  return(0.5f*(from_speed+to_speed)*ramp_duration(acceleration, corner, fabsf(to_speed-from_speed)));
+}
 
-/*                        + <- some maximum rate we don't care about
-                         /|\
-                        / | \
-                       /  |  + <- final_rate
-                      /   |  |
-     initial_rate -> +----+--+
-                          ^  ^
-                          |  |
-      intersection_distance  distance                                                                           */
-// This function gives you the point at which you must start braking (at the rate of -acceleration) if
-// you started at speed initial_rate and accelerated until this point and want to end at the final_rate after
-// a total travel of distance. This can be used to compute the intersection point between acceleration and
-// deceleration in the cases where the trapezoid has no plateau (i.e. never reaches maximum speed)
-static float intersection_distance(float initial_rate, float final_rate, float acceleration, float distance)
+// Returns the speed a ramp starting at the given speed reaches within the distance, the inverse of
+// ramp_distance(). Ramps reaching the block acceleration solve a quadratic. Shorter ones solve
+// s^3 + 2*speed*s = distance*acceleration/sqrt(corner) for s = sqrt(speed change), by Newton's method
+// from above, where it converges monotonically.
+static float ramp_end_speed(float acceleration, float corner, float speed, float distance)
 {
-  return( (2*acceleration*distance-initial_rate*initial_rate+final_rate*final_rate)/(4*acceleration) );
+  if (distance <= 0.0f) { return(speed); }
+  if (distance >= (2*speed+corner)*corner/acceleration) {
+    float b = 2*speed-corner;
+    return(0.5f*(sqrtf(b*b+8*acceleration*distance)-corner));
+  }
+  float q = distance*acceleration/sqrtf(corner);
+  float s = cbrtf(q);
+  if (speed > 0.0f) { s = min(s, 0.5f*q/speed); }
+  uint8_t i;
+  for (i=0; i<4; i++) { s -= (s*(s*s+2*speed)-q)/(3*s*s+2*speed); }
+  return(speed+s*s);
 }
 
 
 // Calculates the maximum allowable speed at this point when you must be able to reach target_velocity
-// using the acceleration within the allotted distance.
+// using the acceleration within the allotted distance. With a jerk setting, the ramp is an S-curve.
 // NOTE: sqrt() reimplimented here from prior version due to improved planner logic. Increases speed
 // in time critical computations, i.e. arcs or rapid short lines from curves. Guaranteed to not exceed
 // BLOCK_BUFFER_SIZE calls per planner cycle.
 static float max_allowable_speed(float acceleration, float target_velocity, float distance)
 {
-  return( sqrt(target_velocity*target_velocity-2*acceleration*distance) );
+  if (settings.jerk <= 0.0f) {
+    return( sqrtf(target_velocity*target_velocity+2*acceleration*distance) );
+  }
+  return( ramp_end_speed(acceleration, acceleration*acceleration/settings.jerk, target_velocity, distance) );
 }
 
 
 // The kernel called by planner_recalculate() when scanning the plan from last to first entry.
-static void planner_reverse_pass_kernel(block_t *previous, block_t *current, block_t *next)
+// Returns true if the entry speed of the current block changed.
+static uint8_t planner_reverse_pass_kernel(block_t *current, block_t *next)
 {
-  if (!current) { return; }  // Cannot operate on nothing.
-
-  if (next) {
-    // If entry speed is already at the maximum entry speed, no need to recheck. Block is cruising.
-    // If not, block in state of acceleration or deceleration. Reset entry speed to maximum and
-    // check for maximum allowable speed reductions to ensure maximum possible planned speed.
-    if (current->entry_speed != current->max_entry_speed) {
-
-      // If nominal length true, max junction speed is guaranteed to be reached. Only compute
-      // for max allowable speed if block is decelerating and nominal length is false.
-      if ((!current->nominal_length_flag) && (current->max_entry_speed > next->entry_speed)) {
-        current->entry_speed = min( current->max_entry_speed,
-          max_allowable_speed(-settings.acceleration,next->entry_speed,current->millimeters));
-      } else {
-        current->entry_speed = current->max_entry_speed;
-      }
+  // If entry speed is already at the maximum entry speed, no need to recheck. Block is cruising.
+  // If not, block in state of acceleration or deceleration. Reset entry speed to maximum and
+  // check for maximum allowable speed reductions to ensure maximum possible planned speed.
+  if (current->entry_speed != current->max_entry_speed) {
+    float entry_speed;
+
+    // If nominal length true, max junction speed is guaranteed to be reached. Only compute
+    // for max allowable speed if block is decelerating and nominal length is false.
+    if ((!current->nominal_length_flag) && (current->max_entry_speed > next->entry_speed)) {
+      entry_speed = min( current->max_entry_speed,
+        max_allowable_speed(current->acceleration,next->entry_speed,current->millimeters));
+    } else {
+      entry_speed = current->max_entry_speed;
+    }
+    if (current->entry_speed != entry_speed) {
+      current->entry_speed = entry_speed;
       current->recalculate_flag = true;
-
+      return(true);
     }
-  } // Skip last block. Already initialized and set for recalculation.
+  }
+  return(false);
 }
 
 
 // planner_recalculate() needs to go over the current plan twice. Once in reverse and once forward. This
-// implements the reverse pass.
+// implements the reverse pass. The newest block is already initialized by plan_buffer_line() to
+// decelerate to MINIMUM_PLANNER_SPEED and is skipped. The pass stops at the planned block, whose entry
+// speed is final, or as soon as a junction comes out unchanged, since nothing before it can change.
 static void planner_reverse_pass()
 {
-  uint8_t block_index = block_buffer_head;
-  block_t *block[3] = {NULL, NULL, NULL};
-  while(block_index != block_buffer_tail) {
+  uint8_t block_index = prev_block_index(block_buffer_head);
+  block_t *next;
+  block_t *current = &block_buffer[block_index];
+
+  while(block_index != block_buffer_planned) {
     block_index = prev_block_index( block_index );
-    block[2]= block[1];
-    block[1]= block[0];
-    block[0] = &block_buffer[block_index];
-    planner_reverse_pass_kernel(block[0], block[1], block[2]);
+    if (block_index == block_buffer_planned) { break; }
+    next = current;
+    current = &block_buffer[block_index];
+    // Every block before a dwell plans to a stop, so one junction unchanged after it says nothing
+    // about those before it.
+    if (!planner_reverse_pass_kernel(current, next) && !current->dwell) { break; }
   }
-  // Skip buffer tail/first block to prevent over-writing the initial entry speed.
 }
 
 
 // The kernel called by planner_recalculate() when scanning the plan from first to last entry.
-static void planner_forward_pass_kernel(block_t *previous, block_t *current, block_t *next)
+static void planner_forward_pass_kernel(block_t *previous, block_t *current)
 {
-  if(!previous) { return; }  // Begin planning after buffer_tail
-
   // If the previous block is an acceleration block, but it is not long enough to complete the
   // full speed change within the block, we need to adjust the entry speed accordingly. Entry
   // speeds have already been reset, maximized, and reverse planned by reverse planner.
@@ -159,7 +202,7 @@ static void planner_forward_pass_kernel(block_t *previous, block_t *current, blo
   if (!previous->nominal_length_flag) {
     if (previous->entry_speed < current->entry_speed) {
       float entry_speed = min( current->entry_speed,
-        max_allowable_speed(-settings.acceleration,previous->entry_speed,previous->millimeters) );
+        max_allowable_speed(previous->acceleration,previous->entry_speed,previous->millimeters) );
 
       // Check for junction speed change
       if (current->entry_speed != entry_speed) {
@@ -172,20 +215,71 @@ static void planner_forward_pass_kernel(block_t *previous, block_t *current, blo
 
 
 // planner_recalculate() needs to go over the current plan twice. Once in reverse and once forward. This
-// implements the forward pass.
+// implements the forward pass, starting at the planned block. Any junction that ends up limited by the
+// acceleration out of the block before it, or that is at its maximum entry speed, can never be raised
+// by blocks added later. The planned block index is advanced to the last such junction.
 static void planner_forward_pass()
 {
-  uint8_t block_index = block_buffer_tail;
-  block_t *block[3] = {NULL, NULL, NULL};
+  uint8_t block_index = block_buffer_planned;
+  block_t *previous;
+  block_t *current = &block_buffer[block_index];
 
+  block_index = next_block_index( block_index );
   while(block_index != block_buffer_head) {
-    block[0] = block[1];
-    block[1] = block[2];
-    block[2] = &block_buffer[block_index];
-    planner_forward_pass_kernel(block[0],block[1],block[2]);
+    previous = current;
+    current = &block_buffer[block_index];
+    float entry_speed = current->entry_speed;
+    planner_forward_pass_kernel(previous, current);
+    if (current->entry_speed != entry_speed || current->entry_speed == current->max_entry_speed) {
+      block_buffer_planned = block_index;
+    }
     block_index = next_block_index( block_index );
   }
-  planner_forward_pass_kernel(block[1], block[2], NULL);
+}
+
+
+// Returns nominal_rate*factor rounded up (step/min). Factors of 1.0 and above (a MINIMUM_PLANNER_SPEED
+// above the nominal speed) are held at the nominal rate. Below, the factor fits a uint32_t in Q32.
+static uint32_t trapezoid_rate(uint32_t nominal_rate, float factor)
+{
+  if (factor >= 1.0f) { return(nominal_rate); }
+  uint32_t factor_q32 = factor*TRAPEZOID_FACTOR_ONE;
+  return(((uint64_t)nominal_rate*factor_q32+0xffffffffUL) >> TRAPEZOID_FACTOR_BITS);
+}
+
+
+// Sets the step indices of the trapezoid for S-curve ramps. They take longer than linear ones for the
+// same rate change, so the block accelerates and decelerates over more step events. Where it cannot
+// cruise, the peak rate where the two ramps meet is found by bisection.
+static void calculate_scurve_trapezoid(block_t *block, uint32_t nominal_rate)
+{
+  float acceleration = (float)block->rate_delta*ACCELERATION_TICKS_PER_SECOND*60; // (step/min^2)
+  float corner = plan_get_jerk_rate(block);
+  float initial_rate = block->initial_rate;
+  float final_rate = block->final_rate;
+  float accelerate_steps = ramp_distance(acceleration, corner, initial_rate, nominal_rate);
+  float decelerate_steps = ramp_distance(acceleration, corner, nominal_rate, final_rate);
+  if (accelerate_steps+decelerate_steps > block->step_event_count) {
+    float low = max(initial_rate, final_rate);
+    float high = nominal_rate;
+    uint8_t i;
+    for (i=0; i<24 && high-low > 1.0f; i++) {
+      float peak_rate = 0.5f*(low+high);
+      if (ramp_distance(acceleration, corner, initial_rate, peak_rate) +
+          ramp_distance(acceleration, corner, peak_rate, final_rate) > block->step_event_count) {
+        high = peak_rate;
+      } else {
+        low = peak_rate;
+      }
+    }
+    accelerate_steps = min(ramp_distance(acceleration, corner, initial_rate, low), block->step_event_count);
+    decelerate_steps = block->step_event_count-accelerate_steps;
+  }
+  // Check limits due to numerical round-off
+  uint32_t accelerate_until = ceilf(min(accelerate_steps, block->step_event_count));
+  uint32_t decelerate_after = block->step_event_count-(uint32_t)floorf(min(decelerate_steps, block->step_event_count));
+  block->accelerate_until = accelerate_until;
+  block->decelerate_after = max(decelerate_after, accelerate_until);
 }
 
 
@@ -201,26 +295,41 @@ static void planner_forward_pass()
 // The factors represent a factor of braking and must be in the range 0.0-1.0.
 // This converts the planner parameters to the data required by the stepper controller.
 // NOTE: Final rates must be computed in terms of their respective blocks.
+// The rates and step indices are computed in integers, exactly rounded. The factors are taken in Q32
+// fixed point, which is exact for factors of 1/256 and more and at most one step/min low otherwise. The
+// squared rates need 64 bits. sim/trapezoid.c checks this against the float version and exact math.
 static void calculate_trapezoid_for_block(block_t *block, float entry_factor, float exit_factor)
 {
-  block->initial_rate = ceil(block->nominal_rate*entry_factor); // (step/min)
-  block->final_rate = ceil(block->nominal_rate*exit_factor); // (step/min)
-  int32_t acceleration_per_minute = block->rate_delta*ACCELERATION_TICKS_PER_SECOND*60.0; // (step/min^2)
-  int32_t accelerate_steps =
-    ceil(estimate_acceleration_distance(block->initial_rate, block->nominal_rate, acceleration_per_minute));
-  int32_t decelerate_steps =
-    floor(estimate_acceleration_distance(block->nominal_rate, block->final_rate, -acceleration_per_minute));
+  uint32_t nominal_rate = plan_get_nominal_rate(block);
+  uint32_t initial_rate = trapezoid_rate(nominal_rate, entry_factor);
+  uint32_t final_rate = trapezoid_rate(nominal_rate, exit_factor);
+  block->initial_rate = initial_rate;
+  block->final_rate = final_rate;
+  if (settings.jerk > 0.0f) {
+    calculate_scurve_trapezoid(block, nominal_rate);
+    return;
+  }
+
+  // Distance (not time) to accelerate from initial to nominal rate, and to decelerate from nominal to final
+  // rate: (v1^2-v0^2)/(2*acceleration), rounded up and down respectively.
+  int64_t acceleration_x2 = 2*(int64_t)block->rate_delta*ACCELERATION_TICKS_PER_SECOND*60; // (step/min^2)
+  int64_t nominal_rate_sq = (int64_t)nominal_rate*nominal_rate;
+  int64_t initial_rate_sq = (int64_t)initial_rate*initial_rate;
+  int64_t final_rate_sq = (int64_t)final_rate*final_rate;
+  int32_t accelerate_steps = (nominal_rate_sq-initial_rate_sq+acceleration_x2-1)/acceleration_x2;
+  int32_t decelerate_steps = (nominal_rate_sq-final_rate_sq)/acceleration_x2;
 
   // Calculate the size of Plateau of Nominal Rate.
   int32_t plateau_steps = block->step_event_count-accelerate_steps-decelerate_steps;
 
   // Is the Plateau of Nominal Rate smaller than nothing? That means no cruising, and we will
-  // have to use intersection_distance() to calculate when to abort acceleration and start braking
-  // in order to reach the final_rate exactly at the end of this block.
+  // have to find the intersection point, where to abort acceleration and start braking in order
+  // to reach the final_rate exactly at the end of this block:
+  //   (2*acceleration*distance-initial_rate^2+final_rate^2)/(4*acceleration), rounded up
   if (plateau_steps < 0) {
-    accelerate_steps = ceil(
-      intersection_distance(block->initial_rate, block->final_rate, acceleration_per_minute, block->step_event_count));
-    accelerate_steps = max(accelerate_steps,0); // Check limits due to numerical round-off
+    int64_t intersection = acceleration_x2*block->step_event_count-initial_rate_sq+final_rate_sq;
+    if (intersection <= 0) { accelerate_steps = 0; } // Check limits due to numerical round-off
+    else { accelerate_steps = (intersection+2*acceleration_x2-1)/(2*acceleration_x2); }
     accelerate_steps = min(accelerate_steps,block->step_event_count);
     plateau_steps = 0;
   }
@@ -242,16 +351,15 @@ static void calculate_trapezoid_for_block(block_t *block, float entry_factor, fl
 // planner_recalculate() after updating the blocks. Any recalulate flagged junction will
 // compute the two adjacent trapezoids to the junction, since the junction speed corresponds
 // to exit speed and entry speed of one another.
-static void planner_recalculate_trapezoids()
+static void planner_recalculate_trapezoids(uint8_t block_index)
 {
-  uint8_t block_index = block_buffer_tail;
   block_t *current;
   block_t *next = NULL;
 
   while(block_index != block_buffer_head) {
     current = next;
     next = &block_buffer[block_index];
-    if (current) {
+    if (current && !current->dwell) {
       // Recalculate if current block entry or exit junction speed has changed.
       if (current->recalculate_flag || next->recalculate_flag) {
         // NOTE: Entry and exit factors always > 0 by all previous logic operations.
@@ -263,8 +371,10 @@ static void planner_recalculate_trapezoids()
     block_index = next_block_index( block_index );
   }
   // Last/newest block in buffer. Exit speed is set with MINIMUM_PLANNER_SPEED. Always recalculated.
-  calculate_trapezoid_for_block(next, next->entry_speed/next->nominal_speed,
-    MINIMUM_PLANNER_SPEED/next->nominal_speed);
+  if (!next->dwell) {
+    calculate_trapezoid_for_block(next, next->entry_speed/next->nominal_speed,
+      MINIMUM_PLANNER_SPEED/next->nominal_speed);
+  }
   next->recalculate_flag = false;
 }
 
@@ -286,19 +396,35 @@ static void planner_recalculate_trapezoids()
 //   3. Recalculate trapezoids for all blocks using the recently updated junction speeds. Block trapezoids
 //      with no updated junction speeds will not be recalculated and assumed ok as is.
 //
-// All planner computations are performed with doubles (float on Arduinos) to minimize numerical round-
-// off errors. Only when planned values are converted to stepper rate parameters, these are integers.
+// The planner speeds are single precision floats, which the FPU of the Cortex-M4F handles in hardware.
+// Constants and math functions are kept single precision too, since anything double is emulated in
+// software. The conversion to stepper rate parameters in calculate_trapezoid_for_block() is done in
+// integers.
+//
+// Blocks from the buffer tail up to block_buffer_planned are optimally planned: their entry speeds
+// cannot change anymore, however many blocks are appended. Both passes and the trapezoid update only
+// work on the blocks past that point, so the cost stays constant on long runs of short segments.
 
 static void planner_recalculate()
 {
+  // The stepper segment preparation discards blocks at the tail. If it has consumed the planned
+  // block, the block it now segments is the first one with a final entry speed.
+  uint8_t block_index = block_buffer_tail;
+  if ( ((block_buffer_planned+BLOCK_BUFFER_SIZE-block_index) % BLOCK_BUFFER_SIZE) >=
+       ((block_buffer_head+BLOCK_BUFFER_SIZE-block_index) % BLOCK_BUFFER_SIZE) ) {
+    block_buffer_planned = block_index;
+  }
+  block_index = block_buffer_planned;
+
   planner_reverse_pass();
   planner_forward_pass();
-  planner_recalculate_trapezoids();
+  planner_recalculate_trapezoids(block_index);
 }
 
 void plan_reset_buffer()
 {
   block_buffer_tail = block_buffer_head;
+  block_buffer_planned = block_buffer_tail;
   next_buffer_head = next_block_index(block_buffer_head);
 }
 
@@ -322,9 +448,61 @@ inline block_t *plan_get_current_block()
   return(&block_buffer[block_buffer_tail]);
 }
 
-// Returns the availability status of the block ring buffer. True, if full.
+uint32_t plan_get_nominal_rate(block_t *block)
+{
+  return(ceilf(block->step_event_count*block->nominal_speed/block->millimeters)); // (step/min) Always > 0
+}
+
+// The ramp rises to full acceleration and falls back at the jerk setting, which takes 2*acceleration/jerk
+// and a rate change of acceleration^2/jerk in all. Converted from mm/min to step/min.
+float plan_get_jerk_rate(block_t *block)
+{
+  return(block->acceleration*block->acceleration/settings.jerk*block->step_event_count/block->millimeters);
+}
+
+// Returns the rate a ramp of the block starting at the given rate reaches within the step events
+float plan_get_ramp_rate(block_t *block, float rate, uint32_t step_events)
+{
+  float acceleration = (float)block->rate_delta*ACCELERATION_TICKS_PER_SECOND*60; // (step/min^2)
+  return(ramp_end_speed(acceleration, plan_get_jerk_rate(block), rate, step_events));
+}
+
+// Returns the nominal speed of a block: its programmed speed scaled by the feed or rapid override and
+// limited by the max rate of each axis, as the acceleration is in planner_buffer_line(). Fillet chords
+// keep to their programmed speed at most, which holds them within the centripetal acceleration.
+// Homing motions are not scaled at all.
+// NOTE: The axis travel per mm of path follows from the step counts of the whole block, which a feed
+// hold or an override does not change, while step_event_count and millimeters become the remainder.
+static float planner_nominal_speed(block_t *block)
+{
+  uint8_t override = (block->rapid_motion) ? sys.rapid_override : sys.feed_override;
+  if (block->blend_chord && override > 100) { override = 100; }
+  if (block->no_override) { override = 100; }
+  float speed = block->programmed_speed*(0.01f*override);
+  uint32_t steps[3] = { block->steps_x, block->steps_y, block->steps_z };
+  float millimeters = block->millimeters*max(steps[X_AXIS], max(steps[Y_AXIS], steps[Z_AXIS]))/
+    block->step_event_count; // Length of the whole block
+  uint8_t i;
+  for (i=0; i<N_AXIS; i++) {
+    if (steps[i]) { speed = min(speed, settings.max_rate[i]*millimeters*settings.steps_per_mm[i]/steps[i]); }
+  }
+  return(speed);
+}
+
+uint8_t plan_get_block_buffer_count()
+{
+  uint8_t tail = block_buffer_tail; // The stepper segment preparation may move the tail meanwhile.
+  if (block_buffer_head >= tail) { return(block_buffer_head-tail); }
+  return(BLOCK_BUFFER_SIZE-(tail-block_buffer_head));
+}
+
+// Returns the availability status of the block ring buffer. True, if full. While blending, the next
+// line may buffer the held line and the chords of a fillet along with it.
 uint8_t plan_check_full_buffer()
 {
+  if (pl.blend_tolerance > 0.0f) {
+    return(plan_get_block_buffer_count() >= BLOCK_BUFFER_SIZE-1-BLEND_MAX_SEGMENTS);
+  }
   if (block_buffer_tail == next_buffer_head) { return(true); }
   return(false);
 }
@@ -333,6 +511,7 @@ uint8_t plan_check_full_buffer()
 // during a synchronize call, if it should happen. Also, waits for clean cycle end.
 void plan_synchronize()
 {
+  plan_flush_line();
   while (plan_get_current_block() || sys.state == STATE_CYCLE) {
     protocol_execute_runtime();   // Check and execute run-time commands
     if (sys.abort) { return; } // Check for system abort
@@ -345,7 +524,7 @@ void plan_synchronize()
 // All position data passed to the planner must be in terms of machine position to keep the planner
 // independent of any coordinate system changes and offsets, which are handled by the g-code parser.
 // NOTE: Assumes buffer is available. Buffer checks are handled at a higher level by motion_control.
-void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t invert_feed_rate)
+static void planner_buffer_line(float x, float y, float z, float feed_rate, uint8_t motion_flags)
 {
   // Prepare to set up new block
   block_t *block = &block_buffer[block_buffer_head];
@@ -376,20 +555,46 @@ void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t invert
   delta_mm[X_AXIS] = (target[X_AXIS]-pl.position[X_AXIS])/settings.steps_per_mm[X_AXIS];
   delta_mm[Y_AXIS] = (target[Y_AXIS]-pl.position[Y_AXIS])/settings.steps_per_mm[Y_AXIS];
   delta_mm[Z_AXIS] = (target[Z_AXIS]-pl.position[Z_AXIS])/settings.steps_per_mm[Z_AXIS];
-  block->millimeters = sqrt(delta_mm[X_AXIS]*delta_mm[X_AXIS] + delta_mm[Y_AXIS]*delta_mm[Y_AXIS] +
+  block->millimeters = sqrtf(delta_mm[X_AXIS]*delta_mm[X_AXIS] + delta_mm[Y_AXIS]*delta_mm[Y_AXIS] +
                             delta_mm[Z_AXIS]*delta_mm[Z_AXIS]);
-  float inverse_millimeters = 1.0/block->millimeters;  // Inverse millimeters to remove multiple divides
+  float inverse_millimeters = 1.0f/block->millimeters;  // Inverse millimeters to remove multiple divides
+
+  // Compute path unit vector
+  float unit_vec[3];
+
+  unit_vec[X_AXIS] = delta_mm[X_AXIS]*inverse_millimeters;
+  unit_vec[Y_AXIS] = delta_mm[Y_AXIS]*inverse_millimeters;
+  unit_vec[Z_AXIS] = delta_mm[Z_AXIS]*inverse_millimeters;
+
+  // Limit the acceleration along the path by that of each axis. An axis covers |unit_vec| mm per
+  // mm of path, so it reaches its own limit at limit/|unit_vec| along the path. The axis with the
+  // lowest such value dominates the block, e.g. Z in a plunging XYZ move. The speed is limited
+  // the same way by planner_nominal_speed().
+  block->acceleration = settings.acceleration;
+  uint8_t i;
+  for (i=0; i<N_AXIS; i++) {
+    if (unit_vec[i] != 0.0f) {
+      block->acceleration = min(block->acceleration, settings.max_acceleration[i]*fabsf(1.0f/unit_vec[i]));
+    }
+  }
 
   // Calculate speed in mm/minute for each axis. No divide by zero due to previous checks.
   // NOTE: Minimum stepper speed is limited by MINIMUM_STEPS_PER_MINUTE in stepper.c
   float inverse_minute;
-  if (!invert_feed_rate) {
+  if (!(motion_flags & PLAN_INVERSE_TIME)) {
     inverse_minute = feed_rate * inverse_millimeters;
   } else {
-    inverse_minute = 1.0 / feed_rate;
+    inverse_minute = 1.0f / feed_rate;
   }
-  block->nominal_speed = block->millimeters * inverse_minute; // (mm/min) Always > 0
-  block->nominal_rate = ceil(block->step_event_count * inverse_minute); // (step/min) Always > 0
+  block->programmed_speed = block->millimeters * inverse_minute; // (mm/min) Always > 0
+  block->rapid_motion = (motion_flags & PLAN_RAPID) ? 1 : 0;
+  block->blend_chord = (motion_flags & PLAN_BLEND_CHORD) ? 1 : 0;
+  block->no_override = (motion_flags & PLAN_NO_OVERRIDE) ? 1 : 0;
+  block->dwell = 0;
+  block->spindle_direction = pl.spindle_direction;
+  block->spindle_speed = pl.spindle_speed;
+  block->coolant_mode = pl.coolant_mode;
+  block->nominal_speed = planner_nominal_speed(block);
 
   // Compute the acceleration rate for the trapezoid generator. Depending on the slope of the line
   // average travel per step event changes. For a line along one axis the travel per step event
@@ -398,15 +603,8 @@ void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t invert
   // To generate trapezoids with contant acceleration between blocks the rate_delta must be computed
   // specifically for each line to compensate for this phenomenon:
   // Convert universal acceleration for direction-dependent stepper rate change parameter
-  block->rate_delta = ceil( block->step_event_count*inverse_millimeters *
-        settings.acceleration / (60 * ACCELERATION_TICKS_PER_SECOND )); // (step/min/acceleration_tick)
-
-  // Compute path unit vector
-  float unit_vec[3];
-
-  unit_vec[X_AXIS] = delta_mm[X_AXIS]*inverse_millimeters;
-  unit_vec[Y_AXIS] = delta_mm[Y_AXIS]*inverse_millimeters;
-  unit_vec[Z_AXIS] = delta_mm[Z_AXIS]*inverse_millimeters;
+  block->rate_delta = ceilf( block->step_event_count*inverse_millimeters *
+        block->acceleration / (60 * ACCELERATION_TICKS_PER_SECOND )); // (step/min/acceleration_tick)
 
   // Compute maximum allowable entry speed at junction by centripetal acceleration approximation.
   // Let a circle be tangent to both previous and current path line segments, where the junction
@@ -418,15 +616,13 @@ void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t invert
   // from path, but used as a robust way to compute cornering speeds, as it takes into account the
   // nonlinearities of both the junction angle and junction velocity.
   // NOTE: This is basically an exact path mode (G61), but it doesn't come to a complete stop unless
-  // the junction deviation value is high. In the future, if continuous mode (G64) is desired, the
-  // math here is exactly the same. Instead of motioning all the way to junction point, the machine
-  // will just need to follow the arc circle defined above and check if the arc radii are no longer
-  // than half of either line segment to ensure no overlapping. Right now, the Arduino likely doesn't
-  // have the horsepower to do these calculations at high feed rates.
+  // the junction deviation value is high. In continuous mode (G64), planner_blend_corner() has
+  // already replaced the corner by a fillet in short chords, whose junctions are nearly straight.
   float vmax_junction = MINIMUM_PLANNER_SPEED; // Set default max junction speed
+  block->max_junction_speed = MINIMUM_PLANNER_SPEED;
 
   // Skip first block or when previous_nominal_speed is used as a flag for homing and offset cycles.
-  if ((block_buffer_head != block_buffer_tail) && (pl.previous_nominal_speed > 0.0)) {
+  if ((block_buffer_head != block_buffer_tail) && (pl.previous_nominal_speed > 0.0f)) {
     // Compute cosine of angle between previous and current path. (prev_unit_vec is negative)
     // NOTE: Max junction velocity is computed without sin() or acos() by trig half angle identity.
     float cos_theta = - pl.previous_unit_vec[X_AXIS] * unit_vec[X_AXIS]
@@ -434,21 +630,23 @@ void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t invert
                        - pl.previous_unit_vec[Z_AXIS] * unit_vec[Z_AXIS] ;
 
     // Skip and use default max junction speed for 0 degree acute junction.
-    if (cos_theta < 0.95) {
-      vmax_junction = min(pl.previous_nominal_speed,block->nominal_speed);
+    if (cos_theta < 0.95f) {
+      block->max_junction_speed = SOME_LARGE_VALUE;
       // Skip and avoid divide by zero for straight junctions at 180 degrees. Limit to min() of nominal speeds.
-      if (cos_theta > -0.95) {
+      if (cos_theta > -0.95f) {
         // Compute maximum junction velocity based on maximum acceleration and junction deviation
-        float sin_theta_d2 = sqrt(0.5*(1.0-cos_theta)); // Trig half angle identity. Always positive.
-        vmax_junction = min(vmax_junction,
-          sqrt(settings.acceleration * settings.junction_deviation * sin_theta_d2/(1.0-sin_theta_d2)) );
+        float sin_theta_d2 = sqrtf(0.5f*(1.0f-cos_theta)); // Trig half angle identity. Always positive.
+        block->max_junction_speed =
+          sqrtf(block->acceleration * settings.junction_deviation * sin_theta_d2/(1.0f-sin_theta_d2));
       }
+      // Kept apart from the nominal speeds, which overrides change.
+      vmax_junction = min(block->max_junction_speed, min(pl.previous_nominal_speed,block->nominal_speed));
     }
   }
   block->max_entry_speed = vmax_junction;
 
   // Initialize block entry speed. Compute based on deceleration to user-defined MINIMUM_PLANNER_SPEED.
-  float v_allowable = max_allowable_speed(-settings.acceleration,MINIMUM_PLANNER_SPEED,block->millimeters);
+  float v_allowable = max_allowable_speed(block->acceleration,MINIMUM_PLANNER_SPEED,block->millimeters);
   block->entry_speed = min(vmax_junction, v_allowable);
 
   // Initialize planner efficiency flags
@@ -480,30 +678,269 @@ void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t invert
   planner_recalculate();
 }
 
-// Reset the planner position vector (in steps). Called by the system abort routine.
+// Buffers the line held back for blending, if any. Called when no line may follow soon, or when
+// the planner has to catch up with the g-code, i.e. before synchronizing or leaving G64.
+void plan_flush_line()
+{
+  if (pl.line_held) {
+    pl.line_held = false;
+    // The chords of the last fillet may have filled the ring. Wait for a free block as mc_line() does.
+    while (block_buffer_tail == next_buffer_head) {
+      protocol_execute_runtime();
+      if (sys.abort) { return; }
+      if (sys.auto_start) { st_cycle_start(); }
+    }
+    planner_buffer_line(pl.line_end[X_AXIS], pl.line_end[Y_AXIS], pl.line_end[Z_AXIS], pl.line_feed_rate,
+      pl.line_flags);
+    if (!sys.state) { sys.state = STATE_QUEUED; }
+  }
+}
+
+// Adds a dwell block. The planner passes take it for a junction at MINIMUM_PLANNER_SPEED on either
+// side: the block before it decelerates to a stop as the newest block in the buffer does, and the
+// next line starts from rest as the first one after a stop. Nothing before the dwell can change
+// with the blocks added later, so it becomes the planned block.
+void plan_buffer_dwell(float seconds)
+{
+  plan_flush_line();
+  uint32_t step_events = lround(seconds*DWELL_STEP_EVENTS_PER_SECOND);
+  if (step_events == 0) { return; }
+
+  block_t *block = &block_buffer[block_buffer_head];
+  memset(block, 0, sizeof(block_t));
+  block->step_event_count = step_events;
+  block->dwell = 1;
+  block->spindle_direction = pl.spindle_direction;
+  block->spindle_speed = pl.spindle_speed;
+  block->coolant_mode = pl.coolant_mode;
+  block->entry_speed = MINIMUM_PLANNER_SPEED;
+  block->max_entry_speed = MINIMUM_PLANNER_SPEED;
+  block->max_junction_speed = MINIMUM_PLANNER_SPEED;
+  block->nominal_length_flag = true; // Keeps the forward pass from planning past it
+  pl.previous_nominal_speed = 0.0f;  // The next line starts from rest
+
+  block_buffer_planned = block_buffer_head;
+  block_buffer_head = next_buffer_head;
+  next_buffer_head = next_block_index(block_buffer_head);
+}
+
+// Blends the corner between the held line and the line to the target with a fillet tangent to both.
+// Buffers the held line up to the start of the fillet and the fillet as chords, and leaves the
+// line to the target to start where the fillet ends. The fillet radius is the largest that keeps
+// the chords within the blend tolerance of the corner, and the fillet may take no more than half
+// of either line. Its chords are run no faster than the centripetal acceleration allows.
+static void planner_blend_corner(float *target, float feed_rate, uint8_t motion_flags)
+{
+  float *corner = pl.line_end;
+  float unit_vec_in[3], unit_vec_out[3];
+  float length_in = 0.0f, length_out = 0.0f;
+  uint8_t i, k;
+  for (i=0; i<N_AXIS; i++) {
+    unit_vec_in[i] = corner[i]-pl.line_start[i];
+    unit_vec_out[i] = target[i]-corner[i];
+    length_in += unit_vec_in[i]*unit_vec_in[i];
+    length_out += unit_vec_out[i]*unit_vec_out[i];
+  }
+  length_in = sqrtf(length_in);
+  length_out = sqrtf(length_out);
+  float cos_theta = 1.0f; // Cosine of the turn at the corner
+  if (length_in > 0.0f && length_out > 0.0f) {
+    cos_theta = 0.0f;
+    for (i=0; i<N_AXIS; i++) {
+      unit_vec_in[i] /= length_in;
+      unit_vec_out[i] /= length_out;
+      cos_theta += unit_vec_in[i]*unit_vec_out[i];
+    }
+  }
+  float theta = acosf(max(cos_theta, -1.0f));
+  if (cos_theta > BLEND_MIN_COS || theta > BLEND_MAX_ANGLE) {
+    plan_flush_line();
+    memcpy(pl.line_start, corner, sizeof(pl.line_start));
+    return;
+  }
+
+  // The corner lies radius/cos(theta/2) from the fillet center, the chords no less than
+  // radius*cos(theta/(2*segments)).
+  uint8_t segments = ceilf(theta/BLEND_SEGMENT_ANGLE);
+  if (segments > BLEND_MAX_SEGMENTS) { segments = BLEND_MAX_SEGMENTS; }
+  float half_theta = 0.5f*theta;
+  float radius = pl.blend_tolerance/(1.0f/cosf(half_theta) - cosf(half_theta/segments));
+  float tan_half_theta = tanf(half_theta);
+  float distance = radius*tan_half_theta; // From the corner to either end of the fillet
+  float max_distance = 0.5f*min(length_in, length_out);
+  if (distance > max_distance) {
+    distance = max_distance;
+    radius = distance/tan_half_theta;
+  }
+
+  // Centripetal acceleration limit of the axes turning at the corner
+  float acceleration = settings.acceleration;
+  for (i=0; i<N_AXIS; i++) {
+    if (unit_vec_in[i] != 0.0f || unit_vec_out[i] != 0.0f) {
+      acceleration = min(acceleration, settings.max_acceleration[i]);
+    }
+  }
+  float blend_feed_rate = min(min(pl.line_feed_rate, feed_rate), sqrtf(acceleration*radius));
+  uint8_t blend_flags = PLAN_BLEND_CHORD | (pl.line_flags & motion_flags & PLAN_RAPID);
+
+  float start[3], end[3], center[3];
+  float sin_theta = sinf(theta);
+  for (i=0; i<N_AXIS; i++) {
+    start[i] = corner[i]-distance*unit_vec_in[i];
+    end[i] = corner[i]+distance*unit_vec_out[i];
+    center[i] = corner[i]+(unit_vec_out[i]-unit_vec_in[i])*radius/sin_theta;
+  }
+  planner_buffer_line(start[X_AXIS], start[Y_AXIS], start[Z_AXIS], pl.line_feed_rate, pl.line_flags);
+  pl.line_held = false;
+
+  // Chord ends along the fillet, interpolated between its radius vectors at either end
+  float point[3];
+  for (k=1; k<segments; k++) {
+    float weight_start = sinf((segments-k)*theta/segments)/sin_theta;
+    float weight_end = sinf(k*theta/segments)/sin_theta;
+    for (i=0; i<N_AXIS; i++) {
+      point[i] = center[i]+weight_start*(start[i]-center[i])+weight_end*(end[i]-center[i]);
+    }
+    planner_buffer_line(point[X_AXIS], point[Y_AXIS], point[Z_AXIS], blend_feed_rate, blend_flags);
+  }
+  planner_buffer_line(end[X_AXIS], end[Y_AXIS], end[Z_AXIS], blend_feed_rate, blend_flags);
+  memcpy(pl.line_start, end, sizeof(pl.line_start));
+}
+
+// Add a new linear movement to the plan. In continuous mode (G64) the line is held back until the
+// next one, or plan_flush_line(), so the corner between the two can be blended. Inverse time
+// motions (G93) are never blended, since a fillet would change their duration.
+void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t motion_flags)
+{
+  float target[3] = { x, y, z };
+  if (pl.blend_tolerance > 0.0f && !(motion_flags & PLAN_INVERSE_TIME)) {
+    if (pl.line_held) { planner_blend_corner(target, feed_rate, motion_flags); }
+    else { memcpy(pl.line_start, pl.line_end, sizeof(pl.line_start)); }
+    pl.line_held = true;
+    pl.line_feed_rate = feed_rate;
+    pl.line_flags = motion_flags;
+  } else {
+    plan_flush_line();
+    planner_buffer_line(x, y, z, feed_rate, motion_flags);
+  }
+  memcpy(pl.line_end, target, sizeof(pl.line_end));
+}
+
+// Sets the deviation from the corners allowed by blending consecutive lines (G64). Zero returns to
+// exact path mode (G61), and buffers a line still held back.
+void plan_set_blend_tolerance(float tolerance)
+{
+  pl.blend_tolerance = tolerance;
+  if (tolerance <= 0.0f) { plan_flush_line(); }
+}
+
+// Sets the spindle direction and speed of the following blocks. A line held back for blending
+// still runs with the spindle as it was, so it is buffered first.
+void plan_set_spindle(int8_t direction, float speed)
+{
+  if (direction != pl.spindle_direction || speed != pl.spindle_speed) {
+    plan_flush_line();
+    pl.spindle_direction = direction;
+    pl.spindle_speed = speed;
+  }
+}
+
+// Sets the coolant mode of the following blocks, as plan_set_spindle() does
+void plan_set_coolant_mode(uint8_t mode)
+{
+  if (mode != pl.coolant_mode) {
+    plan_flush_line();
+    pl.coolant_mode = mode;
+  }
+}
+
+int8_t plan_get_spindle_direction()
+{
+  return(pl.spindle_direction);
+}
+
+float plan_get_spindle_speed()
+{
+  return(pl.spindle_speed);
+}
+
+uint8_t plan_get_coolant_mode()
+{
+  return(pl.coolant_mode);
+}
+
+// Reset the planner position vector (in steps). Called by the system abort routine. Drops a line
+// held back for blending, whose start no longer holds.
 void plan_set_current_position(int32_t x, int32_t y, int32_t z)
 {
   pl.position[X_AXIS] = x;
   pl.position[Y_AXIS] = y;
   pl.position[Z_AXIS] = z;
+  uint8_t i;
+  for (i=0; i<N_AXIS; i++) { pl.line_end[i] = pl.position[i]/settings.steps_per_mm[i]; }
+  pl.line_held = false;
 }
 
 // Re-initialize buffer plan with a partially completed block, assumed to exist at the buffer tail.
-// Called after a steppers have come to a complete stop for a feed hold and the cycle is stopped.
-void plan_cycle_reinitialize(int32_t step_events_remaining)
+// Called after a steppers have come to a complete stop for a feed hold and the cycle is stopped,
+// with a zero step rate, or on an override change at the step rate the block has reached.
+void plan_cycle_reinitialize(int32_t step_events_remaining, float step_rate)
 {
   block_t *block = &block_buffer[block_buffer_tail]; // Point to partially completed block
 
+  // A dwell only has its remaining time. The blocks after it start from rest either way.
+  if (block->dwell) {
+    block->step_event_count = step_events_remaining;
+    return;
+  }
+
   // Only remaining millimeters and step_event_count need to be updated for planner recalculate.
   // Other variables (step_x, step_y, step_z, rate_delta, etc.) all need to remain the same to
   // ensure the original planned motion is resumed exactly.
   block->millimeters = (block->millimeters*step_events_remaining)/block->step_event_count;
   block->step_event_count = step_events_remaining;
 
-  // Re-plan from a complete stop. Reset planner entry speeds and flags.
-  block->entry_speed = 0.0;
-  block->max_entry_speed = 0.0;
+  // Re-plan from the step rate, a complete stop after a feed hold. Reset planner entry speeds and flags.
+  block->entry_speed = step_rate*block->millimeters/block->step_event_count;
+  block->max_entry_speed = block->entry_speed;
   block->nominal_length_flag = false;
   block->recalculate_flag = true;
+  block_buffer_planned = block_buffer_tail; // Every following entry speed must be re-planned.
+  planner_recalculate();
+}
+
+// Rescales the nominal speeds of the buffered blocks to the current overrides and replans them all,
+// since the junction speeds may rise as well as fall. Only the entry speed of the block at the tail
+// stays as it is; the stepper segment preparation slows down to a nominal speed below it.
+void plan_update_overrides()
+{
+  if (block_buffer_head == block_buffer_tail) { return; }
+  uint8_t block_index = block_buffer_tail;
+  block_t *block = NULL;
+  float previous_nominal_speed = 0.0f;
+  while (block_index != block_buffer_head) {
+    block = &block_buffer[block_index];
+    block_index = next_block_index(block_index);
+    if (block->dwell) {
+      previous_nominal_speed = MINIMUM_PLANNER_SPEED; // The block after it starts from rest, as when it was added
+      continue;
+    }
+    block->nominal_speed = planner_nominal_speed(block);
+    float v_allowable = max_allowable_speed(block->acceleration,MINIMUM_PLANNER_SPEED,block->millimeters);
+    block->nominal_length_flag = (block->nominal_speed <= v_allowable);
+    if (block != &block_buffer[block_buffer_tail]) {
+      block->max_entry_speed = min(block->max_junction_speed, min(previous_nominal_speed, block->nominal_speed));
+      block->entry_speed = -1.0f; // Differs from any maximum, so the reverse pass replans the whole buffer.
+    }
+    block->recalculate_flag = true;
+    previous_nominal_speed = block->nominal_speed;
+  }
+  // The newest block is left out of the reverse pass. Plan it to decelerate to a stop, as when it was added.
+  if (block != &block_buffer[block_buffer_tail] && !block->dwell) {
+    block->entry_speed = min(block->max_entry_speed,
+      max_allowable_speed(block->acceleration,MINIMUM_PLANNER_SPEED,block->millimeters));
+  }
+  if (pl.previous_nominal_speed > 0.0f) { pl.previous_nominal_speed = previous_nominal_speed; }
+  block_buffer_planned = block_buffer_tail;
   planner_recalculate();
 }
@@ -24,30 +24,37 @@
 
 #include <inttypes.h>
 
-// The number of linear motions that can be in the plan at any give time
+// The number of linear motions that can be in the plan at any give time. The LM4F120 has the SRAM
+// for a much longer lookahead than the AVR, which keeps junction speeds up on short segments.
 #ifndef BLOCK_BUFFER_SIZE
-  #define BLOCK_BUFFER_SIZE 18
+  #ifdef PART_LM4F120H5QR
+    #define BLOCK_BUFFER_SIZE 64
+  #else
+    #define BLOCK_BUFFER_SIZE 18
+  #endif
+#endif
+#if BLOCK_BUFFER_SIZE > 255
+  #error "BLOCK_BUFFER_SIZE is limited to 255 by the uint8_t buffer indices"
 #endif
 
 // This struct is used when buffering the setup for each linear movement "nominal" values are as specified in
 // the source g-code and may never actually be reached if acceleration management is active.
+// NOTE: Kept compact, since its size times BLOCK_BUFFER_SIZE is most of the RAM Grbl uses. Values that
+// follow from others, like the nominal step rate, are computed when needed instead of stored.
 typedef struct {
 
   // Fields used by the bresenham algorithm for tracing the line
-///  uint8_t  direction_bits;            // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
-  uint32_t  direction_bits;            // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
   uint32_t steps_x, steps_y, steps_z; // Step count along each axis
   int32_t  step_event_count;          // The number of step events required to complete this block
 
   // Fields used by the motion planner to manage acceleration
+  float programmed_speed;            // The speed programmed for this block in mm/min, before overrides
   float nominal_speed;               // The nominal speed for this block in mm/min
   float entry_speed;                 // Entry speed at previous-current block junction in mm/min
   float max_entry_speed;             // Maximum allowable junction entry speed in mm/min
+  float max_junction_speed;          // Junction speed limit of the corner alone, without nominal speeds
   float millimeters;                 // The total travel of this block in mm
-///  uint8_t recalculate_flag;           // Planner flag to recalculate trapezoids on entry junction
-///  uint8_t nominal_length_flag;        // Planner flag for nominal speed always reached
-  uint32_t recalculate_flag;           // Planner flag to recalculate trapezoids on entry junction
-  uint32_t nominal_length_flag;        // Planner flag for nominal speed always reached
+  float acceleration;                // Acceleration along the path in mm/min^2, limited by each axis
 
   // Settings for the trapezoid generator
   uint32_t initial_rate;              // The step rate at start of block
@@ -55,17 +62,61 @@ typedef struct {
   int32_t rate_delta;                 // The steps/minute to add or subtract when changing speed (must be positive)
   uint32_t accelerate_until;          // The index of the step event on which to stop acceleration
   uint32_t decelerate_after;          // The index of the step event on which to start decelerating
-  uint32_t nominal_rate;              // The nominal step rate for this block in step_events/minute
+
+  float spindle_speed;                // Spindle speed during this block in rpm {S}
+
+  uint8_t  direction_bits;            // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
+  int8_t   spindle_direction;         // Spindle during this block. 1 = CW, -1 = CCW, 0 = Stop {M3, M4, M5}
+  uint8_t  coolant_mode;              // Coolant during this block. COOLANT_* of coolant_control.h {M7, M8, M9}
+  uint8_t  recalculate_flag : 1;      // Planner flag to recalculate trapezoids on entry junction
+  uint8_t  nominal_length_flag : 1;   // Planner flag for nominal speed always reached
+  uint8_t  rapid_motion : 1;          // Seek motion, scaled by the rapid override instead of the feed override
+  uint8_t  blend_chord : 1;           // Chord of a G64 fillet. Overrides may slow it down, not speed it up.
+  uint8_t  no_override : 1;           // Homing motion. The overrides do not apply.
+  uint8_t  dwell : 1;                 // Dwell (G4) without motion. step_event_count is its duration in
+                                      // DWELL_STEP_EVENTS_PER_SECOND units, the step counts are zero.
 
 } block_t;
 
 // Initialize the motion plan subsystem
 void plan_init();
 
+// Motion flags of plan_buffer_line() and mc_line()
+#define PLAN_INVERSE_TIME bit(0) // Feed rate is inverted (G93). Same as a true invert_feed_rate.
+#define PLAN_RAPID        bit(1) // Seek motion (G0), scaled by the rapid override
+#define PLAN_BLEND_CHORD  bit(2) // Chord of a G64 fillet. Only used inside the planner.
+#define PLAN_NO_OVERRIDE  bit(3) // Runs at the feed rate given, whatever the overrides (homing)
+
 // Add a new linear movement to the buffer. x, y and z is the signed, absolute target position in
-// millimaters. Feed rate specifies the speed of the motion. If feed rate is inverted, the feed
-// rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
-void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t invert_feed_rate);
+// millimaters. Feed rate specifies the speed of the motion. If PLAN_INVERSE_TIME is set in the motion
+// flags, the feed rate is taken to mean "frequency" and would complete the operation in 1/feed_rate
+// minutes.
+// NOTE: While blending (G64), the line is held back until the next one or plan_flush_line().
+void plan_buffer_line(float x, float y, float z, float feed_rate, uint8_t motion_flags);
+
+// Buffers the line held back for blending, if any
+void plan_flush_line();
+
+// Dwell blocks are timed in step events without steps, one per millisecond
+#define DWELL_STEP_EVENTS_PER_SECOND 1000
+
+// Add a dwell to the buffer. The motion before it comes to a stop, the motion after it starts from
+// rest once the dwell has elapsed. Assumes buffer is available, as plan_buffer_line() does.
+void plan_buffer_dwell(float seconds);
+
+// Set the deviation from the corners allowed by blending lines in mm (G64). Zero for exact path (G61).
+void plan_set_blend_tolerance(float tolerance);
+
+// Set the spindle direction and speed and the coolant mode of the blocks buffered from now on. The
+// stepper interrupt switches the outputs as the first of them starts.
+void plan_set_spindle(int8_t direction, float speed);
+void plan_set_coolant_mode(uint8_t mode);
+
+// Returns the spindle direction and speed and the coolant mode last set, for the blocks buffered
+// from now on
+int8_t plan_get_spindle_direction();
+float plan_get_spindle_speed();
+uint8_t plan_get_coolant_mode();
 
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
@@ -74,11 +125,28 @@ void plan_discard_current_block();
 // Gets the current block. Returns NULL if buffer empty
 block_t *plan_get_current_block();
 
+// Returns the nominal step rate of a block in step_events/minute, derived from its nominal speed.
+uint32_t plan_get_nominal_rate(block_t *block);
+
+// Returns the rate change in step_events/minute a ramp of the block needs to reach its full acceleration
+// at the jerk setting and fall back from it, acceleration^2/jerk. Shorter ramps never reach it.
+float plan_get_jerk_rate(block_t *block);
+
+// Returns the rate in step_events/minute an S-curve ramp of the block starting at the given rate reaches
+// within the given step events, as the planner lays out the trapezoid.
+float plan_get_ramp_rate(block_t *block, float rate, uint32_t step_events);
+
+// Returns the number of blocks in the buffer
+uint8_t plan_get_block_buffer_count();
+
 // Reset the planner position vector (in steps)
 void plan_set_current_position(int32_t x, int32_t y, int32_t z);
 
-// Reinitialize plan with a partially completed block
-void plan_cycle_reinitialize(int32_t step_events_remaining);
+// Reinitialize plan with a partially completed block, entered at the given step rate
+void plan_cycle_reinitialize(int32_t step_events_remaining, float step_rate);
+
+// Rescale the buffered blocks to changed feed and rapid overrides and replan them
+void plan_update_overrides();
 
 // Reset buffer
 void plan_reset_buffer();
@@ -34,8 +34,7 @@
 
 void printString(const char *s)
 {
-  while (*s)
-    serial_write(*s++);
+  serial_write_string(s);
 }
 
 #ifndef PART_LM4F120H5QR // AVR code
@@ -83,14 +82,15 @@ void print_uint8_base2(uint8_t n)
 		serial_write('0' + buf[i - 1]);
 }
 
-static void print_uint32_base10(unsigned long n)
+// Writes the decimal digits of n to s and returns the end of them. The string is not terminated.
+static char *format_uint32_base10(char *s, unsigned long n)
 { 
   unsigned char buf[10]; 
   uint8_t i = 0;
 
   if (n == 0) {
-    serial_write('0');
-    return;
+    *s++ = '0';
+    return(s);
   }
 
   while (n > 0) {
@@ -99,16 +99,24 @@ static void print_uint32_base10(unsigned long n)
   }
 
   for (; i > 0; i--)
-    serial_write(buf[i-1]);
+    *s++ = buf[i-1];
+  return(s);
 }
 
-void printInteger(long n)
+char *format_integer(char *s, long n)
 {
   if (n < 0) {
-    serial_write('-');
+    *s++ = '-';
     n = -n;
   }
-  print_uint32_base10(n);
+  return(format_uint32_base10(s, n));
+}
+
+void printInteger(long n)
+{
+  char buf[12];
+  *format_integer(buf, n) = 0;
+  printString(buf);
 }
 
 // Convert float to string by immediately converting to a long integer, which contains
@@ -116,10 +124,10 @@ void printInteger(long n)
 // may be set by the user. The integer is then efficiently converted to a string.
 // NOTE: AVR '%' and '/' integer operations are very efficient. Bitshifting speed-up 
 // techniques are actually just slightly slower. Found this out the hard way.
-void printFloat(float n)
+char *format_float(char *s, float n)
 {
   if (n < 0) {
-    serial_write('-');
+    *s++ = '-';
     n = -n;
   }
 
@@ -152,7 +160,15 @@ void printFloat(float n)
     buf[i++] = '0';
   }
 
-  // Print the generated string.
+  // Copy the generated string.
   for (; i > 0; i--)
-    serial_write(buf[i-1]);
+    *s++ = buf[i-1];
+  return(s);
+}
+
+void printFloat(float n)
+{
+  char buf[12];
+  *format_float(buf, n) = 0;
+  printString(buf);
 }
@@ -44,4 +44,10 @@ void printFloat(float n);
 
 void printChar( char c );
 
+// Write a number to the string s, as printInteger() and printFloat() print it, and return the end
+// of it. The string is not terminated. Used to build a line before sending it in one piece.
+char *format_integer(char *s, long n);
+
+char *format_float(char *s, float n);
+
 #endif
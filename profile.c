@@ -0,0 +1,93 @@
+/*
+  profile.c - interrupt timing by the Cortex-M4 DWT cycle counter
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The interrupts time themselves with the free running cycle counter of the data watchpoint and
+   trace unit. It counts core cycles whether or not a debugger is attached. Reading it takes a
+   single load, so the timing adds little to the interrupts it measures. */
+
+#include "config.h"
+#ifdef ISR_PROFILE
+
+#include "inc/hw_types.h"
+#include "driverlib/interrupt.h"
+#include "profile.h"
+
+static profile_t profiles[N_PROFILE];
+
+static uint32_t step_last_entry; // Cycle counter at the previous stepper interrupt entry
+static uint32_t step_last_period; // Step timer period loaded back then
+static uint8_t step_running;     // False until the first entry after the step timer was started
+
+static void profile_clear(profile_t *p)
+{
+  memset(p, 0, sizeof(profile_t));
+  p->min = 0xffffffff;
+}
+
+void profile_init()
+{
+  uint8_t i;
+  for (i=0; i<N_PROFILE; i++) { profile_clear(&profiles[i]); }
+  step_running = false;
+  HWREG(DEMCR) |= DEMCR_TRCENA;
+  HWREG(DWT_CTRL) |= DWT_CTRL_CYCCNTENA;
+}
+
+void profile_record(uint8_t quantity, uint32_t cycles)
+{
+  profile_t *p = &profiles[quantity];
+  p->count++;
+  p->sum += cycles;
+  if (cycles < p->min) { p->min = cycles; }
+  if (cycles > p->max) { p->max = cycles; }
+
+  uint8_t bucket = 0;
+  cycles /= PROFILE_BUCKET_MIN;
+  while (cycles && bucket < PROFILE_BUCKETS-1) {
+    cycles >>= 1;
+    bucket++;
+  }
+  p->histogram[bucket]++;
+}
+
+void profile_step_entry(uint32_t entry, uint32_t period)
+{
+  if (step_running) {
+    int32_t error = (entry-step_last_entry) - step_last_period;
+    profile_record(PROFILE_JITTER, (error < 0) ? -error : error);
+  }
+  step_last_entry = entry;
+  step_last_period = period;
+  step_running = true;
+}
+
+void profile_step_restart()
+{
+  step_running = false;
+}
+
+void profile_take(profile_t *copy)
+{
+  uint8_t i;
+  IntMasterDisable();
+  memcpy(copy, profiles, sizeof(profiles));
+  for (i=0; i<N_PROFILE; i++) { profile_clear(&profiles[i]); }
+  IntMasterEnable();
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*
+  profile.h - interrupt timing by the Cortex-M4 DWT cycle counter
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef profile_h
+#define profile_h
+
+#include "nuts_bolts.h"
+
+#ifdef ISR_PROFILE
+
+#include "inc/hw_types.h"
+
+// Profiled quantities, all in core cycles
+#define PROFILE_STEP       0 // Stepper driver interrupt, or the port word ring refill with STEP_PULSE_DMA
+#define PROFILE_STEP_RESET 1 // Step port reset interrupt
+#define PROFILE_SERIAL     2 // UART interrupt
+#define PROFILE_JITTER     3 // Deviation of the step interrupt period from the timer period programmed
+#define N_PROFILE          4
+
+// Histogram buckets. Bucket 0 counts values below PROFILE_BUCKET_MIN cycles, each further bucket
+// twice as wide as the one before, the last one everything above.
+#define PROFILE_BUCKETS    10
+#define PROFILE_BUCKET_MIN 64 // 0.8 usec at 80 MHz
+
+// Statistics of one profiled quantity
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t histogram[PROFILE_BUCKETS];
+} profile_t;
+
+// Core debug registers (ARMv7-M architecture reference manual, C1.6 and C1.8)
+#define DEMCR              0xE000EDFC // Debug exception and monitor control
+#define DEMCR_TRCENA       0x01000000 // Enables the DWT
+#define DWT_CTRL           0xE0001000 // DWT control
+#define DWT_CTRL_CYCCNTENA 0x00000001 // Enables the cycle counter
+#define DWT_CYCCNT         0xE0001004 // Free running core cycle counter
+
+// Returns the core cycle counter. Differences are valid across its wrap-around.
+#define profile_cycles() ((uint32_t)HWREG(DWT_CYCCNT))
+
+// Starts the cycle counter and clears the statistics
+void profile_init();
+
+// Adds a value in cycles to a profiled quantity. Called from the interrupts.
+void profile_record(uint8_t quantity, uint32_t cycles);
+
+// Called on every entry of the stepper driver interrupt with the cycle counter and the step timer
+// load value, before the interrupt changes it. The timer has just reloaded with it, so it is the
+// period until the next entry. Records by how much the time since the previous entry missed the
+// period loaded back then.
+void profile_step_entry(uint32_t entry, uint32_t period);
+
+// Called when the step timer is started, so the next period is not taken from the idle time.
+void profile_step_restart();
+
+// Copies the statistics of all quantities to the array, then clears them. Main program only.
+void profile_take(profile_t *profiles);
+
+// Times the code from PROFILE_START to PROFILE_END of the same name as the given quantity.
+#define PROFILE_START(name) uint32_t name = profile_cycles()
+#define PROFILE_END(name,quantity) profile_record(quantity, profile_cycles()-name)
+
+#else
+
+#define PROFILE_START(name)
+#define PROFILE_END(name,quantity)
+
+#endif
+
+#endif
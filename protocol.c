@@ -45,12 +45,40 @@
 static char line[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
 static uint8_t char_counter; // Last character counter in line variable.
 static uint8_t iscomment; // Comment/block delete flag for processor to ignore comment characters.
-
-
-void protocol_init() 
+static uint8_t frame_mode; // Binary motion frames instead of lines, from '$B' until FRAME_EXIT.
+static uint8_t frame_escape; // The last frame byte was FRAME_ESCAPE.
+
+// Incoming g-code lines are split into words as they are read from the serial read buffer, so
+// they are never copied into line[] and parsed a second time. Only '$' lines are stored as text.
+#define TOKEN_LINE_START 0 // Nothing but whitespace and comments in the line so far
+#define TOKEN_LETTER 1     // Expecting the command letter of the next word
+#define TOKEN_SIGN 2       // Expecting the sign or first digit of the value
+#define TOKEN_NUMBER 3     // Reading the digits of the value
+#define TOKEN_SETTING 4    // Storing a '$' line in line[]
+#define TOKEN_ERROR 5      // Skipping the rest of a line that failed to split into words
+
+static gc_block_t block; // Words of the incoming g-code line
+static uint8_t token_state;
+static uint8_t token_isnegative;
+static uint8_t token_isdecimal;
+static uint8_t token_ndigit;
+static int8_t token_exp;
+static uint32_t token_intval;
+
+static void protocol_reset_line()
 {
   char_counter = 0; // Reset line input
   iscomment = false;
+  frame_escape = false;
+  block.count = 0;
+  block.status_code = STATUS_OK;
+  token_state = TOKEN_LINE_START;
+}
+
+void protocol_init() 
+{
+  frame_mode = false;
+  protocol_reset_line();
   report_init_message(); // Welcome message
 
 #ifdef PART_LM4F120H5QR // code for ARM
@@ -79,6 +107,7 @@ void protocol_execute_startup()
       report_status_message(STATUS_SETTING_READ_FAIL);
     } else {
       if (line[0] != 0) {
+        mc_arc_finish(); // An arc from the previous startup line has to be buffered first.
         printString(line); // Echo startup line to indicate execution.
         report_status_message(gc_execute_line(line));
       }
@@ -137,6 +166,9 @@ ISR(PINOUT_INT_vect)
 // limit switches, or the main program.
 void protocol_execute_runtime()
 {
+  // Keep the stepper segment buffer filled. Every wait loop of the main program ends up here.
+  st_prep_buffer();
+
   if (sys.execute) { // Enter only if any bit flag is true
     uint8_t rt_exec = sys.execute; // Avoid calling volatile multiple times
     
@@ -199,10 +231,14 @@ void protocol_execute_runtime()
       }
       bit_false(sys.execute,EXEC_CYCLE_START);
     }
-  }
 
-  // Overrides flag byte (sys.override) and execution should be installed here, since they
-  // are runtime and require a direct and controlled interface to the main stepper program.
+    // Replan the buffered motion for changed overrides. Runs here, since the planner
+    // and the stepper segment preparation are only ever touched by the main program.
+    if (rt_exec & EXEC_OVERRIDE) {
+      bit_false(sys.execute,EXEC_OVERRIDE); // Cleared first, so a change meanwhile replans again.
+      st_update_overrides();
+    }
+  }
 }
 
 
@@ -237,6 +273,16 @@ uint8_t protocol_execute_line(char *line)
         if ( line[++char_counter] != 0 ) { return(STATUS_UNSUPPORTED_STATEMENT); }
         else { report_gcode_modes(); }
         break;
+      case 'P' : // Prints planner buffer size and use
+        if ( line[++char_counter] != 0 ) { return(STATUS_UNSUPPORTED_STATEMENT); }
+        else { report_planner_buffer(); }
+        break;
+      #ifdef ISR_PROFILE
+      case 'T' : // Prints and clears the interrupt timing statistics
+        if ( line[++char_counter] != 0 ) { return(STATUS_UNSUPPORTED_STATEMENT); }
+        else { report_isr_profile(); }
+        break;
+      #endif
       case 'C' : // Set check g-code mode
         if ( line[++char_counter] != 0 ) { return(STATUS_UNSUPPORTED_STATEMENT); }
         // Perform reset when toggling off. Check g-code mode should only work if Grbl
@@ -259,6 +305,12 @@ uint8_t protocol_execute_line(char *line)
           // Don't run startup script. Prevents stored moves in startup from causing accidents.
         }
         break;
+      case 'B' : // Stream binary motion frames
+        if ( line[++char_counter] != 0 ) { return(STATUS_UNSUPPORTED_STATEMENT); }
+        if (sys.state == STATE_ALARM) { return(STATUS_ALARM_LOCK); }
+        gc_begin_frames();
+        frame_mode = true;
+        break;
       case 'H' : // Perform homing cycle
         if (bit_istrue(settings.flags,BITFLAG_HOMING_ENABLE)) {
           // Only perform homing if Grbl is idle or lost.
@@ -324,53 +376,193 @@ uint8_t protocol_execute_line(char *line)
 }
 
 
+// Completes the value of the current word. Fails the line if the word has no digits.
+static void protocol_end_word()
+{
+  if (!token_ndigit) {
+    block.status_code = STATUS_BAD_NUMBER_FORMAT;
+    token_state = TOKEN_ERROR;
+    return;
+  }
+  float value = decimal_to_float(token_intval, token_exp);
+  block.word[block.count++].value = token_isnegative ? -value : value;
+  token_state = TOKEN_LETTER;
+}
+
+// Collects one binary motion frame in place of a line and executes it. The frame is unescaped
+// into the line buffer, which is not needed for anything else meanwhile. Returns once the frame
+// is complete or the read buffer holds no more of it.
+static void protocol_process_frame(uint8_t *data, uint16_t count)
+{
+  uint16_t n;
+  uint8_t c;
+  for (n = 0; n < count; n++) {
+    c = data[n];
+    if (c == FRAME_END) { break; }
+    if (c == FRAME_ESCAPE) {
+      frame_escape = true;
+      continue;
+    }
+    if (frame_escape) {
+      c ^= 0x20;
+      frame_escape = false;
+    }
+    // Keep counting the bytes of an overlong frame, so it fails the length check.
+    if (char_counter < FRAME_MAX_SIZE) { line[char_counter] = c; }
+    if (char_counter <= FRAME_MAX_SIZE) { char_counter++; }
+  }
+
+  if (n == count) { // No end of frame yet. Release the bytes and wait for more.
+    serial_advance(count);
+    return;
+  }
+  if (mc_arc_pending()) { // Hold the frame until the arc in progress is buffered. Keep its end.
+    serial_advance(n);
+    return;
+  }
+  serial_advance(n+1);
+
+  protocol_execute_runtime(); // Runtime command check point, as for lines
+  if (sys.abort) { return; }
+
+  if (char_counter == 0) {
+    report_status_message(STATUS_OK); // Empty frame. Acknowledged for syncing purposes, like an empty line.
+  } else {
+    uint8_t status = gc_execute_frame((uint8_t *)line, char_counter);
+    if (status == STATUS_OK && (uint8_t)line[0] == FRAME_EXIT) { frame_mode = false; }
+    report_status_message(status);
+  }
+  protocol_reset_line();
+}
+
 // Process and report status one line of incoming serial data. Performs an initial filtering
-// by removing spaces and comments and capitalizing all letters.
+// by removing spaces and comments and capitalizing all letters. G-code lines are split into
+// words on the fly, with the same number format as read_float(). The characters are parsed in
+// place in the serial read buffer, as many at a time as it holds in one piece.
 void protocol_process()
 {
+  uint8_t *data;
+  uint16_t count, n;
   uint8_t c;
-  while((c = serial_read()) != SERIAL_NO_DATA) {
-    if ((c == '\n') || (c == '\r')) { // End of line reached
-
-      // Runtime command check point before executing line. Prevent any furthur line executions.
-      // NOTE: If there is no line, this function should quickly return to the main program when
-      // the buffer empties of non-executable data.
-      protocol_execute_runtime();
-      if (sys.abort) { return; } // Bail to main program upon system abort
-
-      if (char_counter > 0) {// Line is complete. Then execute!
-        line[char_counter] = 0; // Terminate string
-        report_status_message(protocol_execute_line(line));
-      } else {
-        // Empty or comment line. Skip block.
-        report_status_message(STATUS_OK); // Send status message for syncing purposes.
-      }
-      char_counter = 0; // Reset line buffer index
-      iscomment = false; // Reset comment flag
-
-    } else {
+  while((count = serial_peek(&data)) > 0) {
+    if (frame_mode) {
+      protocol_process_frame(data, count);
+      if (sys.abort || mc_arc_pending()) { return; }
+      continue;
+    }
+    for (n = 0; n < count; n++) {
+      c = data[n];
+      if ((c == '\n') || (c == '\r')) { break; } // End of line reached
       if (iscomment) {
         // Throw away all comment characters
         if (c == ')') {
           // End of comment. Resume line.
           iscomment = false;
         }
-      } else {
-        if (c <= ' ') {
-          // Throw away whitepace and control characters
-        } else if (c == '/') {
-          // Block delete not supported. Ignore character.
-        } else if (c == '(') {
-          // Enable comments flag and ignore all characters until ')' or EOL.
-          iscomment = true;
-        } else if (char_counter >= LINE_BUFFER_SIZE-1) {
+        continue;
+      }
+      if (c <= ' ') {
+        continue; // Throw away whitepace and control characters
+      } else if (c == '/') {
+        continue; // Block delete not supported. Ignore character.
+      } else if (c == '(') {
+        // Enable comments flag and ignore all characters until ')' or EOL.
+        iscomment = true;
+        continue;
+      } else if (c >= 'a' && c <= 'z') { // Upcase lowercase
+        c -= 'a'-'A';
+      }
+
+      switch (token_state) {
+        case TOKEN_LINE_START:
+          if (c == '$') {
+            token_state = TOKEN_SETTING;
+            line[char_counter++] = c;
+            continue;
+          }
+          break;
+        case TOKEN_SETTING:
           // Throw away any characters beyond the end of the line buffer
-        } else if (c >= 'a' && c <= 'z') { // Upcase lowercase
-          line[char_counter++] = c-'a'+'A';
-        } else {
-          line[char_counter++] = c;
-        }
+          if (char_counter < LINE_BUFFER_SIZE-1) { line[char_counter++] = c; }
+          continue;
+        case TOKEN_ERROR:
+          continue;
+        case TOKEN_SIGN:
+          if (c == '-') {
+            token_isnegative = true;
+            token_state = TOKEN_NUMBER;
+            continue;
+          } else if (c == '+') {
+            token_state = TOKEN_NUMBER;
+            continue;
+          }
+          // No break. The value starts without a sign.
+        case TOKEN_NUMBER:
+          token_state = TOKEN_NUMBER;
+          if ((uint8_t)(c-'0') <= 9) {
+            token_ndigit++;
+            if (token_ndigit <= MAX_INT_DIGITS) {
+              if (token_isdecimal) { token_exp--; }
+              token_intval = (((token_intval << 2) + token_intval) << 1) + (c-'0'); // intval*10 + c
+            } else {
+              if (!(token_isdecimal)) { token_exp++; }  // Drop overflow digits
+            }
+            continue;
+          } else if (c == '.' && !(token_isdecimal)) {
+            token_isdecimal = true;
+            continue;
+          }
+          protocol_end_word(); // Any other character ends the value and starts the next word.
+          if (token_state == TOKEN_ERROR) { continue; }
+          break;
       }
+
+      // Start the next word with its command letter
+      if ((c < 'A') || (c > 'Z')) {
+        block.status_code = STATUS_EXPECTED_COMMAND_LETTER;
+        token_state = TOKEN_ERROR;
+      } else if (block.count == MAX_BLOCK_WORDS) {
+        block.status_code = STATUS_OVERFLOW;
+        token_state = TOKEN_ERROR;
+      } else {
+        block.word[block.count].letter = c;
+        token_isnegative = false;
+        token_isdecimal = false;
+        token_ndigit = 0;
+        token_exp = 0;
+        token_intval = 0;
+        token_state = TOKEN_SIGN;
+      }
+    }
+
+    if (n == count) { // No end of line yet. Release the characters and wait for more.
+      serial_advance(count);
+      continue;
+    }
+    if (mc_arc_pending()) {
+      // The words are split already, but the line has to wait until the arc in progress is
+      // buffered. Keep its end in the buffer and let the main loop feed the arc meanwhile.
+      serial_advance(n);
+      return;
+    }
+    serial_advance(n+1); // Release the line and its end before executing, which may take a while.
+    if (token_state == TOKEN_SIGN || token_state == TOKEN_NUMBER) { protocol_end_word(); }
+
+    // Runtime command check point before executing line. Prevent any furthur line executions.
+    // NOTE: If there is no line, this function should quickly return to the main program when
+    // the buffer empties of non-executable data.
+    protocol_execute_runtime();
+    if (sys.abort) { return; } // Bail to main program upon system abort
+
+    if (token_state == TOKEN_SETTING) { // Line is complete. Then execute!
+      line[char_counter] = 0; // Terminate string
+      report_status_message(protocol_execute_line(line));
+    } else if (token_state != TOKEN_LINE_START) {
+      report_status_message(gc_execute_block(&block));
+    } else {
+      // Empty or comment line. Skip block.
+      report_status_message(STATUS_OK); // Send status message for syncing purposes.
     }
+    protocol_reset_line();
   }
 }
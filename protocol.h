@@ -37,6 +37,12 @@
   #define LINE_BUFFER_SIZE 64 /// must be a multiple of 4 for ARM (because of EEPROM limitations...)
 #endif
 
+// Binary motion frames (see gcode.h) end with FRAME_END, like lines. Frame bytes that would be
+// taken for a line end, a runtime command or flow control are sent as FRAME_ESCAPE followed by
+// the byte xor 0x20: '\n', '\r', FRAME_ESCAPE, the CMD_ characters of config.h, XON and XOFF.
+#define FRAME_END '\n'
+#define FRAME_ESCAPE 0x1b
+
 // Initialize the serial protocol
 void protocol_init();
 
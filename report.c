@@ -39,6 +39,10 @@
 #include "nuts_bolts.h"
 #include "gcode.h"
 #include "coolant_control.h"
+#include "serial.h"
+#include "planner.h"
+#include "stepper.h"
+#include "profile.h"
 
 
 // Handles the primary confirmation protocol response for streaming interfaces and human-feedback.
@@ -80,6 +84,12 @@ void report_status_message(uint8_t status_code)
       printPgmString("Busy or queued"); break;
       case STATUS_ALARM_LOCK:
       printPgmString("Alarm lock"); break;
+      case STATUS_OVERFLOW:
+      printPgmString("Line overflow"); break;
+      case STATUS_BAD_FRAME:
+      printPgmString("Bad frame"); break;
+      case STATUS_SETTING_RPM_RANGE:
+      printPgmString("Min rpm > max rpm"); break;
     }
     printPgmString("\r\n");
   }
@@ -94,6 +104,8 @@ void report_alarm_message(int8_t alarm_code)
     printPgmString("Hard limit"); break;
     case ALARM_ABORT_CYCLE:
     printPgmString("Abort during cycle"); break;
+    case ALARM_HOMING_FAIL:
+    printPgmString("Homing fail"); break;
   }
   printPgmString(". MPos?\r\n");
   delay_ms(500); // Force delay to ensure message clears serial write buffer.
@@ -141,9 +153,15 @@ void report_grbl_help() {
                       "$C (check gcode mode)\r\n"
                       "$X (kill alarm lock)\r\n"
                       "$H (run homing cycle)\r\n"
-                      "~ (cycle start)\r\n"
+                      "$B (stream binary motion frames)\r\n"
+                      "$P (view planner buffer)\r\n");
+  #ifdef ISR_PROFILE
+    printPgmString("$T (view interrupt timing)\r\n");
+  #endif
+  printPgmString("~ (cycle start)\r\n"
                       "! (feed hold)\r\n"
                       "? (current status)\r\n"
+                      "0x90-0x9D (feed, rapid and spindle overrides)\r\n"
                       "ctrl-x (reset Grbl)\r\n");
 }
 
@@ -175,7 +193,18 @@ void report_grbl_settings() {
   printPgmString(" (homing feed, mm/min)\r\n$20="); printFloat(settings.homing_seek_rate);
   printPgmString(" (homing seek, mm/min)\r\n$21="); printInteger(settings.homing_debounce_delay);
   printPgmString(" (homing debounce, msec)\r\n$22="); printFloat(settings.homing_pulloff);
-  printPgmString(" (homing pull-off, mm)\r\n");
+  printPgmString(" (homing pull-off, mm)\r\n$23="); printFloat(settings.arc_tolerance);
+  printPgmString(" (arc tolerance, mm)\r\n$24="); printFloat(settings.max_rate[X_AXIS]);
+  printPgmString(" (x max rate, mm/min)\r\n$25="); printFloat(settings.max_rate[Y_AXIS]);
+  printPgmString(" (y max rate, mm/min)\r\n$26="); printFloat(settings.max_rate[Z_AXIS]);
+  printPgmString(" (z max rate, mm/min)\r\n$27="); printFloat(settings.max_acceleration[X_AXIS]/(60*60)); // Convert from mm/min^2 for human readability
+  printPgmString(" (x accel, mm/sec^2)\r\n$28="); printFloat(settings.max_acceleration[Y_AXIS]/(60*60));
+  printPgmString(" (y accel, mm/sec^2)\r\n$29="); printFloat(settings.max_acceleration[Z_AXIS]/(60*60));
+  printPgmString(" (z accel, mm/sec^2)\r\n$30="); printFloat(settings.jerk/(60*60*60)); // Convert from mm/min^3 for human readability
+  printPgmString(" (jerk, mm/sec^3)\r\n$31="); printFloat(settings.spindle_max_rpm);
+  printPgmString(" (spindle max, rpm)\r\n$32="); printFloat(settings.spindle_min_rpm);
+  printPgmString(" (spindle min, rpm)\r\n$33="); printInteger(bit_istrue(settings.flags,BITFLAG_LASER_MODE) && 1);
+  printPgmString(" (laser mode, bool)\r\n");
 }
 
 
@@ -246,6 +275,9 @@ void report_gcode_modes()
   if (gc.inverse_feed_rate_mode) { printPgmString(" G93"); }
   else { printPgmString(" G94"); }
 
+  if (gc.path_tolerance > 0) { printPgmString(" G64"); }
+  else { printPgmString(" G61"); }
+
   switch (gc.program_flow) {
     case PROGRAM_FLOW_RUNNING : printPgmString(" M0"); break;
     case PROGRAM_FLOW_PAUSED : printPgmString(" M1"); break;
@@ -269,6 +301,9 @@ void report_gcode_modes()
   printPgmString(" T");
   printInteger(gc.tool);
 
+  printPgmString(" S");
+  printFloat(gc.spindle_speed);
+
   printPgmString(" F");
   if (gc.inches_mode) { printFloat(gc.feed_rate*INCH_PER_MM); }
   else { printFloat(gc.feed_rate); }
@@ -284,6 +319,62 @@ void report_startup_line(uint8_t n, char *line)
   printPgmString("\r\n");
 }
 
+// Prints the planner buffer size, the RAM it takes and the number of blocks in use, e.g.
+// "[Blocks:64,Bytes/block:60,RAM:3840,Used:12]"
+void report_planner_buffer()
+{
+  printPgmString("[Blocks:"); printInteger(BLOCK_BUFFER_SIZE);
+  printPgmString(",Bytes/block:"); printInteger(sizeof(block_t));
+  printPgmString(",RAM:"); printInteger(BLOCK_BUFFER_SIZE*sizeof(block_t));
+  printPgmString(",Used:"); printInteger(plan_get_block_buffer_count());
+  printPgmString("]\r\n");
+}
+
+#ifdef ISR_PROFILE
+// Prints the interrupt timing since the last call in core cycles, one line per profiled quantity
+// after a line with the histogram bucket limits, e.g.
+// "[Step,N:41210,Min:96,Mean:131,Max:402,Hist:0,39877,1320,13,0,0,0,0,0,0]"
+void report_isr_profile()
+{
+  static const char *names[N_PROFILE] = { "Step", "StepReset", "Serial", "Jitter" };
+  profile_t profiles[N_PROFILE];
+  uint8_t i, k;
+  profile_take(profiles);
+
+  printPgmString("[Cycles at "); printInteger(F_CPU/1000000);
+  printPgmString(" MHz,Hist:<"); printInteger(PROFILE_BUCKET_MIN);
+  for (k=1; k<PROFILE_BUCKETS-1; k++) {
+    printPgmString(",<"); printInteger(PROFILE_BUCKET_MIN << k);
+  }
+  printPgmString(",more]\r\n");
+
+  for (i=0; i<N_PROFILE; i++) {
+    profile_t *p = &profiles[i];
+    printPgmString("["); printString(names[i]);
+    printPgmString(",N:"); printInteger(p->count);
+    printPgmString(",Min:"); printInteger(p->count ? p->min : 0);
+    printPgmString(",Mean:"); printInteger(p->count ? p->sum/p->count : 0);
+    printPgmString(",Max:"); printInteger(p->max);
+    printPgmString(",Hist:");
+    for (k=0; k<PROFILE_BUCKETS; k++) {
+      if (k) { printPgmString(","); }
+      printInteger(p->histogram[k]);
+    }
+    printPgmString("]\r\n");
+  }
+}
+#endif
+
+// Longest status report, with all fields at the most digits they can have
+#define STATUS_LINE_SIZE 224
+
+// Appends the text to the status line at s and returns the end of it.
+static char *status_append(char *s, const char *text)
+{
+  while (*text) { *s++ = *text++; }
+  return(s);
+}
+
  // Prints real-time data. This function grabs a real-time snapshot of the stepper subprogram 
  // and the actual location of the CNC machine. Users may change the following function to their
  // specific needs, but the desired real-time data report must be as short as possible. This is
@@ -291,47 +382,79 @@ void report_startup_line(uint8_t n, char *line)
  // especially during g-code programs with fast, short line segments and high frequency reports (5-20Hz).
 void report_realtime_status()
 {
-  // **Under construction** Bare-bones status report. Provides real-time machine position relative to 
-  // the system power on location (0,0,0) and work coordinate position (G54 and G92 applied). Eventually
-  // to be added are distance to go on block, processed block id, and feed rate. Also a settings bitmask
-  // for a user to select the desired real-time data.
+  // Real-time machine position relative to the system power on location (0,0,0), work coordinate
+  // position (G54 and G92 applied), overrides, feed rate and planner state. The machine state is
+  // taken from the stepper interrupt in one consistent snapshot, then the whole line is formatted
+  // in memory and queued for sending in one piece, which keeps frequent polling cheap.
+  static char line[STATUS_LINE_SIZE];
+  char *s = line;
   uint8_t i;
-  int32_t current_position[N_AXIS]; // Copy current state of the system position variable
-  memcpy(current_position,sys.position,sizeof(sys.position));
+  st_snapshot_t snapshot;
+  st_get_snapshot(&snapshot);
   float print_position[N_AXIS];
  
   // Report current machine state
   switch (sys.state) {
-    case STATE_IDLE: printPgmString("<Idle"); break;
-//    case STATE_INIT: printPgmString("[Init")); break; // Never observed
-    case STATE_QUEUED: printPgmString("<Queue"); break;
-    case STATE_CYCLE: printPgmString("<Run"); break;
-    case STATE_HOLD: printPgmString("<Hold"); break;
-    case STATE_HOMING: printPgmString("<Home"); break;
-    case STATE_ALARM: printPgmString("<Alarm"); break;
-    case STATE_CHECK_MODE: printPgmString("<Check"); break;
+    case STATE_IDLE: s = status_append(s,"<Idle"); break;
+//    case STATE_INIT: s = status_append(s,"[Init"); break; // Never observed
+    case STATE_QUEUED: s = status_append(s,"<Queue"); break;
+    case STATE_CYCLE: s = status_append(s,"<Run"); break;
+    case STATE_HOLD: s = status_append(s,"<Hold"); break;
+    case STATE_HOMING: s = status_append(s,"<Home"); break;
+    case STATE_ALARM: s = status_append(s,"<Alarm"); break;
+    case STATE_CHECK_MODE: s = status_append(s,"<Check"); break;
   }
  
   // Report machine position
-  printPgmString(",MPos:");
+  s = status_append(s,",MPos:");
   for (i=0; i<= 2; i++) {
-    print_position[i] = current_position[i]/settings.steps_per_mm[i];
+    print_position[i] = snapshot.position[i]/settings.steps_per_mm[i];
     if (bit_istrue(settings.flags,BITFLAG_REPORT_INCHES)) { print_position[i] *= INCH_PER_MM; }
-    printFloat(print_position[i]);
-    printPgmString(",");
+    s = format_float(s,print_position[i]);
+    *s++ = ',';
   }
   
   // Report work position
-  printPgmString("WPos:");
+  s = status_append(s,"WPos:");
   for (i=0; i<= 2; i++) {
     if (bit_istrue(settings.flags,BITFLAG_REPORT_INCHES)) {
       print_position[i] -= (gc.coord_system[i]+gc.coord_offset[i])*INCH_PER_MM;
     } else {
       print_position[i] -= gc.coord_system[i]+gc.coord_offset[i];
     }
-    printFloat(print_position[i]);
-    if (i < 2) { printPgmString(","); }
+    s = format_float(s,print_position[i]);
+    if (i < 2) { *s++ = ','; }
   }
 
-  printPgmString(">\r\n");
+  // Report the override values in percent: feed, rapid, spindle.
+  s = status_append(s,",Ov:");
+  s = format_integer(s,sys.feed_override);
+  *s++ = ',';
+  s = format_integer(s,sys.rapid_override);
+  *s++ = ',';
+  s = format_integer(s,sys.spindle_override);
+
+  // Report the speed of the motion being stepped, the blocks in the planner buffer and the blocks
+  // started since reset, by which a host can follow the progress of a streamed program.
+  s = status_append(s,",F:");
+  if (bit_istrue(settings.flags,BITFLAG_REPORT_INCHES)) { snapshot.feed_rate *= INCH_PER_MM; }
+  s = format_float(s,snapshot.feed_rate);
+  s = status_append(s,",Bf:");
+  s = format_integer(s,snapshot.buffer_count);
+  s = status_append(s,",Blk:");
+  s = format_integer(s,snapshot.block_count);
+
+  #ifdef REPORT_SERIAL_STATE
+    // Report serial read buffer level, its high watermark and dropped echoes
+    s = status_append(s,",RX:");
+    s = format_integer(s,serial_get_rx_buffer_count());
+    s = status_append(s,",RXMax:");
+    s = format_integer(s,serial_get_rx_buffer_high_water());
+    s = status_append(s,",TXDrop:");
+    s = format_integer(s,serial_get_tx_dropped());
+  #endif
+
+  s = status_append(s,">\r\n");
+  *s = 0;
+  printString(line);
 }
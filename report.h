@@ -35,10 +35,14 @@
 #define STATUS_SETTING_READ_FAIL 10
 #define STATUS_IDLE_ERROR 11
 #define STATUS_ALARM_LOCK 12
+#define STATUS_OVERFLOW 13
+#define STATUS_BAD_FRAME 14
+#define STATUS_SETTING_RPM_RANGE 15
 
 // Define Grbl alarm codes. Less than zero to distinguish alarm error from status error.
 #define ALARM_HARD_LIMIT -1
 #define ALARM_ABORT_CYCLE -2
+#define ALARM_HOMING_FAIL -3
 
 // Define Grbl feedback message codes.
 #define MESSAGE_CRITICAL_EVENT 1
@@ -79,4 +83,12 @@ void report_gcode_modes();
 // Prints startup line
 void report_startup_line(uint8_t n, char *line);
 
+// Prints planner buffer size and use
+void report_planner_buffer();
+
+#ifdef ISR_PROFILE
+// Prints the interrupt timing statistics and clears them
+void report_isr_profile();
+#endif
+
 #endif
@@ -0,0 +1,235 @@
+#!/usr/bin/env python
+"""\
+Pack a g-code file into binary motion frames for grbl
+
+Lines that hold nothing but a G0, G1, G2 or G3 motion with X, Y, Z,
+I, J, K and F words are converted into binary frames, which grbl
+executes without parsing any text (see gcode.h). Everything else is
+passed on as a g-code line, leaving frame mode with an exit frame
+first. '$B' enters frame mode again for the next motion.
+
+The output is meant to be streamed like any g-code file: every line
+and every frame ends with a newline and gets one 'ok' or 'error'
+response. Do not strip the frames, they may start or end with a
+byte that looks like white space.
+
+Targets are sent relative to the last one in 16 bits where they fit
+and absolute in 32 bits otherwise, always in micrometers of the work
+coordinate system. Absolute targets are also sent for every axis the
+first time it moves after '$B', or when its position is unknown, e.g.
+after G28 or a coordinate system change.
+
+Usage: pack.py file.nc [-o out.bin] [-s]
+"""
+
+from __future__ import print_function
+import argparse
+import re
+import struct
+import sys
+
+FRAME_END = 0x0a
+FRAME_ESCAPE = 0x1b
+# Line ends, FRAME_ESCAPE, the runtime commands ^X ? ~ !, the override commands and XON/XOFF
+ESCAPED = (0x0a, 0x0d, 0x1b, 0x18, ord('?'), ord('~'), ord('!'), 0x11, 0x13) + \
+          tuple(range(0x90, 0x98)) + tuple(range(0x99, 0x9e))
+
+FRAME_WIDE_BIT = 0
+FRAME_X_BIT = 1
+FRAME_FEED_BIT = 4
+FRAME_MOTION_BIT = 5
+FRAME_EXIT = 0x80
+
+MOTION_WORDS = set('XYZIJKF')
+PLANES = { 17: (0, 1), 18: (0, 2), 19: (1, 2) } # Axes of the arc offsets, as select_plane()
+
+
+def crc16(data):
+    crc = 0xffff
+    for b in bytearray(data):
+        crc ^= b << 8
+        for k in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xffff
+    return crc
+
+def frame(payload):
+    payload = bytearray(payload)
+    payload += struct.pack('>H', crc16(payload))
+    out = bytearray()
+    for b in payload:
+        if b in ESCAPED:
+            out.append(FRAME_ESCAPE)
+            b ^= 0x20
+        out.append(b)
+    out.append(FRAME_END)
+    return out
+
+def fits16(v):
+    return -32768 <= v <= 32767
+
+
+class Packer:
+    def __init__(self):
+        self.out = bytearray()
+        self.frames = 0
+        self.lines = 0
+        self.reset()
+        self.in_frames = False
+
+    # Modal state after power up or M2/M30, as gc_init()
+    def reset(self):
+        self.inches = False
+        self.absolute = True
+        self.inverse = False
+        self.plane = (0, 1)
+        self.motion = 0
+        self.feed = None   # um/min, as grbl has it. None while unknown.
+        self.pos = [None, None, None] # um in work coordinates. None while unknown.
+        self.synced = set()
+
+    def um(self, value):
+        return int(round(value*(25400.0 if self.inches else 1000.0)))
+
+    def line(self, text):
+        if self.in_frames:
+            self.out += frame([FRAME_EXIT])
+            self.frames += 1
+            self.in_frames = False
+        self.out += bytearray(text + '\n', 'ascii')
+        self.lines += 1
+
+    # Returns the payload of a frame for the words, or None if the line has to stay g-code.
+    def encode(self, words):
+        motion = self.motion
+        for letter, value in words:
+            if letter == 'G':
+                if value in (0, 1, 2, 3): motion = int(value)
+                else: return None
+            elif letter != 'N' and letter not in MOTION_WORDS:
+                return None
+        if motion not in (0, 1, 2, 3) or self.inverse: return None
+        axes = dict((l, v) for l, v in words if l in 'XYZ')
+        offsets = dict((l, v) for l, v in words if l in 'IJK')
+        if not axes: return None
+        if motion >= 2:
+            plane = [self.plane[0], self.plane[1]]
+            if any('IJK'.index(l) not in plane for l in offsets) or not offsets: return None
+        elif offsets: return None
+
+        target = list(self.pos)
+        for l, v in axes.items():
+            i = 'XYZ'.index(l)
+            if self.absolute: target[i] = self.um(v)
+            elif self.pos[i] is None: return None
+            else: target[i] = self.pos[i] + self.um(v)
+
+        header = motion << FRAME_MOTION_BIT
+        present = [i for i in range(3) if 'XYZ'[i] in axes]
+        wide = any(i not in self.synced or not fits16(target[i]-self.pos[i]) for i in present)
+        arc = []
+        if motion >= 2:
+            arc = [self.um(offsets.get('IJK'[i], 0.0)) for i in self.plane]
+            wide = wide or not all(fits16(v) for v in arc)
+        fmt = '<i' if wide else '<h'
+        payload = bytearray()
+        for i in present:
+            header |= 1 << (FRAME_X_BIT+i)
+            payload += struct.pack(fmt, target[i] if wide else target[i]-self.pos[i])
+        for v in arc:
+            payload += struct.pack(fmt, v)
+        feed = dict(words).get('F')
+        if feed is not None and self.um(feed) != self.feed:
+            header |= 1 << FRAME_FEED_BIT
+            payload += struct.pack('<I', self.um(feed))
+            self.feed = self.um(feed)
+        if wide: header |= 1 << FRAME_WIDE_BIT
+
+        self.motion = motion
+        self.pos = target
+        self.synced.update(present)
+        return bytearray([header]) + payload
+
+    # Tracks what a g-code line passed on to grbl does to the state the frames depend on.
+    def track(self, words):
+        forget = False
+        g = [v for l, v in words if l == 'G']
+        for v in g:
+            if v in (0, 1, 2, 3, 80): self.motion = int(v)
+            elif v in PLANES: self.plane = PLANES[v]
+            elif v == 20: self.inches = True
+            elif v == 21: self.inches = False
+            elif v == 90: self.absolute = True
+            elif v == 91: self.absolute = False
+            elif v == 93: self.inverse = True
+            elif v == 94: self.inverse = False
+            elif v not in (4, 92): forget = True # G10, G28, G30, G53, G54-G59, G92.1, ...
+        for l, v in words:
+            if l == 'F' and not self.inverse: self.feed = self.um(v)
+            if l == 'M' and v in (2, 30): self.reset()
+        if forget:
+            self.pos = [None, None, None]
+        elif 92 in g: # G92 sets the work position of the axes given
+            for l, v in words:
+                if l in 'XYZ': self.pos['XYZ'.index(l)] = self.um(v)
+        elif self.motion in (0, 1, 2, 3):
+            for l, v in words:
+                if l in 'XYZ':
+                    i = 'XYZ'.index(l)
+                    if self.absolute: self.pos[i] = self.um(v)
+                    elif self.pos[i] is not None: self.pos[i] += self.um(v)
+
+    def add(self, text):
+        text = re.sub(r'\(.*?\)|;.*', '', text).upper()
+        text = re.sub(r'\s', '', text)
+        if not text: return
+        tokens = re.findall(r'([A-Z])([-+]?[0-9]*\.?[0-9]+|[-+]?[0-9]+\.?)', text)
+        if text.startswith('$') or ''.join(l+v for l, v in tokens) != text:
+            self.line(text) # Settings or anything odd go to grbl unchanged.
+            return
+        words = [(l, float(v)) for l, v in tokens]
+        if not self.in_frames:
+            self.synced = set() # Grbl takes the position from its own, rounded to micrometers.
+        payload = self.encode(words)
+        if payload is None:
+            self.line(text)
+            self.track(words)
+            return
+        if not self.in_frames:
+            self.out += bytearray('$B\n', 'ascii')
+            self.lines += 1
+            self.in_frames = True
+        self.out += frame(payload)
+        self.frames += 1
+
+    def finish(self):
+        if self.in_frames:
+            self.out += frame([FRAME_EXIT])
+            self.frames += 1
+            self.in_frames = False
+
+
+parser = argparse.ArgumentParser(description='Pack a g-code file into binary motion frames for grbl.')
+parser.add_argument('gcode_file', type=argparse.FileType('r'),
+        help='g-code filename to be packed')
+parser.add_argument('-o','--output', default=None,
+        help='output file, stdout by default')
+parser.add_argument('-s','--stats', action='store_true', default=False,
+        help='print the size of the input and output to stderr')
+args = parser.parse_args()
+
+p = Packer()
+size = 0
+for text in args.gcode_file:
+    size += len(text)
+    p.add(text)
+p.finish()
+
+if args.output:
+    with open(args.output, 'wb') as f: f.write(p.out)
+else:
+    out = getattr(sys.stdout, 'buffer', sys.stdout)
+    out.write(p.out)
+if args.stats:
+    print('%d bytes in, %d bytes out (%.2fx), %d frames, %d lines' %
+          (size, len(p.out), float(size)/max(len(p.out), 1), p.frames, p.lines), file=sys.stderr)
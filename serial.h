@@ -28,7 +28,7 @@
 #include "nuts_bolts.h"
 
 #ifndef RX_BUFFER_SIZE
-  #define RX_BUFFER_SIZE 32
+  #define RX_BUFFER_SIZE 1024 ///32 on AVR. Buffer indices are 16-bit, so up to 65535 bytes.
 #endif
 #ifndef TX_BUFFER_SIZE
   #define TX_BUFFER_SIZE 128
@@ -36,9 +36,14 @@
 
 #define SERIAL_NO_DATA 0xff
 
+// Flow control watermarks. Stop the host at three quarters full, which leaves a quarter of the
+// read buffer for whatever the host and its USB-serial bridge still have in flight. Let it go
+// again at half full, so the stop and go handshakes do not chatter. The USB transport stops
+// taking packets from the host instead.
+#define RX_BUFFER_FULL (RX_BUFFER_SIZE - RX_BUFFER_SIZE/4) // XOFF and RTS high watermark
+#define RX_BUFFER_LOW (RX_BUFFER_SIZE/2) // XON and RTS low watermark
+
 #ifdef ENABLE_XONXOFF
-  #define RX_BUFFER_FULL 96 // XOFF high watermark
-  #define RX_BUFFER_LOW 64 // XON low watermark
   #define SEND_XOFF 1
   #define SEND_XON 2
   #define XOFF_SENT 3
@@ -49,11 +54,54 @@
 
 void serial_init();
 
+// Writes a byte to the transmit buffer, waiting for room if it is full. Main program only.
 void serial_write(uint8_t data);
 
+// Writes a string to the transmit buffer, waiting for room as needed. Holds off the transport
+// interrupt once for as much of the string as fits, instead of once per byte. Main program only.
+void serial_write_string(const char *s);
+
 uint8_t serial_read();
 
+// Points data at the oldest received byte and returns how many bytes follow it in one piece, so
+// they can be parsed in place. The bytes stay in the read buffer until released by serial_advance().
+uint16_t serial_peek(uint8_t **data);
+
+// Releases the given number of bytes, as returned by serial_peek(), from the read buffer.
+void serial_advance(uint16_t count);
+
+// Returns the number of bytes in the read buffer.
+uint16_t serial_get_rx_buffer_count();
+
+// Returns the most bytes the read buffer has held since power-up, i.e. how close a
+// streaming host came to overrunning it.
+uint16_t serial_get_rx_buffer_high_water();
+
+// Returns the number of echoed bytes dropped since power-up because the transmit buffer was full.
+uint32_t serial_get_tx_dropped();
+
 // Reset and empty data in read buffer. Used by e-stop and reset.
 void serial_reset_read_buffer();
 
+
+// Transport interface. serial.c keeps the buffers and picks off the runtime commands. The
+// transport selected in config.h moves the bytes between them and the host.
+
+// Called by the transport from its interrupt for every byte received.
+void serial_receive(uint8_t data);
+
+// Takes the next byte to send from the transmit buffer. Returns false if it is empty.
+uint8_t serial_tx_get(uint8_t *data);
+
+// Returns true while the transmit buffer holds bytes to send.
+uint8_t serial_tx_pending();
+
+// Implemented by the transport (serial_uart.c or serial_usb.c).
+void transport_init();
+void transport_start_tx(); // New bytes in the transmit buffer. Transport interrupt held off or running.
+void transport_stop_rx();  // Read buffer reached RX_BUFFER_FULL. Called from the transport interrupt.
+void transport_resume_rx(); // Read buffer drained below RX_BUFFER_LOW. Transport interrupt held off.
+void transport_lock();     // Holds off the transport interrupt
+void transport_unlock();
+
 #endif
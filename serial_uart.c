@@ -0,0 +1,304 @@
+/*
+  serial_uart.c - UART transport for the serial read and write buffers
+  Part of Grbl
+
+  Copyright (c) 2009-2011 Simen Svale Skogsrud
+  Copyright (c) 2011-2012 Sungeun K. Jeon
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* This code was initially inspired by the wiring_serial module by David A. Mellis which
+   used to be a part of the Arduino project. */
+
+#include "config.h"
+#ifndef SERIAL_USB_CDC // Otherwise serial_usb.c is the transport
+
+#if defined( PART_LM4F120H5QR ) // code for ARM
+  #include "inc/hw_memmap.h"
+  #include "inc/hw_types.h"
+  #include "driverlib/sysctl.h"
+  #include "driverlib/uart.h"
+  #include "driverlib/interrupt.h"
+  #include "driverlib/pin_map.h"
+  #include "driverlib/gpio.h"
+  #include "inc/hw_ints.h"
+#else // code for AVR
+  #include <avr/interrupt.h>
+#endif
+
+#include "serial.h"
+#include "profile.h"
+
+#ifdef PART_LM4F120H5QR
+  // Serial port selected in config.h
+  #if SERIAL_UART == 1
+    #define SERIAL_UART_BASE     UART1_BASE
+    #define SERIAL_UART_INT      INT_UART1
+    #define SERIAL_UART_PERIPH   SYSCTL_PERIPH_UART1
+    #define SERIAL_GPIO_PERIPH   SYSCTL_PERIPH_GPIOB
+    #define SERIAL_GPIO_PORT     GPIO_PORTB_BASE
+    #define SERIAL_RX_PIN_CONFIG GPIO_PB0_U1RX
+    #define SERIAL_TX_PIN_CONFIG GPIO_PB1_U1TX
+  #else
+    #define SERIAL_UART_BASE     UART0_BASE
+    #define SERIAL_UART_INT      INT_UART0
+    #define SERIAL_UART_PERIPH   SYSCTL_PERIPH_UART0
+    #define SERIAL_GPIO_PERIPH   SYSCTL_PERIPH_GPIOA
+    #define SERIAL_GPIO_PORT     GPIO_PORTA_BASE
+    #define SERIAL_RX_PIN_CONFIG GPIO_PA0_U0RX
+    #define SERIAL_TX_PIN_CONFIG GPIO_PA1_U0TX
+    #ifdef ENABLE_RTSCTS
+      #error "ENABLE_RTSCTS requires SERIAL_UART 1. UART0 has no handshake lines."
+    #endif
+  #endif
+#endif
+
+#ifdef ENABLE_XONXOFF
+  volatile uint8_t flow_ctrl = XON_SENT; // Flow control state variable
+#endif
+
+#ifdef PART_LM4F120H5QR
+//ARM code
+void arm_uart_send_data( void );
+void arm_uart_transmit( void );
+
+// True while a flow control character waits to go out ahead of the transmit buffer.
+#ifdef ENABLE_XONXOFF
+  #define flow_char_pending() (flow_ctrl == SEND_XOFF || flow_ctrl == SEND_XON)
+#else
+  #define flow_char_pending() false
+#endif
+
+void arm_uart_interrupt_handler( void ) {
+  PROFILE_START(profile_entry);
+  //clear interrupt flag
+  unsigned long ul = UARTIntStatus( SERIAL_UART_BASE, true );
+  UARTIntClear( SERIAL_UART_BASE, ul );
+
+  //receive chars if any. Drain the whole hardware FIFO in one go.
+  while ( UARTCharsAvail( SERIAL_UART_BASE ) ) {
+    serial_receive( (uint8_t)( UARTCharGetNonBlocking( SERIAL_UART_BASE ) & 0xFF ) ); //read a char and remove control bits (highest)
+  }
+
+  arm_uart_transmit();
+  PROFILE_END(profile_entry, PROFILE_SERIAL);
+}
+
+// Moves characters from tx_buffer into the UART FIFO. Kept apart from the receive path so that
+// an echo from inside the receive interrupt never re-enters it.
+void arm_uart_transmit( void ) {
+  //transmit characters if possible
+  while ( UARTSpaceAvail( SERIAL_UART_BASE ) && (flow_char_pending() || serial_tx_pending()) ) arm_uart_send_data();
+
+  //if nothing to transmit, then switch off transmit interrupt, otherwise enable TX interrupt
+  if ( !UARTBusy( SERIAL_UART_BASE ) && !serial_tx_pending() && !flow_char_pending() ) {
+    UARTIntDisable( SERIAL_UART_BASE, UART_INT_TX );
+  } else {
+    UARTIntEnable( SERIAL_UART_BASE, UART_INT_TX );
+  }
+}
+#endif
+
+void transport_init()
+{
+#ifdef PART_LM4F120H5QR
+  //code for ARM
+  SysCtlPeripheralEnable( SERIAL_GPIO_PERIPH ); //enable pins which correspond to RxD and TxD signals
+  SysCtlDelay( 26 ); // Delay 1usec for peripherial to start
+  GPIOPinConfigure( SERIAL_RX_PIN_CONFIG ); //configure pin to be RxD of the UART
+  GPIOPinConfigure( SERIAL_TX_PIN_CONFIG ); //configure pin to be TxD of the UART
+  GPIOPinTypeUART( SERIAL_GPIO_PORT, GPIO_PIN_0 | GPIO_PIN_1 ); //configure pins 0 and 1 of the port to be RxD and TxD
+
+  #ifdef ENABLE_RTSCTS
+    // RTS follows the read buffer level rather than the 16 byte hardware FIFO, so it is driven
+    // by software from a plain output. Active low: asserted (low) while Grbl accepts data.
+    SysCtlPeripheralEnable( RTS_PERIPH );
+    SysCtlDelay( 26 ); // Delay 1usec for peripherial to start
+    GPIOPinTypeGPIOOutput( RTS_PORT, 1 << RTS_BIT );
+    GPIOPinWrite( RTS_PORT, 1 << RTS_BIT, 0 );
+
+    // CTS gates the transmitter in hardware, so a stopped host never overruns its own buffer.
+    SysCtlPeripheralEnable( CTS_PERIPH );
+    SysCtlDelay( 26 ); // Delay 1usec for peripherial to start
+    GPIOPinConfigure( CTS_PIN_CONFIG );
+    GPIOPinTypeUART( CTS_PORT, 1 << CTS_BIT );
+  #endif
+
+  SysCtlPeripheralEnable( SERIAL_UART_PERIPH ); // Enable the UART peripheral for use.
+  SysCtlDelay( 26 ); // Delay 1usec for peripherial to start
+  UARTConfigSetExpClk( SERIAL_UART_BASE, SysCtlClockGet(), BAUD_RATE, UART_CONFIG_WLEN_8 | UART_CONFIG_PAR_NONE | UART_CONFIG_STOP_ONE ); //8-N-1
+  #ifdef ENABLE_RTSCTS
+    UARTFlowControlSet( SERIAL_UART_BASE, UART_FLOWCONTROL_TX );
+  #endif
+
+  // Interrupt if TX FIFO is almost empty or the RX FIFO is half full. The receive timeout
+  // interrupt picks up anything less than that once the line goes quiet for 32 bit periods.
+  UARTFIFOLevelSet( SERIAL_UART_BASE, UART_FIFO_TX1_8, UART_FIFO_RX4_8 );
+  UARTIntDisable( SERIAL_UART_BASE, 0xFFFFFFFF ); // Disable all interrupt sources for the UART module
+  UARTIntEnable( SERIAL_UART_BASE, UART_INT_RX | UART_INT_RT ); //Enable only receive interrupts
+  UARTIntRegister( SERIAL_UART_BASE, arm_uart_interrupt_handler );
+  IntPrioritySet( SERIAL_UART_INT, 64 ); // lowest priority for UART interrupts
+  IntEnable( SERIAL_UART_INT ); //Enable UART interrupts in the NVIC
+  UARTEnable( SERIAL_UART_BASE ); //Enable the UART to work
+
+#else
+  //code for AVR
+  // Set baud rate
+  #if BAUD_RATE < 57600
+    uint16_t UBRR0_value = ((F_CPU / (8L * BAUD_RATE)) - 1)/2 ;
+    UCSR0A &= ~(1 << U2X0); // baud doubler off  - Only needed on Uno XX
+  #else
+    uint16_t UBRR0_value = ((F_CPU / (4L * BAUD_RATE)) - 1)/2;
+    UCSR0A |= (1 << U2X0);  // baud doubler on for high baud rates, i.e. 115200
+  #endif
+  UBRR0H = UBRR0_value >> 8;
+  UBRR0L = UBRR0_value;
+
+  // enable rx and tx
+  UCSR0B |= 1<<RXEN0;
+  UCSR0B |= 1<<TXEN0;
+
+  // enable interrupt on complete reception of a byte
+  UCSR0B |= 1<<RXCIE0;
+
+  // defaults to 8-bit, no parity, 1 stop bit
+
+#endif //for ARM
+
+}
+
+void transport_start_tx()
+{
+#ifdef PART_LM4F120H5QR // code for ARM
+  arm_uart_transmit();
+#else // code for AVR
+  // Enable Data Register Empty Interrupt to make sure tx-streaming is running
+  UCSR0B |=  (1 << UDRIE0);
+#endif
+}
+
+void transport_stop_rx()
+{
+  #ifdef ENABLE_XONXOFF
+    if (flow_ctrl == XON_SENT) {
+      flow_ctrl = SEND_XOFF;
+      #ifndef PART_LM4F120H5QR // ARM sends it when the interrupt handler calls arm_uart_transmit()
+        UCSR0B |=  (1 << UDRIE0); // Force TX
+      #endif
+    }
+  #endif
+  #ifdef ENABLE_RTSCTS
+    GPIOPinWrite( RTS_PORT, 1 << RTS_BIT, 1 << RTS_BIT ); // Deassert RTS
+  #endif
+}
+
+void transport_resume_rx()
+{
+  #ifdef ENABLE_XONXOFF
+    if (flow_ctrl == XOFF_SENT) {
+      flow_ctrl = SEND_XON;
+      transport_start_tx(); // Force TX
+    } else if (flow_ctrl == SEND_XOFF) {
+      flow_ctrl = XON_SENT; // Drained before the XOFF got out. Drop it.
+    }
+  #endif
+  #ifdef ENABLE_RTSCTS
+    GPIOPinWrite( RTS_PORT, 1 << RTS_BIT, 0 ); // Assert RTS
+  #endif
+}
+
+void transport_lock()
+{
+#ifdef PART_LM4F120H5QR
+  IntDisable( SERIAL_UART_INT );
+#else
+  cli();
+#endif
+}
+
+void transport_unlock()
+{
+#ifdef PART_LM4F120H5QR
+  IntEnable( SERIAL_UART_INT );
+#else
+  sei();
+#endif
+}
+
+// Data Register Empty Interrupt handler
+#if defined( PART_LM4F120H5QR )
+  void arm_uart_send_data( void )
+#elif defined( __AVR_ATmega644P__ )
+  ISR(USART0_UDRE_vect)
+#else
+  ISR(USART_UDRE_vect)
+#endif
+{
+  #ifdef ENABLE_XONXOFF
+    // Flow control characters jump the queue
+    if (flow_ctrl == SEND_XOFF) {
+      #ifdef PART_LM4F120H5QR
+        UARTCharPutNonBlocking( SERIAL_UART_BASE, XOFF_CHAR );
+      #else
+        UDR0 = XOFF_CHAR;
+      #endif
+      flow_ctrl = XOFF_SENT;
+      return;
+    } else if (flow_ctrl == SEND_XON) {
+      #ifdef PART_LM4F120H5QR
+        UARTCharPutNonBlocking( SERIAL_UART_BASE, XON_CHAR );
+      #else
+        UDR0 = XON_CHAR;
+      #endif
+      flow_ctrl = XON_SENT;
+      return;
+    }
+  #endif
+
+  uint8_t data;
+  if ( !serial_tx_get(&data) ) {
+    #ifdef PART_LM4F120H5QR
+      UARTIntDisable( SERIAL_UART_BASE, UART_INT_TX );
+    #else
+      // AVR code
+      // Turn off Data Register Empty Interrupt to stop tx-streaming if this concludes the transfer
+      UCSR0B &= ~(1 << UDRIE0);
+    #endif
+    return;
+  }
+
+  // Send a byte from the buffer
+  #if defined( PART_LM4F120H5QR )
+    // ARM code
+    UARTCharPutNonBlocking( SERIAL_UART_BASE, data );
+  #else
+    // AVR code
+    UDR0 = data;
+  #endif
+}
+
+#ifndef PART_LM4F120H5QR
+// UART Receive Interrupt handler
+#if defined( __AVR_ATmega644P__ )
+ISR(USART0_RX_vect)
+#else
+ISR(USART_RX_vect)
+#endif
+{
+  serial_receive(UDR0);
+}
+#endif
+
+#endif // SERIAL_USB_CDC
@@ -0,0 +1,165 @@
+/*
+  serial_usb.c - USB CDC transport for the serial read and write buffers
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Presents Grbl as a USB CDC virtual serial port on the device USB connector of the LaunchPad
+   (PD4/PD5), using the StellarisWare USB library. There is no baud rate: bulk packets move at
+   USB full speed, and the host is held off by simply not taking its next packet from the
+   controller while the read buffer is above RX_BUFFER_FULL. Bytes are handed to serial_receive()
+   from the USB interrupt, so the runtime commands are picked off as soon as a packet arrives. */
+
+#include "config.h"
+#ifdef SERIAL_USB_CDC
+
+#include "inc/hw_memmap.h"
+#include "inc/hw_types.h"
+#include "inc/hw_ints.h"
+#include "driverlib/sysctl.h"
+#include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
+#include "driverlib/usb.h"
+#include "usblib/usblib.h"
+#include "usblib/usbcdc.h"
+#include "usblib/usb-ids.h"
+#include "usblib/device/usbdevice.h"
+#include "usblib/device/usbdcdc.h"
+
+#include "serial.h"
+
+#define USB_PACKET_SIZE 64 // Full speed bulk endpoint size
+
+// The read buffer must take the rest of a packet after reaching RX_BUFFER_FULL.
+#if RX_BUFFER_SIZE/4 < USB_PACKET_SIZE+1
+  #error "SERIAL_USB_CDC requires an RX_BUFFER_SIZE of at least 260 bytes."
+#endif
+
+static volatile uint8_t usb_connected; // True once the host has configured the device
+static volatile uint8_t usb_rx_stopped; // True while packets are left with the controller
+
+// Line coding is meaningless on USB, but terminal programs set and read it back.
+static tLineCoding usb_line_coding = { BAUD_RATE, USB_CDC_STOP_BITS_1, USB_CDC_PARITY_NONE, 8 };
+
+// String descriptors: language, manufacturer, product, serial number, control interface and
+// configuration, in UTF-16LE.
+static const unsigned char usb_lang_descriptor[] = { 4, USB_DTYPE_STRING, USBShort(USB_LANG_EN_US) };
+static const unsigned char usb_manufacturer_string[] = { 2+2*4, USB_DTYPE_STRING, 'G',0, 'r',0, 'b',0, 'l',0 };
+static const unsigned char usb_product_string[] = { 2+2*8, USB_DTYPE_STRING,
+  'G',0, 'r',0, 'b',0, 'l',0, ' ',0, 'C',0, 'N',0, 'C',0 };
+static const unsigned char usb_serial_number_string[] = { 2+2*1, USB_DTYPE_STRING, '1',0 };
+static const unsigned char usb_interface_string[] = { 2+2*3, USB_DTYPE_STRING, 'A',0, 'C',0, 'M',0 };
+static const unsigned char usb_config_string[] = { 2+2*4, USB_DTYPE_STRING, 'G',0, 'r',0, 'b',0, 'l',0 };
+static const unsigned char * const usb_string_descriptors[] = {
+  usb_lang_descriptor, usb_manufacturer_string, usb_product_string,
+  usb_serial_number_string, usb_interface_string, usb_config_string
+};
+
+static unsigned long usb_control_handler(void *pvCBData, unsigned long ulEvent, unsigned long ulMsgValue, void *pvMsgData);
+static unsigned long usb_rx_handler(void *pvCBData, unsigned long ulEvent, unsigned long ulMsgValue, void *pvMsgData);
+static unsigned long usb_tx_handler(void *pvCBData, unsigned long ulEvent, unsigned long ulMsgValue, void *pvMsgData);
+
+static tCDCSerInstance usb_cdc_instance;
+static tUSBDCDCDevice usb_cdc_device = {
+  USB_VID_STELLARIS, USB_PID_SERIAL, 0, USB_CONF_ATTR_SELF_PWR,
+  usb_control_handler, &usb_cdc_device,
+  usb_rx_handler, &usb_cdc_device,
+  usb_tx_handler, &usb_cdc_device,
+  usb_string_descriptors, sizeof(usb_string_descriptors)/sizeof(usb_string_descriptors[0]),
+  &usb_cdc_instance
+};
+
+// Hands whole packets from the controller to the read buffer until it asks to stop.
+static void usb_receive()
+{
+  unsigned char packet[USB_PACKET_SIZE];
+  unsigned long count, i;
+  while (!usb_rx_stopped && USBDCDCRxPacketAvailable(&usb_cdc_device)) {
+    count = USBDCDCPacketRead(&usb_cdc_device, packet, USB_PACKET_SIZE, true);
+    for (i=0; i<count; i++) { serial_receive(packet[i]); }
+  }
+}
+
+// Sends the transmit buffer a packet at a time, whenever the IN endpoint is free.
+static void usb_transmit()
+{
+  unsigned char packet[USB_PACKET_SIZE];
+  unsigned long count = 0;
+  if (!usb_connected) {
+    // Nobody is listening, like a UART without a cable. Drop the bytes so serial_write never waits.
+    while (serial_tx_get(&packet[0])) { }
+    return;
+  }
+  if (!USBDCDCTxPacketAvailable(&usb_cdc_device)) { return; } // Resumed on TX complete.
+  while (count < USB_PACKET_SIZE && serial_tx_get(&packet[count])) { count++; }
+  if (count) { USBDCDCPacketWrite(&usb_cdc_device, packet, count, true); }
+}
+
+static unsigned long usb_control_handler(void *pvCBData, unsigned long ulEvent, unsigned long ulMsgValue, void *pvMsgData)
+{
+  switch (ulEvent) {
+    case USB_EVENT_CONNECTED:
+      usb_connected = true;
+      break;
+    case USB_EVENT_DISCONNECTED: usb_connected = false; break;
+    case USBD_CDC_EVENT_GET_LINE_CODING: *(tLineCoding *)pvMsgData = usb_line_coding; break;
+    case USBD_CDC_EVENT_SET_LINE_CODING: usb_line_coding = *(tLineCoding *)pvMsgData; break;
+    default: break; // Control line state, breaks, suspend and resume need no action.
+  }
+  return(0);
+}
+
+static unsigned long usb_rx_handler(void *pvCBData, unsigned long ulEvent, unsigned long ulMsgValue, void *pvMsgData)
+{
+  if (ulEvent == USB_EVENT_RX_AVAILABLE) { usb_receive(); }
+  return(0); // Also for USB_EVENT_DATA_REMAINING. Nothing is held outside the read buffer.
+}
+
+static unsigned long usb_tx_handler(void *pvCBData, unsigned long ulEvent, unsigned long ulMsgValue, void *pvMsgData)
+{
+  if (ulEvent == USB_EVENT_TX_COMPLETE) { usb_transmit(); }
+  return(0);
+}
+
+void transport_init()
+{
+  // The device port has no VBUS or ID pin on the LM4F120, so force device mode.
+  SysCtlPeripheralEnable( SYSCTL_PERIPH_GPIOD );
+  SysCtlDelay( 26 ); // Delay 1usec for peripherial to start
+  GPIOPinTypeUSBAnalog( GPIO_PORTD_BASE, GPIO_PIN_4 | GPIO_PIN_5 ); // USB0DM and USB0DP
+  USBStackModeSet( 0, USB_MODE_FORCE_DEVICE, 0 );
+
+  usb_connected = false;
+  usb_rx_stopped = false;
+  IntRegister( INT_USB0, USB0DeviceIntHandler );
+  IntPrioritySet( INT_USB0, 64 ); // lowest priority, like the UART
+  USBDCDCInit( 0, &usb_cdc_device ); // Enables the USB interrupt
+}
+
+void transport_start_tx() { usb_transmit(); }
+
+void transport_stop_rx() { usb_rx_stopped = true; }
+
+void transport_resume_rx()
+{
+  usb_rx_stopped = false;
+  usb_receive(); // Take the packet left waiting, if any. No new receive event comes for it.
+}
+
+void transport_lock() { IntDisable( INT_USB0 ); }
+
+void transport_unlock() { IntEnable( INT_USB0 ); }
+
+#endif // SERIAL_USB_CDC
@@ -28,6 +28,7 @@
   #include <avr/io.h>
 #endif
 
+#include <stddef.h>
 #include "protocol.h"
 #include "report.h"
 #include "stepper.h"
@@ -93,6 +94,12 @@ void settings_reset(bool reset_all) {
     settings.mm_per_arc_segment = DEFAULT_MM_PER_ARC_SEGMENT;
     settings.invert_mask = DEFAULT_STEPPING_INVERT_MASK;
     settings.junction_deviation = DEFAULT_JUNCTION_DEVIATION;
+    settings.max_rate[X_AXIS] = DEFAULT_X_MAX_RATE;
+    settings.max_rate[Y_AXIS] = DEFAULT_Y_MAX_RATE;
+    settings.max_rate[Z_AXIS] = DEFAULT_Z_MAX_RATE;
+    settings.max_acceleration[X_AXIS] = DEFAULT_X_ACCELERATION;
+    settings.max_acceleration[Y_AXIS] = DEFAULT_Y_ACCELERATION;
+    settings.max_acceleration[Z_AXIS] = DEFAULT_Z_ACCELERATION;
   }
   // New settings since last version
   settings.flags = 0;
@@ -101,6 +108,7 @@ void settings_reset(bool reset_all) {
   if (DEFAULT_INVERT_ST_ENABLE) { settings.flags |= BITFLAG_INVERT_ST_ENABLE; }
   if (DEFAULT_HARD_LIMIT_ENABLE) { settings.flags |= BITFLAG_HARD_LIMIT_ENABLE; }
   if (DEFAULT_HOMING_ENABLE) { settings.flags |= BITFLAG_HOMING_ENABLE; }
+  if (DEFAULT_LASER_MODE) { settings.flags |= BITFLAG_LASER_MODE; }
   settings.homing_dir_mask = DEFAULT_HOMING_DIR_MASK;
   settings.homing_feed_rate = DEFAULT_HOMING_FEEDRATE;
   settings.homing_seek_rate = DEFAULT_HOMING_RAPID_FEEDRATE;
@@ -109,6 +117,10 @@ void settings_reset(bool reset_all) {
   settings.stepper_idle_lock_time = DEFAULT_STEPPER_IDLE_LOCK_TIME;
   settings.decimal_places = DEFAULT_DECIMAL_PLACES;
   settings.n_arc_correction = DEFAULT_N_ARC_CORRECTION;
+  settings.arc_tolerance = DEFAULT_ARC_TOLERANCE;
+  settings.jerk = DEFAULT_JERK;
+  settings.spindle_max_rpm = DEFAULT_SPINDLE_MAX_RPM;
+  settings.spindle_min_rpm = DEFAULT_SPINDLE_MIN_RPM;
   write_global_settings();
 }
 
@@ -167,6 +179,31 @@ uint8_t read_global_settings() {
     #else // code for AVR
       if (!(memcpy_from_eeprom_with_checksum((char*)&settings, EEPROM_ADDR_GLOBAL, sizeof(settings_t)))) return false;
     #endif
+  } else if (version >= 5 && version < SETTINGS_VERSION) {
+    // Migrate from settings versions 5 to 8. Each version added settings at the end, which start
+    // out at their defaults. The axes get the seek rate and acceleration they had until then.
+    unsigned long size = offsetof(settings_t, arc_tolerance); // Version 5
+    if (version == 6) { size = offsetof(settings_t, max_rate); }
+    if (version == 7) { size = offsetof(settings_t, jerk); }
+    if (version == 8) { size = offsetof(settings_t, spindle_max_rpm); }
+    #ifdef PART_LM4F120H5QR // code for ARM
+      if ( !EEPROMload( EEPROM_ADDR_GLOBAL, (unsigned long *) &settings, size ) ) return false;
+    #else // code for AVR
+      if (!(memcpy_from_eeprom_with_checksum((char*)&settings, EEPROM_ADDR_GLOBAL, size))) return false;
+    #endif
+    if (version < 6) { settings.arc_tolerance = DEFAULT_ARC_TOLERANCE; }
+    if (version < 7) {
+      uint8_t i;
+      for (i=0; i<N_AXIS; i++) {
+        settings.max_rate[i] = settings.default_seek_rate;
+        settings.max_acceleration[i] = settings.acceleration;
+      }
+    }
+    if (version < 8) { settings.jerk = DEFAULT_JERK; }
+    settings.spindle_max_rpm = DEFAULT_SPINDLE_MAX_RPM;
+    settings.spindle_min_rpm = DEFAULT_SPINDLE_MIN_RPM;
+    if (DEFAULT_LASER_MODE) { settings.flags |= BITFLAG_LASER_MODE; }
+    write_global_settings();
   } else return false;
 
   return true;
@@ -216,6 +253,30 @@ uint8_t settings_store_global_setting(int parameter, float value) {
     case 20: settings.homing_seek_rate = value; break;
     case 21: settings.homing_debounce_delay = round(value); break;
     case 22: settings.homing_pulloff = value; break;
+    case 23:
+      if (value < 0.0) { return(STATUS_SETTING_VALUE_NEG); }
+      settings.arc_tolerance = value; break;
+    case 24: case 25: case 26:
+      if (value <= 0.0) { return(STATUS_SETTING_VALUE_NEG); }
+      settings.max_rate[parameter-24] = value; break;
+    case 27: case 28: case 29:
+      if (value <= 0.0) { return(STATUS_SETTING_VALUE_NEG); }
+      settings.max_acceleration[parameter-27] = value*60*60; break; // Convert to mm/min^2 for grbl internal use.
+    case 30:
+      if (value < 0.0) { return(STATUS_SETTING_VALUE_NEG); }
+      settings.jerk = value*60*60*60; break; // Convert to mm/min^3 for grbl internal use.
+    case 31:
+      if (value <= 0.0) { return(STATUS_SETTING_VALUE_NEG); }
+      if (value < settings.spindle_min_rpm) { return(STATUS_SETTING_RPM_RANGE); }
+      settings.spindle_max_rpm = value; break;
+    case 32:
+      if (value < 0.0) { return(STATUS_SETTING_VALUE_NEG); }
+      if (value > settings.spindle_max_rpm) { return(STATUS_SETTING_RPM_RANGE); }
+      settings.spindle_min_rpm = value; break;
+    case 33:
+      if (value) { settings.flags |= BITFLAG_LASER_MODE; }
+      else { settings.flags &= ~BITFLAG_LASER_MODE; }
+      break;
     default:
       return(STATUS_INVALID_STATEMENT);
   }
@@ -254,12 +315,14 @@ void EEPROMsave( unsigned long addr, unsigned long * data, unsigned long size )
   EEPROMProgram( data, addr, size );
   addr += size;
 
+  // Sum 32-bit words, matching the 4 byte checksum stored after the data.
+  uint32_t *word = (uint32_t *) data;
   unsigned long checksum = 0;
 
   for( ; size > 0; size -= 4 ) {
     ///checksum = ( checksum << 1 ) || ( checksum >> 7 );
-    checksum += *data;
-    data++;
+    checksum = (uint32_t) (checksum + *word);
+    word++;
   }
 
   EEPROMProgram( &checksum, addr, 4 );
@@ -272,11 +335,12 @@ int EEPROMload( unsigned long addr, unsigned long * data, unsigned long size ) {
   unsigned long checksum2 = 0;
   EEPROMRead( &checksum2, addr + size, 4 );
 
+  uint32_t *word = (uint32_t *) data;
   unsigned long checksum = 0;
   for( ; size > 0; size -= 4 ) {
     ///checksum = (checksum << 1) || (checksum >> 7);
-    checksum += *data;
-    data++;
+    checksum = (uint32_t) (checksum + *word);
+    word++;
   }
 
   return checksum == checksum2;
@@ -29,7 +29,7 @@
 
 // Version of the EEPROM data. Will be used to migrate existing data from older versions of Grbl
 // when firmware is upgraded. Always stored in byte 0 of eeprom
-#define SETTINGS_VERSION 5
+#define SETTINGS_VERSION 9
 
 // Define bit flag masks for the boolean settings in settings.flag.
 #define BITFLAG_REPORT_INCHES      bit(0)
@@ -37,6 +37,7 @@
 #define BITFLAG_INVERT_ST_ENABLE   bit(2)
 #define BITFLAG_HARD_LIMIT_ENABLE  bit(3)
 #define BITFLAG_HOMING_ENABLE      bit(4)
+#define BITFLAG_LASER_MODE         bit(5)
 
 // Define EEPROM memory address location values for Grbl settings and parameters
 // NOTE: The Atmega328p has 1KB EEPROM. The upper half is reserved for parameters and
@@ -74,6 +75,12 @@ typedef struct {
   uint32_t stepper_idle_lock_time; // If max value 255, steppers do not disable.
   uint32_t decimal_places;
   uint32_t n_arc_correction;
+  float arc_tolerance; // Chord tolerance of arc segments in mm. Zero uses mm_per_arc_segment.
+  float max_rate[3]; // Maximum rate of each axis in mm/min
+  float max_acceleration[3]; // Maximum acceleration of each axis in mm/min^2
+  float jerk; // Jerk of S-curve acceleration ramps in mm/min^3. Zero ramps linearly.
+  float spindle_max_rpm; // Spindle speed of a full PWM duty cycle
+  float spindle_min_rpm; // Lowest spindle speed the PWM output goes to while the spindle runs
 //  uint8_t status_report_mask; // Mask to indicate desired report data.
 } settings_t;
 extern settings_t settings;
@@ -0,0 +1,568 @@
+/*
+  bench.c - host microbenchmarks of the Grbl main program hot paths
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Times the g-code parser, the planner and the number formatting of the main program on the host,
+   linked against the same driver library stand-in as the simulator, but without its function call
+   instrumentation, so the figures are plain host CPU time. The simulated clock never advances and
+   no interrupt fires: nothing is stepped. The benchmark discards planner blocks itself whenever
+   the buffer fills, which takes a few nanoseconds, and empties it before a program pause or end,
+   which would otherwise wait for the motion to complete.
+
+   The g-code corpus is generated here: surfacing (long zig-zag passes), pocketing (short lines and
+   corner arcs, blended with G64), arc-heavy (bolt circles, helices and arc contours) and a laser
+   raster (many short lines with S words). Files given on the command line are added as further
+   corpora. Each benchmark repeats until it has run for the minimum time, and the fastest pass
+   counts, which filters out most of the noise of a busy host.
+
+   The results are printed as a table and, with -o, written as CSV with the columns benchmark,
+   corpus, calls, ns_per_call and calls_per_second. -c compares against such a file from an
+   earlier run and exits with a failure if any benchmark got slower by more than -t percent. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "tivaware.h"
+#include "simulator.h"
+#include "config.h"
+#include "nuts_bolts.h"
+#include "settings.h"
+#include "planner.h"
+#include "gcode.h"
+#include "motion_control.h"
+#include "stepper.h"
+#include "protocol.h"
+#include "serial.h"
+#include "print.h"
+#include "report.h"
+
+// Host side of the simulator, as far as the driver library stand-in calls it. Output is counted
+// and dropped.
+static uint64_t bytes_sent;
+uint64_t sim_host_next_transfer() { return(SIM_NEVER); }
+uint8_t sim_input_low(unsigned long port) { return(0); }
+void sim_host_transfer() { }
+void sim_host_receive(uint8_t data) { bytes_sent++; }
+void sim_trace_port(unsigned long port, uint8_t previous, uint8_t current) { }
+void sim_trace_pwm(unsigned long port, uint8_t pin, float duty) { }
+void sim_trace_step_timer(uint8_t enabled) { }
+void sim_trace_isr(int irq, uint64_t deadline, uint64_t entry, uint64_t exit) { }
+void sim_trace_overrun(int irq) { }
+
+// Command line options
+static double min_seconds = 0.5;
+static double threshold = 10.0;
+static const char *output_name;
+static const char *baseline_name;
+
+
+// G-code corpus. Lines are kept as the protocol hands them to the parser: upper case, without
+// white space or comments.
+typedef struct {
+  const char *name;
+  char **lines;
+  int count;
+  int allocated;
+} corpus_t;
+
+#define MAX_CORPORA 16
+static corpus_t corpora[MAX_CORPORA];
+static int n_corpora;
+
+static void clean_line(char *line)
+{
+  char *out = line;
+  uint8_t comment = false;
+  for (; *line; line++) {
+    if (*line == '(') { comment = true; }
+    else if (*line == ')') { comment = false; }
+    else if (*line == ';') { break; }
+    else if (!comment && !isspace((unsigned char)*line)) { *out++ = toupper((unsigned char)*line); }
+  }
+  *out = 0;
+}
+
+static void corpus_add(corpus_t *c, const char *format, ...)
+{
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  clean_line(line);
+  if (!line[0] || line[0] == '%' || line[0] == '$') { return; }
+  if (strlen(line) >= LINE_BUFFER_SIZE) {
+    fprintf(stderr, "%s: line longer than the line buffer skipped: %s\n", c->name, line);
+    return;
+  }
+  if (c->count == c->allocated) {
+    c->allocated = c->allocated ? 2*c->allocated : 1024;
+    c->lines = realloc(c->lines, c->allocated*sizeof(char *));
+  }
+  c->lines[c->count++] = strdup(line);
+}
+
+static corpus_t *corpus_new(const char *name)
+{
+  if (n_corpora == MAX_CORPORA) { fprintf(stderr, "too many corpora\n"); exit(EXIT_FAILURE); }
+  corpus_t *c = &corpora[n_corpora++];
+  c->name = name;
+  return(c);
+}
+
+// Face milling a 150x100 mm stock in five depth passes with a 2 mm step-over
+static void make_surfacing()
+{
+  corpus_t *c = corpus_new("surfacing");
+  int pass, row;
+  corpus_add(c, "G21 G90 G94 G17 G61");
+  corpus_add(c, "G0 Z5");
+  for (pass = 1; pass <= 5; pass++) {
+    corpus_add(c, "G0 X0 Y0");
+    corpus_add(c, "G1 Z%.3f F300", -0.2*pass);
+    for (row = 0; row <= 50; row++) {
+      corpus_add(c, "G1 X%.3f Y%.3f F1500", (row & 1) ? 0.0 : 150.0, 2.0*row);
+      if (row < 50) { corpus_add(c, "G1 Y%.3f", 2.0*(row+1)); }
+    }
+    corpus_add(c, "G0 Z5");
+  }
+}
+
+// Rectangular pockets cleared by offset loops with rounded corners, blended with G64
+static void make_pocketing()
+{
+  corpus_t *c = corpus_new("pocketing");
+  int pocket, depth, loop;
+  corpus_add(c, "G21 G90 G94 G17 G64 P0.02");
+  for (pocket = 0; pocket < 4; pocket++) {
+    float cx = 40.0f*pocket, cy = 20.0f;
+    corpus_add(c, "G0 Z2");
+    for (depth = 1; depth <= 3; depth++) {
+      corpus_add(c, "G0 X%.3f Y%.3f", cx, cy);
+      corpus_add(c, "G1 Z%.3f F200", -1.0*depth);
+      for (loop = 1; loop <= 16; loop++) {
+        float w = 1.0f*loop, h = 0.6f*loop, r = 0.5f;
+        corpus_add(c, "G1 X%.3f Y%.3f F900", cx+w-r, cy-h);
+        corpus_add(c, "G3 X%.3f Y%.3f I0 J%.3f", cx+w, cy-h+r, r);
+        corpus_add(c, "G1 Y%.3f", cy+h-r);
+        corpus_add(c, "G3 X%.3f Y%.3f I%.3f J0", cx+w-r, cy+h, -r);
+        corpus_add(c, "G1 X%.3f", cx-w+r);
+        corpus_add(c, "G3 X%.3f Y%.3f I0 J%.3f", cx-w, cy+h-r, -r);
+        corpus_add(c, "G1 Y%.3f", cy-h+r);
+        corpus_add(c, "G3 X%.3f Y%.3f I%.3f J0", cx-w+r, cy-h, r);
+      }
+    }
+  }
+  corpus_add(c, "G0 Z5");
+}
+
+// Bolt circles, helical bores and a contour of alternating arcs
+static void make_arcs()
+{
+  corpus_t *c = corpus_new("arcs");
+  int hole, turn, k;
+  corpus_add(c, "G21 G90 G94 G17 G61");
+  for (hole = 0; hole < 24; hole++) {
+    float a = hole*2.0f*M_PI/24, x = 50+40*cosf(a), y = 50+40*sinf(a);
+    corpus_add(c, "G0 Z2");
+    corpus_add(c, "G0 X%.3f Y%.3f", x+3, y);
+    corpus_add(c, "G1 Z0 F300");
+    for (turn = 1; turn <= 4; turn++) {
+      corpus_add(c, "G2 X%.3f Y%.3f Z%.3f I-3 J0 F600", x+3, y, -0.5*turn);
+    }
+    corpus_add(c, "G2 X%.3f Y%.3f I-3 J0", x+3, y);
+  }
+  corpus_add(c, "G0 Z2");
+  corpus_add(c, "G0 X0 Y120");
+  corpus_add(c, "G1 Z-1 F300");
+  for (k = 0; k < 200; k++) {
+    corpus_add(c, "%s X%.3f Y120 I2 J0 F1200", (k & 1) ? "G3" : "G2", 4.0*(k+1));
+  }
+  corpus_add(c, "G0 Z5");
+}
+
+// Grayscale laser raster, 0.1 mm per pixel, with the power of each run of pixels in S
+static void make_raster()
+{
+  corpus_t *c = corpus_new("raster");
+  int row, px;
+  corpus_add(c, "G21 G90 G94 G61");
+  corpus_add(c, "M3 S0");
+  for (row = 0; row < 40; row++) {
+    float y = 0.1f*row;
+    int forward = !(row & 1);
+    corpus_add(c, "G0 X%.3f Y%.3f", forward ? 0.0 : 40.0, y);
+    for (px = 1; px <= 100; px++) {
+      float x = forward ? 0.4f*px : 40.0f-0.4f*px;
+      int power = (int)(500+400*sinf(0.15f*px)*cosf(0.2f*row));
+      corpus_add(c, "G1 X%.3f S%d F3000", x, power);
+    }
+  }
+}
+
+static void load_file(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) { perror(path); exit(EXIT_FAILURE); }
+  const char *name = strrchr(path, '/') ? strrchr(path, '/')+1 : path;
+  corpus_t *c = corpus_new(name);
+  char line[256];
+  while (fgets(line, sizeof(line), f)) { corpus_add(c, "%s", line); }
+  fclose(f);
+}
+
+
+// Firmware state
+
+// Clears the parser, the planner and the machine position, as a reset does.
+static void machine_reset()
+{
+  memset(sys.position, 0, sizeof(sys.position));
+  sys.state = STATE_IDLE;
+  sys.abort = false;
+  sys.execute = 0;
+  sys.auto_start = false;
+  sys.feed_override = 100;
+  sys.rapid_override = 100;
+  sys.spindle_override = 100;
+  plan_init();
+  mc_init();
+  gc_init();
+  st_reset();
+  sys_sync_current_position();
+}
+
+// Discards planner blocks as if the steppers had executed them: down to half the buffer, or all of
+// them including a line held back for blending.
+static void planner_drain(uint8_t all)
+{
+  if (all) { plan_flush_line(); }
+  while (plan_get_block_buffer_count() > (all ? 0 : BLOCK_BUFFER_SIZE/2)) { plan_discard_current_block(); }
+}
+
+// True for lines that wait for the buffered motion to complete: program pauses and ends (M0, M1,
+// M2, M30)
+static uint8_t line_synchronizes(const char *line)
+{
+  while ((line = strchr(line, 'M')) != NULL) {
+    int code = atoi(++line);
+    if (code <= 2 || code == 30) { return(true); }
+  }
+  return(false);
+}
+
+
+// Timing and results
+
+static double now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return(t.tv_sec + 1e-9*t.tv_nsec);
+}
+
+typedef struct {
+  char benchmark[40];
+  char corpus[40];
+  double calls;
+  double ns_per_call;
+} result_t;
+
+#define MAX_RESULTS 64
+static result_t results[MAX_RESULTS];
+static int n_results;
+
+static void add_result(const char *benchmark, const char *corpus, double calls, double seconds)
+{
+  if (n_results == MAX_RESULTS) { return; }
+  result_t *r = &results[n_results++];
+  snprintf(r->benchmark, sizeof(r->benchmark), "%s", benchmark);
+  snprintf(r->corpus, sizeof(r->corpus), "%s", corpus);
+  r->calls = calls;
+  r->ns_per_call = 1e9*seconds/calls;
+  printf("%-24s %-12s %9.0f calls %10.1f ns/call %12.0f /s\n", r->benchmark, r->corpus, calls,
+         r->ns_per_call, 1e9/r->ns_per_call);
+  fflush(stdout);
+}
+
+// Runs a pass function until it has taken min_seconds altogether, at least three times, and
+// returns the time of the fastest pass.
+static double best_pass(double (*pass)(void *), void *context)
+{
+  double best = 1e30, total = 0;
+  int passes = 0;
+  while (passes < 3 || total < min_seconds) {
+    double t = pass(context);
+    if (t < best) { best = t; }
+    total += t;
+    passes++;
+  }
+  return(best);
+}
+
+
+// Benchmarks
+
+static uint8_t check_mode; // Parse only, as with $C. No motion reaches the planner.
+static int errors;
+
+// One pass of a corpus through gc_execute_line(), as the protocol feeds it, arcs included
+static double gcode_pass(void *context)
+{
+  corpus_t *c = (corpus_t *)context;
+  char line[LINE_BUFFER_SIZE];
+  int i;
+  machine_reset();
+  if (check_mode) { sys.state = STATE_CHECK_MODE; }
+  errors = 0;
+  double start = now();
+  for (i = 0; i < c->count; i++) {
+    if (!check_mode && line_synchronizes(c->lines[i])) { planner_drain(true); }
+    else if (plan_check_full_buffer()) { planner_drain(false); }
+    strcpy(line, c->lines[i]);
+    if (gc_execute_line(line) != STATUS_OK) { errors++; }
+    while (mc_arc_continue()) { planner_drain(false); }
+  }
+  return(now()-start);
+}
+
+static void bench_gcode(corpus_t *c)
+{
+  check_mode = true;
+  add_result("gc_execute_line parse", c->name, c->count, best_pass(gcode_pass, c));
+  if (errors) { fprintf(stderr, "%s: %d lines with errors\n", c->name, errors); }
+  check_mode = false;
+  add_result("gc_execute_line", c->name, c->count, best_pass(gcode_pass, c));
+}
+
+// A spiral of 0.5 mm segments with a zig-zag of sharp corners on it, straight to the planner
+#define PLANNER_POINTS 4000
+static float planner_points[PLANNER_POINTS][2];
+
+static double planner_pass(void *context)
+{
+  float tolerance = *(float *)context;
+  int i;
+  machine_reset();
+  plan_set_blend_tolerance(tolerance);
+  double start = now();
+  for (i = 0; i < PLANNER_POINTS; i++) {
+    if (plan_check_full_buffer()) { planner_drain(false); }
+    plan_buffer_line(planner_points[i][0], planner_points[i][1], 0, 1500, 0);
+  }
+  return(now()-start);
+}
+
+static void bench_planner()
+{
+  int i;
+  float tolerance;
+  for (i = 0; i < PLANNER_POINTS; i++) {
+    float t = 0.02f*i, r = 5+0.08f*t*10, zig = (i & 1) ? 0.3f : -0.3f;
+    planner_points[i][0] = (r+zig)*cosf(t);
+    planner_points[i][1] = (r+zig)*sinf(t);
+  }
+  tolerance = 0;
+  add_result("plan_buffer_line G61", "spiral", PLANNER_POINTS, best_pass(planner_pass, &tolerance));
+  tolerance = 0.02f;
+  add_result("plan_buffer_line G64", "spiral", PLANNER_POINTS, best_pass(planner_pass, &tolerance));
+}
+
+// Replans a full buffer, as a feed override change does. Covers the whole planner_recalculate().
+#define REPLAN_CALLS 2000
+static double replan_pass(void *context)
+{
+  int i;
+  double start = now();
+  for (i = 0; i < REPLAN_CALLS; i++) {
+    sys.feed_override = (i & 1) ? 90 : 100;
+    plan_update_overrides();
+  }
+  return(now()-start);
+}
+
+static void bench_replan()
+{
+  int i = 0;
+  machine_reset();
+  while (!plan_check_full_buffer()) {
+    plan_buffer_line(planner_points[i][0], planner_points[i][1], 0, 1500, 0);
+    i++;
+  }
+  add_result("plan_update_overrides", "spiral", REPLAN_CALLS, best_pass(replan_pass, NULL));
+}
+
+// Every number of every corpus line, through read_float() as the parser reads them
+static double read_float_calls;
+static volatile float sink;
+
+static double read_float_pass(void *context)
+{
+  int k, i;
+  float value;
+  read_float_calls = 0;
+  double start = now();
+  for (k = 0; k < n_corpora; k++) {
+    for (i = 0; i < corpora[k].count; i++) {
+      char *line = corpora[k].lines[i];
+      uint8_t counter = 0;
+      while (line[counter]) {
+        counter++; // Letter
+        if (!read_float(line, &counter, &value)) { break; }
+        sink = value;
+        read_float_calls++;
+      }
+    }
+  }
+  return(now()-start);
+}
+
+// Numbers as the status and parameter reports print them
+#define FORMAT_VALUES 1000
+static float format_values[FORMAT_VALUES];
+
+static double print_float_pass(void *context)
+{
+  int i;
+  double start = now();
+  for (i = 0; i < FORMAT_VALUES; i++) { printFloat(format_values[i]); }
+  return(now()-start);
+}
+
+static double format_float_pass(void *context)
+{
+  char buffer[16];
+  int i;
+  double start = now();
+  for (i = 0; i < FORMAT_VALUES; i++) {
+    format_float(buffer, format_values[i]);
+    sink = buffer[0];
+  }
+  return(now()-start);
+}
+
+#define STATUS_CALLS 1000
+static double status_pass(void *context)
+{
+  int i;
+  double start = now();
+  for (i = 0; i < STATUS_CALLS; i++) { report_realtime_status(); }
+  return(now()-start);
+}
+
+static void bench_formatting()
+{
+  int i;
+  double seconds = best_pass(read_float_pass, NULL);
+  add_result("read_float", "all", read_float_calls, seconds);
+  for (i = 0; i < FORMAT_VALUES; i++) { format_values[i] = 300.0f*sinf(0.37f*i)*((i % 7)+1); }
+  add_result("printFloat", "mixed", FORMAT_VALUES, best_pass(print_float_pass, NULL));
+  add_result("format_float", "mixed", FORMAT_VALUES, best_pass(format_float_pass, NULL));
+  machine_reset();
+  sys.position[X_AXIS] = 123456;
+  sys.position[Y_AXIS] = -7890;
+  add_result("report_realtime_status", "-", STATUS_CALLS, best_pass(status_pass, NULL));
+}
+
+
+// Results files
+
+static void write_results()
+{
+  FILE *f = fopen(output_name, "w");
+  int i;
+  if (!f) { perror(output_name); exit(EXIT_FAILURE); }
+  fprintf(f, "benchmark,corpus,calls,ns_per_call,calls_per_second\n");
+  for (i = 0; i < n_results; i++) {
+    fprintf(f, "%s,%s,%.0f,%.2f,%.0f\n", results[i].benchmark, results[i].corpus, results[i].calls,
+            results[i].ns_per_call, 1e9/results[i].ns_per_call);
+  }
+  fclose(f);
+}
+
+// Prints the change against the baseline of every benchmark it has. Returns the number of
+// benchmarks slower than the threshold.
+static int compare_results()
+{
+  FILE *f = fopen(baseline_name, "r");
+  char line[256], benchmark[40], corpus[40];
+  double calls, ns;
+  int i, regressions = 0;
+  if (!f) { perror(baseline_name); exit(EXIT_FAILURE); }
+  printf("\nchange against %s:\n", baseline_name);
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "%39[^,],%39[^,],%lf,%lf", benchmark, corpus, &calls, &ns) != 4) { continue; }
+    for (i = 0; i < n_results; i++) {
+      if (strcmp(results[i].benchmark, benchmark) || strcmp(results[i].corpus, corpus)) { continue; }
+      double change = 100*(results[i].ns_per_call-ns)/ns;
+      uint8_t slower = change > threshold;
+      printf("%-24s %-12s %+7.1f%%%s\n", benchmark, corpus, change, slower ? "  REGRESSION" : "");
+      regressions += slower;
+    }
+  }
+  fclose(f);
+  return(regressions);
+}
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-s min_seconds] [-o results.csv] [-c baseline.csv] [-t percent] [file.nc ...]\n", name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+  int opt, k;
+  while ((opt = getopt(argc, argv, "s:o:c:t:")) != -1) {
+    switch (opt) {
+      case 's': min_seconds = atof(optarg); break;
+      case 'o': output_name = optarg; break;
+      case 'c': baseline_name = optarg; break;
+      case 't': threshold = atof(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+
+  make_surfacing();
+  make_pocketing();
+  make_arcs();
+  make_raster();
+  for (; optind < argc; optind++) { load_file(argv[optind]); }
+
+  // Bring up the firmware as main() does, short of its main loop
+  sim_hardware_init();
+  serial_init();
+  settings_init();
+  st_init();
+  memset(&sys, 0, sizeof(sys));
+  machine_reset();
+
+  for (k = 0; k < n_corpora; k++) { bench_gcode(&corpora[k]); }
+  bench_planner();
+  bench_replan();
+  bench_formatting();
+
+  if (output_name) { write_results(); }
+  if (baseline_name && compare_results()) { return(EXIT_FAILURE); }
+  return(EXIT_SUCCESS);
+}
@@ -0,0 +1,2 @@
+// driverlib/interrupt.h - host stand-in. Everything Grbl uses is declared in sim/tivaware.h.
+#include "../tivaware.h"
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+"""\
+Velocity and acceleration profile of a grbl_sim step trace
+
+Reads the step port trace written by grbl_sim and samples the path
+speed and its acceleration at a fixed interval. The step rate of
+each axis is taken from the time between its steps, so the curves
+show the ramps as the step generator executes them, segment by
+segment. Compare a run with $30=0 (linear ramps) against one with a
+jerk setting to see the S-curves.
+
+The result is written as columns of time (s), X, Y and Z speed,
+path speed (mm/s), path acceleration (mm/s^2) and spindle PWM duty
+(%), which in laser mode ($33=1) follows the path speed. With -p and
+matplotlib installed, the speed and acceleration are also plotted
+to an image file.
+
+Usage: profile.py trace.txt [-s steps_per_mm] [-i interval_ms] [-p plot.png]
+"""
+
+from __future__ import print_function
+import argparse
+import bisect
+import math
+import re
+
+parser = argparse.ArgumentParser(description='Velocity and acceleration profile of a grbl_sim step trace.')
+parser.add_argument('trace_file', type=argparse.FileType('r'),
+        help='step port trace of grbl_sim -o')
+parser.add_argument('-s','--steps-per-mm', type=float, nargs='+', default=[250.0],
+        help='steps/mm of all axes, or of X, Y and Z. Default 250')
+parser.add_argument('-i','--interval', type=float, default=1.0,
+        help='sampling interval in ms. Default 1')
+parser.add_argument('-w','--window', type=float, default=10.0,
+        help='time over which the acceleration is taken, in ms. Default 10')
+parser.add_argument('-p','--plot', default=None,
+        help='plot speed and acceleration to this image file (needs matplotlib)')
+args = parser.parse_args()
+steps_per_mm = (args.steps_per_mm*3)[:3] if len(args.steps_per_mm) == 1 else args.steps_per_mm
+
+# Rising edges of the step bits, in seconds
+f_cpu = 80000000.0
+step_bits = [1, 2, 3]
+steps = [[], [], []]
+pwm = [(0.0, 0.0)] # (time, duty) of each spindle PWM change
+for line in args.trace_file:
+    if line.startswith('#'):
+        m = re.search(r'(\d+) cycles per second', line)
+        if m: f_cpu = float(m.group(1))
+        m = re.search(r'step bits X=(\d+) Y=(\d+) Z=(\d+)', line)
+        if m: step_bits = [int(b) for b in m.groups()]
+        continue
+    fields = line.split()
+    if fields[1] == 'pwm':
+        pwm.append((int(fields[0])/f_cpu, float(fields[2])))
+        continue
+    cycle, bit, level = [int(v) for v in fields]
+    if level and bit in step_bits:
+        steps[step_bits.index(bit)].append(cycle/f_cpu)
+
+# Step rate of an axis at time t, from the interval between the steps around it. An axis that does
+# not step for longer than a tenth of a second is taken to stand still.
+def rate(times, t):
+    k = bisect.bisect_right(times, t)
+    if k == 0 or k == len(times): return 0.0
+    interval = times[k]-times[k-1]
+    return 0.0 if interval > 0.1 else 1.0/interval
+
+# Spindle PWM duty at time t
+pwm_times = [p[0] for p in pwm]
+def power(t):
+    return pwm[bisect.bisect_right(pwm_times, t)-1][1]
+
+start = min([s[0] for s in steps if s] or [0.0])
+end = max([s[-1] for s in steps if s] or [0.0])
+interval = args.interval/1000.0
+samples = []
+t = start
+while t <= end:
+    speeds = [rate(steps[i], t)/steps_per_mm[i] for i in range(3)]
+    samples.append((t, speeds, math.sqrt(sum(v*v for v in speeds))))
+    t += interval
+
+half = max(1, int(round(args.window/args.interval/2)))
+times, accelerations, speeds = [], [], []
+print('# time(s) x(mm/s) y(mm/s) z(mm/s) speed(mm/s) acceleration(mm/s^2) power(%)')
+for k, (t, axes, speed) in enumerate(samples):
+    a, b = max(0, k-half), min(len(samples)-1, k+half)
+    acceleration = (samples[b][2]-samples[a][2])/(samples[b][0]-samples[a][0]) if b > a else 0.0
+    print('%.4f %.3f %.3f %.3f %.3f %.1f %.1f' % (t, axes[0], axes[1], axes[2], speed, acceleration, 100.0*power(t)))
+    times.append(t); speeds.append(speed); accelerations.append(acceleration)
+
+if args.plot:
+    import matplotlib
+    matplotlib.use('Agg')
+    import matplotlib.pyplot as plt
+    fig, (top, bottom) = plt.subplots(2, 1, sharex=True)
+    top.plot(times, speeds)
+    top.set_ylabel('speed (mm/s)')
+    bottom.plot(times, accelerations)
+    bottom.set_ylabel('acceleration (mm/s^2)')
+    bottom.set_xlabel('time (s)')
+    fig.savefig(args.plot)
@@ -0,0 +1,535 @@
+/*
+  simulator.c - host-native simulation of the Grbl motion core
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Runs the unmodified Grbl sources on the host against the peripheral model in tivaware.c and
+   streams a g-code file into the simulated UART. Every firmware function entry costs a fixed
+   number of core cycles (-c), which is how the simulated clock advances and how interrupts get a
+   chance to fire. The result is a deterministic timeline of the step port, written as one line
+   per pin edge: "<cycle> <bit> <level>". A summary of step rates, pulse widths, buffer
+   starvation and interrupt timing is printed to stderr when the job completes.
+
+   The host behaves like a sender with hardware flow control: it only puts a byte on the wire
+   when Grbl's serial read buffer has room for it, so no input is ever dropped and the stream is
+   as fast as the baud rate and the firmware allow. Built with ENABLE_XONXOFF, the host instead
+   obeys the XOFF and XON characters Grbl sends, and filters them out of the response file.
+   Built with SERIAL_USB_CDC, the host streams USB packets instead and the baud rate is unused.
+
+   The input is read whole before the simulation starts. "-" reads it from a pipe on stdin. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "tivaware.h"
+#include "simulator.h"
+#include "config.h"
+#include "nuts_bolts.h"
+#include "settings.h"
+#include "planner.h"
+#include "protocol.h"
+#include "serial.h"
+
+int grbl_main(void); // main.c, renamed by the Makefile
+
+// Grbl's serial read buffer indices (serial.c), used for host flow control.
+extern volatile uint16_t rx_buffer_head;
+extern volatile uint16_t rx_buffer_tail;
+
+// Command line options
+static uint32_t baud_rate = 115200;
+static uint32_t cycles_per_call = 50;
+static double max_seconds = 3600;
+static double limit_distance; // Distance of the limit switches from the start in mm. Zero for none.
+static double max_acceleration; // Acceleration of any axis that fails the run in mm/s^2. Zero for none.
+static FILE *trace_file;
+static FILE *response_file;
+
+// Host side of the serial link
+static char *input;
+static size_t input_size;
+static size_t input_sent;
+static uint8_t host_started;
+static uint64_t host_start_cycle;
+static uint64_t host_next_cycle = SIM_NEVER; // Arrival of the byte currently on the wire
+static uint64_t wire_free_cycle;
+// Realtime bytes of -x, sent at their simulated time out of the stream, as a host sends them
+#define SIM_MAX_REALTIME 32
+static uint64_t realtime_cycle[SIM_MAX_REALTIME];
+static uint8_t realtime_byte[SIM_MAX_REALTIME];
+static uint8_t realtime_count;
+static uint8_t realtime_sent;
+static const char banner[] = "['$' for help]";
+static uint8_t banner_match;
+#ifdef ENABLE_XONXOFF
+  static uint8_t host_stopped; // XOFF received
+  static uint64_t xoff_count;
+#endif
+
+// Step port statistics
+typedef struct {
+  uint64_t count;
+  int64_t position; // Steps from the start
+  uint64_t last_step;
+  uint64_t min_interval;
+  uint64_t pulse_start;
+  uint64_t min_pulse;
+  uint64_t max_pulse;
+  // Acceleration, from the position interpolated between steps at every ACCEL_SAMPLE_CYCLES
+  uint64_t next_sample;
+  double sample[2];
+  uint8_t samples;
+  double max_acceleration; // (step/s^2)
+} sim_axis_t;
+
+// Four acceleration ticks. Short enough to show a rate jump between two step segments, long enough
+// to average out the step jitter of the slower axes of a multi-axis move.
+#define ACCEL_SAMPLE_CYCLES (4*F_CPU/ACCELERATION_TICKS_PER_SECOND)
+#define ACCEL_SAMPLE_RATE ((double)F_CPU/ACCEL_SAMPLE_CYCLES)
+
+static const uint8_t step_bit[N_AXIS] = { X_STEP_BIT, Y_STEP_BIT, Z_STEP_BIT };
+static const uint8_t direction_bit[N_AXIS] = { X_DIRECTION_BIT, Y_DIRECTION_BIT, Z_DIRECTION_BIT };
+static const uint8_t limit_bit[N_AXIS] = { X_LIMIT_BIT, Y_LIMIT_BIT, Z_LIMIT_BIT };
+static const char axis_name[N_AXIS] = { 'X', 'Y', 'Z' };
+static sim_axis_t axis[N_AXIS];
+static uint64_t first_step = SIM_NEVER;
+static uint64_t last_step;
+
+// Stepper timer and interrupt statistics
+static uint8_t step_timer_started;
+static uint64_t starve_count;
+static uint64_t starve_start = SIM_NEVER;
+static uint64_t starve_cycles;
+
+typedef struct {
+  uint64_t count;
+  uint64_t overruns;
+  uint64_t max_latency;
+  uint64_t max_duration;
+  uint64_t total_duration;
+} sim_isr_t;
+
+static sim_isr_t isr[NUM_INTERRUPTS];
+
+// Timer PWM outputs
+static uint64_t pwm_changes;
+static float pwm_max_duty;
+
+static uint8_t in_hook;
+
+
+static double cycles_to_us(uint64_t cycles) { return(cycles*1e6/F_CPU); }
+
+static uint16_t rx_buffer_count()
+{
+  uint16_t head = rx_buffer_head, tail = rx_buffer_tail;
+  if (head >= tail) { return(head-tail); }
+  return(RX_BUFFER_SIZE-(tail-head));
+}
+
+// True while Grbl still has unread input anywhere between the file and its line parser.
+static uint8_t input_pending()
+{
+#ifdef SERIAL_USB_CDC
+  return(input_sent < input_size || host_next_cycle != SIM_NEVER || sim_usb_rx_level() || rx_buffer_count());
+#else
+  return(input_sent < input_size || host_next_cycle != SIM_NEVER || sim_uart_rx_level() || rx_buffer_count());
+#endif
+}
+
+
+// The next realtime byte of -x goes ahead of the streamed input. It is delivered at its time, taking
+// no time on the wire, so the stream around it keeps its timing.
+static uint64_t realtime_next_transfer()
+{
+  if (realtime_sent < realtime_count && realtime_cycle[realtime_sent] < host_next_cycle) {
+    return(realtime_cycle[realtime_sent]);
+  }
+  return(host_next_cycle);
+}
+
+static uint8_t realtime_transfer()
+{
+  if (realtime_sent == realtime_count || realtime_cycle[realtime_sent] > sim_cycles ||
+      realtime_cycle[realtime_sent] >= host_next_cycle) {
+    return(false);
+  }
+#ifdef SERIAL_USB_CDC
+  sim_usb_receive(&realtime_byte[realtime_sent], 1);
+#else
+  sim_uart_receive(realtime_byte[realtime_sent]);
+#endif
+  realtime_sent++;
+  return(true);
+}
+
+
+#ifdef SERIAL_USB_CDC
+
+// Packets of up to 64 bytes go out at USB full speed (12 Mbit/s) with some 16 bytes of token,
+// handshake and bit stuffing overhead each, but only once the device has taken the last one.
+// That is the flow control of USB: the controller NAKs the host until then.
+static uint8_t packet_size;
+
+uint64_t sim_host_next_transfer()
+{
+  if (host_next_cycle == SIM_NEVER && host_started && input_sent < input_size && sim_usb_rx_free()) {
+    packet_size = (input_size-input_sent < 64) ? input_size-input_sent : 64;
+    uint64_t start = (wire_free_cycle > sim_cycles) ? wire_free_cycle : sim_cycles;
+    host_next_cycle = start + ((packet_size+16)*8ULL*F_CPU)/12000000;
+    wire_free_cycle = host_next_cycle;
+  }
+  return(realtime_next_transfer());
+}
+
+void sim_host_transfer()
+{
+  if (realtime_transfer()) { return; }
+  host_next_cycle = SIM_NEVER;
+  sim_usb_receive((uint8_t *)&input[input_sent], packet_size);
+  input_sent += packet_size;
+}
+
+#else
+
+uint64_t sim_host_next_transfer()
+{
+  if (host_next_cycle == SIM_NEVER && host_started && input_sent < input_size) {
+#ifdef ENABLE_XONXOFF
+    if (!host_stopped) {
+#else
+    // Everything already sent but not yet consumed by the parser must fit in the read buffer,
+    // which always keeps one slot free. One more is held back for a byte the receive interrupt
+    // may have taken from the FIFO but not yet stored when it gets preempted.
+    if (rx_buffer_count() + sim_uart_rx_level() < RX_BUFFER_SIZE-2) {
+#endif
+      uint64_t start = (wire_free_cycle > sim_cycles) ? wire_free_cycle : sim_cycles;
+      host_next_cycle = start + (10ULL*F_CPU)/baud_rate; // Start bit, 8 data bits, stop bit
+      wire_free_cycle = host_next_cycle;
+    }
+  }
+  return(realtime_next_transfer());
+}
+
+void sim_host_transfer()
+{
+  if (realtime_transfer()) { return; }
+  host_next_cycle = SIM_NEVER;
+  sim_uart_receive(input[input_sent++]);
+}
+
+#endif
+
+void sim_host_receive(uint8_t data)
+{
+#ifdef ENABLE_XONXOFF
+  if (data == XOFF_CHAR) { host_stopped = true; xoff_count++; return; }
+  if (data == XON_CHAR) { host_stopped = false; return; }
+#endif
+  if (response_file) { fputc(data, response_file); }
+  if (!host_started) {
+    // Start streaming once Grbl has printed its welcome message and is listening.
+    if (data == banner[banner_match]) {
+      if (banner[++banner_match] == 0) {
+        host_started = true;
+        host_start_cycle = sim_cycles;
+      }
+    } else {
+      banner_match = (data == banner[0]);
+    }
+  }
+}
+
+
+// Samples the position of the axis at the sample times up to the step it is taking now, interpolated
+// from its last step, and tracks the largest change of speed between samples. Speeds under four steps
+// per acceleration tick are left out, where the steps are too sparse to interpolate.
+static void sample_acceleration(sim_axis_t *a, int8_t direction)
+{
+  if (a->next_sample <= a->last_step) { a->next_sample = (a->last_step/ACCEL_SAMPLE_CYCLES+1)*ACCEL_SAMPLE_CYCLES; }
+  while (a->next_sample <= sim_cycles) {
+    double position = a->position + direction*(double)(a->next_sample-a->last_step)/(sim_cycles-a->last_step);
+    if (a->samples == 2) {
+      double speed0 = (a->sample[1]-a->sample[0])*ACCEL_SAMPLE_RATE;
+      double speed1 = (position-a->sample[1])*ACCEL_SAMPLE_RATE;
+      double slowest = 4*ACCELERATION_TICKS_PER_SECOND;
+      if (fabs(speed0) >= slowest && fabs(speed1) >= slowest) {
+        double acceleration = fabs(speed1-speed0)*ACCEL_SAMPLE_RATE;
+        if (acceleration > a->max_acceleration) { a->max_acceleration = acceleration; }
+      }
+    } else {
+      a->samples++;
+    }
+    a->sample[0] = a->sample[1];
+    a->sample[1] = position;
+    a->next_sample += ACCEL_SAMPLE_CYCLES;
+  }
+}
+
+void sim_trace_port(unsigned long port, uint8_t previous, uint8_t current)
+{
+  if (port != STEPPING_PORT) { return; }
+  uint8_t changed = (previous ^ current) & STEPPING_MASK;
+  uint8_t bit, i;
+  for (bit=0; bit<8; bit++) {
+    if (!(changed & (1<<bit))) { continue; }
+    uint8_t level = (current >> bit) & 1;
+    if (trace_file) { fprintf(trace_file, "%llu %u %u\n", (unsigned long long)sim_cycles, bit, level); }
+
+    for (i=0; i<N_AXIS; i++) {
+      if (bit != step_bit[i]) { continue; }
+      sim_axis_t *a = &axis[i];
+      uint8_t active = level ^ ((settings.invert_mask >> bit) & 1);
+      if (active) {
+        int8_t direction = ((current ^ settings.invert_mask) & (1<<direction_bit[i])) ? -1 : 1;
+        if (a->count) { sample_acceleration(a, direction); }
+        if (a->count && (a->min_interval == 0 || sim_cycles-a->last_step < a->min_interval)) {
+          a->min_interval = sim_cycles-a->last_step;
+        }
+        a->count++;
+        a->position += direction;
+        a->last_step = sim_cycles;
+        a->pulse_start = sim_cycles;
+        if (first_step == SIM_NEVER) { first_step = sim_cycles; }
+        last_step = sim_cycles;
+      } else if (a->count) {
+        uint64_t width = sim_cycles-a->pulse_start;
+        if (a->min_pulse == 0 || width < a->min_pulse) { a->min_pulse = width; }
+        if (width > a->max_pulse) { a->max_pulse = width; }
+      }
+    }
+  }
+}
+
+// Each axis has a limit switch limit_distance from its start, in the homing direction of the axis.
+// A switch pulls its pin low from there on.
+uint8_t sim_input_low(unsigned long port)
+{
+  uint8_t low = 0, i;
+  if (port != LIMIT_PORT || limit_distance <= 0) { return(0); }
+  for (i=0; i<N_AXIS; i++) {
+    double position = axis[i].position/settings.steps_per_mm[i];
+    if (settings.homing_dir_mask & (1<<direction_bit[i])) { position = -position; }
+    if (position >= limit_distance) { low |= (1<<limit_bit[i]); }
+  }
+  return(low);
+}
+
+// Timer PWM outputs go to the trace as "<cycle> pwm <duty>", which profile.py reads as power
+void sim_trace_pwm(unsigned long port, uint8_t pin, float duty)
+{
+  if (trace_file) { fprintf(trace_file, "%llu pwm %.4f\n", (unsigned long long)sim_cycles, duty); }
+  pwm_changes++;
+  if (duty > pwm_max_duty) { pwm_max_duty = duty; }
+}
+
+// The stepper driver interrupt is stopped whenever the planner runs dry. If that happens while
+// there is still input to be executed, the host or the parser did not keep up with the motion.
+void sim_trace_step_timer(uint8_t enabled)
+{
+  if (enabled) {
+    step_timer_started = true;
+    if (starve_start != SIM_NEVER) {
+      starve_cycles += sim_cycles-starve_start;
+      starve_start = SIM_NEVER;
+    }
+  } else if (step_timer_started && input_pending()) {
+    starve_count++;
+    starve_start = sim_cycles;
+  }
+}
+
+void sim_trace_isr(int irq, uint64_t deadline, uint64_t entry, uint64_t exit)
+{
+  sim_isr_t *s = &isr[irq];
+  s->count++;
+  if (entry-deadline > s->max_latency) { s->max_latency = entry-deadline; }
+  if (exit-entry > s->max_duration) { s->max_duration = exit-entry; }
+  s->total_duration += exit-entry;
+}
+
+void sim_trace_overrun(int irq)
+{
+  isr[irq].overruns++;
+}
+
+
+static void print_isr(const char *name, int irq)
+{
+  sim_isr_t *s = &isr[irq];
+  fprintf(stderr, "%-8s %10llu calls  latency max %8.2f us  duration mean %8.2f us max %8.2f us  overruns %llu\n",
+          name, (unsigned long long)s->count, cycles_to_us(s->max_latency),
+          s->count ? cycles_to_us(s->total_duration)/s->count : 0.0, cycles_to_us(s->max_duration),
+          (unsigned long long)s->overruns);
+}
+
+static void print_summary()
+{
+  uint8_t i;
+#ifdef SERIAL_USB_CDC
+  fprintf(stderr, "simulated %.6f s (%llu cycles at %lu Hz), %llu cycles per call, USB full speed\n",
+          (double)sim_cycles/F_CPU, (unsigned long long)sim_cycles, (unsigned long)F_CPU,
+          (unsigned long long)cycles_per_call);
+#else
+  fprintf(stderr, "simulated %.6f s (%llu cycles at %lu Hz), %llu cycles per call, %lu baud\n",
+          (double)sim_cycles/F_CPU, (unsigned long long)sim_cycles, (unsigned long)F_CPU,
+          (unsigned long long)cycles_per_call, (unsigned long)baud_rate);
+#endif
+  if (first_step != SIM_NEVER) {
+    fprintf(stderr, "motion   %.6f s from first to last step, streaming started at %.6f s\n",
+            (double)(last_step-first_step)/F_CPU, (double)host_start_cycle/F_CPU);
+  }
+  for (i=0; i<N_AXIS; i++) {
+    sim_axis_t *a = &axis[i];
+    fprintf(stderr, "%c steps  %10llu  max rate %9.1f Hz  pulse min %7.2f us max %7.2f us  accel max %7.1f mm/s^2\n",
+            axis_name[i], (unsigned long long)a->count,
+            a->min_interval ? (double)F_CPU/a->min_interval : 0.0,
+            cycles_to_us(a->min_pulse), cycles_to_us(a->max_pulse),
+            a->max_acceleration/settings.steps_per_mm[i]);
+  }
+  fprintf(stderr, "starved  %10llu times, %.6f s with input pending and the steppers idle\n",
+          (unsigned long long)starve_count, (double)starve_cycles/F_CPU);
+  if (pwm_changes) {
+    fprintf(stderr, "pwm      %10llu changes, max duty %.1f%%\n",
+            (unsigned long long)pwm_changes, 100.0*pwm_max_duty);
+  }
+  print_isr("timer1", INT_TIMER1A);
+  print_isr("timer2", INT_TIMER2A);
+#ifdef SERIAL_USB_CDC
+  print_isr("usb0", INT_USB0);
+  fprintf(stderr, "serial   read buffer high water %u of %u bytes",
+          (unsigned)serial_get_rx_buffer_high_water(), (unsigned)RX_BUFFER_SIZE);
+#else
+  print_isr("uart0", INT_UART0);
+  fprintf(stderr, "serial   read buffer high water %u of %u bytes, %llu FIFO overruns",
+          (unsigned)serial_get_rx_buffer_high_water(), (unsigned)RX_BUFFER_SIZE,
+          (unsigned long long)sim_uart_overruns());
+#endif
+#ifdef ENABLE_XONXOFF
+  fprintf(stderr, ", %llu XOFF", (unsigned long long)xoff_count);
+#endif
+  fprintf(stderr, "\n");
+}
+
+static void finish(int status)
+{
+  if (starve_start != SIM_NEVER) { starve_cycles += sim_cycles-starve_start; }
+  if (trace_file) { fflush(trace_file); }
+  if (response_file) { fflush(response_file); }
+  print_summary();
+  uint8_t i;
+  for (i=0; i<N_AXIS; i++) {
+    if (max_acceleration > 0 && axis[i].max_acceleration/settings.steps_per_mm[i] > max_acceleration) {
+      fprintf(stderr, "%c accelerated above %g mm/s^2\n", axis_name[i], max_acceleration);
+      status = EXIT_FAILURE;
+    }
+  }
+  exit(status);
+}
+
+
+// Called by every instrumented firmware function. Checks for the end of the job each time the
+// main loop polls the serial port, then charges the call to the simulated clock. The job also ends
+// in an alarm, such as a failed homing cycle, which locks out the rest of the input.
+void __cyg_profile_func_enter(void *this_fn, void *call_site)
+{
+  if (in_hook) { return; }
+  in_hook = true;
+  if (this_fn == (void *)protocol_process) {
+    if (host_started && !input_pending() && plan_get_current_block() == NULL &&
+        (sys.state == STATE_IDLE || sys.state == STATE_ALARM)) {
+      finish(EXIT_SUCCESS);
+    }
+  }
+  if (sim_cycles > max_seconds*F_CPU) {
+    fprintf(stderr, "time limit of %g s reached\n", max_seconds);
+    finish(EXIT_FAILURE);
+  }
+  in_hook = false;
+  sim_advance(cycles_per_call);
+}
+
+void __cyg_profile_func_exit(void *this_fn, void *call_site) { }
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-b baud] [-c cycles_per_call] [-t max_seconds] [-l limit_mm] [-a max_accel] [-x seconds:byte] [-o trace_file] [-r response_file] file.nc|-\n", name);
+  exit(EXIT_FAILURE);
+}
+
+static void read_input(const char *path)
+{
+  FILE *f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+  if (!f) { perror(path); exit(EXIT_FAILURE); }
+  size_t allocated = 4096;
+  input = malloc(allocated);
+  size_t n;
+  while ((n = fread(input+input_size, 1, allocated-input_size-1, f)) > 0) {
+    input_size += n;
+    if (allocated-input_size < 2) { input = realloc(input, allocated *= 2); }
+  }
+  if (f != stdin) { fclose(f); }
+  // The last line only executes once its end of line arrives.
+  if (input_size && input[input_size-1] != '\n' && input[input_size-1] != '\r') { input[input_size++] = '\n'; }
+}
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  trace_file = stdout;
+  char *end;
+  while ((opt = getopt(argc, argv, "b:c:t:l:a:x:o:r:")) != -1) {
+    switch (opt) {
+      case 'b': baud_rate = atol(optarg); break;
+      case 'c': cycles_per_call = atol(optarg); break;
+      case 't': max_seconds = atof(optarg); break;
+      case 'l': limit_distance = atof(optarg); break;
+      case 'a': max_acceleration = atof(optarg); break;
+      case 'x':
+        // A realtime byte at a simulated time, in order of time, e.g. -x 1.5:0x92
+        if (realtime_count == SIM_MAX_REALTIME) { usage(argv[0]); }
+        realtime_cycle[realtime_count] = strtod(optarg, &end)*F_CPU;
+        if (*end != ':' || (realtime_count && realtime_cycle[realtime_count] < realtime_cycle[realtime_count-1])) {
+          usage(argv[0]);
+        }
+        realtime_byte[realtime_count++] = strtol(end+1, NULL, 0);
+        break;
+      case 'o':
+        trace_file = fopen(optarg, "w");
+        if (!trace_file) { perror(optarg); exit(EXIT_FAILURE); }
+        break;
+      case 'r':
+        response_file = fopen(optarg, "w");
+        if (!response_file) { perror(optarg); exit(EXIT_FAILURE); }
+        break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc-1 || baud_rate == 0) { usage(argv[0]); }
+  read_input(argv[optind]);
+
+  fprintf(trace_file, "# Grbl step port trace: <cycle> <bit> <level>, %lu cycles per second\n", (unsigned long)F_CPU);
+  fprintf(trace_file, "# spindle PWM: <cycle> pwm <duty>\n");
+  fprintf(trace_file, "# step bits X=%d Y=%d Z=%d, direction bits X=%d Y=%d Z=%d\n",
+          X_STEP_BIT, Y_STEP_BIT, Z_STEP_BIT, X_DIRECTION_BIT, Y_DIRECTION_BIT, Z_DIRECTION_BIT);
+
+  sim_hardware_init();
+  grbl_main();
+  return(EXIT_FAILURE); // Never reached. The firmware main loop does not return.
+}
@@ -0,0 +1,68 @@
+/*
+  simulator.h - host-native simulation of the Grbl motion core
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef simulator_h
+#define simulator_h
+
+#include <stdint.h>
+
+#define SIM_NEVER UINT64_MAX
+
+// Simulated CPU clock, in core cycles (F_CPU) since power up.
+extern uint64_t sim_cycles;
+
+// Runs the simulated clock forward, firing any timer or UART interrupts that come due on the
+// way. Called for every firmware function entry and by SysCtlDelay(). (tivaware.c)
+void sim_advance(uint64_t cycles);
+
+// Delivers one byte from the host into the UART0 receive FIFO. (tivaware.c)
+void sim_uart_receive(uint8_t data);
+
+// Number of bytes waiting in the UART0 receive FIFO. (tivaware.c)
+uint8_t sim_uart_rx_level();
+
+// Number of bytes lost to UART0 receive FIFO overruns. (tivaware.c)
+uint64_t sim_uart_overruns();
+
+// USB CDC link: true while the OUT endpoint can take the next packet from the host, bytes of the
+// current packet not yet read by the firmware, and delivery of a packet of up to 64 bytes.
+// (tivaware.c)
+uint8_t sim_usb_rx_free();
+uint8_t sim_usb_rx_level();
+void sim_usb_receive(const uint8_t *data, uint8_t count);
+
+// Initializes the simulated peripherals to their power up state. (tivaware.c)
+void sim_hardware_init();
+
+// Host side of the serial link. The simulated machine calls back into these. (simulator.c)
+uint64_t sim_host_next_transfer();     // Cycle at which the host's next byte or USB packet arrives.
+void sim_host_transfer();              // Put it into the UART or the USB controller.
+void sim_host_receive(uint8_t data);   // Byte transmitted by Grbl.
+
+// Input pins of a port that the simulated machine pulls low: the limit switches. (simulator.c)
+uint8_t sim_input_low(unsigned long port);
+
+// Step port edge and stepper timer bookkeeping for the trace, and the duty cycle of a timer PWM
+// output whenever it changes. (simulator.c)
+void sim_trace_port(unsigned long port, uint8_t previous, uint8_t current);
+void sim_trace_pwm(unsigned long port, uint8_t pin, float duty);
+void sim_trace_step_timer(uint8_t enabled);
+void sim_trace_isr(int irq, uint64_t deadline, uint64_t entry, uint64_t exit);
+void sim_trace_overrun(int irq);
+
+#endif
@@ -0,0 +1,59 @@
+(G64 corners fill the planner buffer with fillet chords, then modal-only lines buffer the held line)
+(expect X 49000 Y 50000 Z 0)
+G21G90G64P0.1F3000
+G1X2
+G1Y4
+G1X6
+G1Y8
+G1X10
+G1Y12
+G1X14
+G1Y16
+G1X18
+G1Y20
+G1X22
+G1Y24
+G1X26
+G1Y28
+G1X30
+G1Y32
+G1X34
+G1Y36
+G1X38
+G1Y40
+G1X42
+G1Y44
+G1X46
+G1Y48
+G1X50
+G1Y52
+G1X54
+G1Y56
+G1X58
+G1Y60
+S200
+G1X62
+G1Y64
+G1X66
+G1Y68
+G1X70
+G1Y72
+G1X74
+G1Y76
+G1X78
+G1Y80
+G61
+G64G1X82
+G1Y84
+G64G1X86
+G1Y88
+G64G1X90
+G1Y92
+G64G1X94
+G1Y96
+G64G1X98
+G1Y100
+M8
+M5
+G1X0Y0
+M9
@@ -0,0 +1,7 @@
+(The feed override drops to 50% at the end of the cruise of a fast block, lowering the junction speed to)
+(the short block after it below what the fast block can slow down to in the steps it has left. Both)
+(blocks must keep to the acceleration instead of jumping to the new plan.)
+(sim -a 11 -x 1.6:0x92 -x 1.6:0x92 -x 1.6:0x92 -x 1.6:0x92 -x 1.6:0x92)
+(expect X 3000 Y 0 Z 0)
+G21G90G1F500X10
+X12
@@ -0,0 +1,780 @@
+/*
+  tivaware.c - host stand-in for the StellarisWare driver library used by Grbl
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The peripherals are modeled only as far as Grbl depends on them: GPIO ports keep their output
+   latch, general purpose timers count core cycles and raise their timeout interrupt, UART0 has a
+   16 byte receive FIFO fed by the host at the line rate, and the EEPROM is a 2 KB array. Time
+   only moves when the firmware calls a function (see simulator.c) or SysCtlDelay(). Interrupts
+   are dispatched by priority like the NVIC, so Timer2 preempts Timer1 and both preempt the UART.
+   UART transmission is instantaneous. The uDMA serves timer requests in scatter-gather mode, taking
+   no time, and decodes the GPIO data and timer load registers as destinations. A timer in PWM mode
+   raises no events; the pins muxed to it report its duty cycle whenever it changes. */
+
+#include <string.h>
+#include <stddef.h>
+#include "tivaware.h"
+#include "simulator.h"
+#include "config.h"
+#include "nuts_bolts.h"
+
+uint64_t sim_cycles;
+
+// Nested vectored interrupt controller
+typedef struct {
+  void (*handler)(void);
+  uint8_t enabled;
+  uint8_t pending;
+  uint8_t priority;
+  uint64_t raised;   // Cycle at which the pending request was raised
+} sim_irq_t;
+
+static sim_irq_t nvic[NUM_INTERRUPTS];
+static uint8_t master_enable;
+static uint16_t active_priority = 0x100; // Thread mode. Lower than any interrupt priority.
+
+// Core debug registers of the DWT cycle counter
+#define DEMCR_ADDRESS      0xE000EDFC
+#define DEMCR_TRCENA       0x01000000
+#define DWT_CTRL_ADDRESS   0xE0001000
+#define DWT_CTRL_CYCCNTENA 0x00000001
+#define DWT_CYCCNT_ADDRESS 0xE0001004
+static volatile unsigned long demcr, dwt_ctrl, dwt_cyccnt, unmodeled_register;
+static uint64_t dwt_updated; // Cycle up to which dwt_cyccnt has counted
+
+// General purpose timers. Only subtimer A is modeled.
+typedef struct {
+  unsigned long base;
+  uint8_t irq;
+  uint8_t periodic;
+  uint8_t count_up;
+  uint8_t running;
+  uint8_t int_enabled;
+  unsigned long load;
+  uint64_t deadline;   // Cycle of the next timeout, while running
+  uint64_t remaining;  // Cycles left when disabled. The counter keeps its value across a stop.
+  uint8_t dma_channel; // uDMA channel plus one the timeouts request. Zero if not assigned.
+  uint8_t pwm;         // PWM mode. High from the reload down to the match value.
+  unsigned long match;
+} sim_timer_t;
+
+#define SIM_N_TIMER 6
+static sim_timer_t gptm[SIM_N_TIMER] = {
+  { TIMER0_BASE, INT_TIMER0A }, { TIMER1_BASE, INT_TIMER1A }, { TIMER2_BASE, INT_TIMER2A },
+  { TIMER3_BASE, INT_TIMER3A }, { TIMER4_BASE, INT_TIMER4A }, { TIMER5_BASE, INT_TIMER5A }
+};
+
+// UART0. Only the receive FIFO is modeled.
+#define SIM_UART_FIFO_SIZE 16
+typedef struct {
+  uint8_t rx_fifo[SIM_UART_FIFO_SIZE];
+  uint8_t rx_head;
+  uint8_t rx_count;
+  unsigned long int_mask;
+  uint64_t overruns;
+} sim_uart_t;
+
+static sim_uart_t uart0;
+
+// USB device controller under the CDC serial class driver. The host configures the device right
+// away. One bulk OUT packet is held until the firmware reads it, and an IN packet completes at
+// once. Events are delivered through the USB interrupt.
+#define SIM_USB_PACKET_SIZE 64
+typedef struct {
+  const tUSBDCDCDevice *device;
+  uint8_t connected;
+  uint8_t connect_event;
+  uint8_t rx_packet[SIM_USB_PACKET_SIZE];
+  uint8_t rx_count;    // Bytes in the OUT packet, zero if the endpoint is free
+  uint8_t rx_read;
+  uint8_t rx_event;
+  uint8_t tx_busy;
+  uint8_t tx_event;
+} sim_usb_t;
+
+static sim_usb_t usb0;
+
+// GPIO output latches and EEPROM contents
+#define SIM_N_PORT 6
+static uint8_t gpio_data[SIM_N_PORT];
+static uint8_t gpio_input_mask[SIM_N_PORT];
+static uint8_t gpio_timer_mask[SIM_N_PORT];
+
+// Timer CCP pins of the pin mux that Grbl may select
+typedef struct {
+  unsigned long pin_config;
+  unsigned long port;
+  uint8_t pin;
+  unsigned long timer;
+  uint8_t selected; // Muxed to the timer by GPIOPinConfigure()
+  float duty;       // Output duty cycle last reported
+} sim_ccp_t;
+
+#define SIM_N_CCP 1
+static sim_ccp_t ccp[SIM_N_CCP] = {
+  { GPIO_PB6_T0CCP0, GPIO_PORTB_BASE, GPIO_PIN_6, TIMER0_BASE }
+};
+
+#define SIM_EEPROM_SIZE 2048
+static uint8_t eeprom[SIM_EEPROM_SIZE];
+
+// uDMA control table and channel enables
+#define SIM_N_DMA_CHANNEL 32
+static tDMAControlTable *udma_table;
+static uint32_t udma_enabled;
+
+
+static int port_index(unsigned long port)
+{
+  switch (port) {
+    case GPIO_PORTA_BASE: return(0);
+    case GPIO_PORTB_BASE: return(1);
+    case GPIO_PORTC_BASE: return(2);
+    case GPIO_PORTD_BASE: return(3);
+    case GPIO_PORTE_BASE: return(4);
+    case GPIO_PORTF_BASE: return(5);
+  }
+  return(-1);
+}
+
+static int port_irq(unsigned long port)
+{
+  switch (port) {
+    case GPIO_PORTA_BASE: return(INT_GPIOA);
+    case GPIO_PORTB_BASE: return(INT_GPIOB);
+    case GPIO_PORTC_BASE: return(INT_GPIOC);
+    case GPIO_PORTD_BASE: return(INT_GPIOD);
+    case GPIO_PORTE_BASE: return(INT_GPIOE);
+    case GPIO_PORTF_BASE: return(INT_GPIOF);
+  }
+  return(0);
+}
+
+static sim_timer_t *find_timer(unsigned long base)
+{
+  uint8_t i;
+  for (i=0; i<SIM_N_TIMER; i++) {
+    if (gptm[i].base == base) { return(&gptm[i]); }
+  }
+  return(NULL);
+}
+
+// Reports the output duty cycle of each timer CCP pin that changed. A pin in timer mode follows the
+// PWM of its timer, any other is a GPIO at 0 or 1.
+static void ccp_update()
+{
+  uint8_t i;
+  for (i=0; i<SIM_N_CCP; i++) {
+    sim_ccp_t *c = &ccp[i];
+    int port = port_index(c->port);
+    float duty = (gpio_data[port] & c->pin) ? 1.0f : 0.0f;
+    if (c->selected && (gpio_timer_mask[port] & c->pin)) {
+      sim_timer_t *timer = find_timer(c->timer);
+      duty = 0.0f;
+      if (timer->pwm && timer->running && timer->load && timer->match < timer->load) {
+        duty = (float)(timer->load-timer->match)/timer->load;
+      }
+    }
+    if (duty != c->duty) {
+      c->duty = duty;
+      sim_trace_pwm(c->port, c->pin, duty);
+    }
+  }
+}
+
+
+// Runs every pending interrupt that has a higher priority than the code currently executing,
+// highest priority first. Handlers may advance time themselves, which can nest further here.
+static void dispatch_interrupts()
+{
+  if (!master_enable) { return; }
+  for (;;) {
+    int i, best = -1;
+    for (i=0; i<NUM_INTERRUPTS; i++) {
+      if (nvic[i].pending && nvic[i].enabled && nvic[i].handler && nvic[i].priority < active_priority) {
+        if (best < 0 || nvic[i].priority < nvic[best].priority) { best = i; }
+      }
+    }
+    if (best < 0) { return; }
+
+    uint16_t preempted_priority = active_priority;
+    uint64_t raised = nvic[best].raised;
+    uint64_t entry = sim_cycles;
+    nvic[best].pending = false;
+    active_priority = nvic[best].priority;
+    nvic[best].handler();
+    active_priority = preempted_priority;
+    sim_trace_isr(best, raised, entry, sim_cycles);
+  }
+}
+
+static void raise_interrupt(int irq, uint64_t when)
+{
+  if (nvic[irq].pending) {
+    sim_trace_overrun(irq); // Previous request not yet serviced. This one is lost.
+  } else {
+    nvic[irq].pending = true;
+    nvic[irq].raised = when;
+  }
+}
+
+// Writes a 32-bit item to a peripheral register. Only the registers Grbl streams to are decoded.
+static void udma_write_register(unsigned long address, uint32_t value)
+{
+  unsigned long base = address & ~0xfffUL, offset = address & 0xfff;
+  if (port_index(base) >= 0 && offset < 0x400) {
+    GPIOPinWrite(base, (offset >> 2) & 0xff, value); // Masked data register
+    return;
+  }
+  sim_timer_t *timer = find_timer(base);
+  if (timer && offset == TIMER_O_TAILR) { timer->load = value; }
+}
+
+// Performs the transfer described by a channel control structure. Sources are always memory.
+// Control structures are copied whole, since they are larger than four words on the host.
+static void udma_transfer(tDMAControlTable *control)
+{
+  unsigned long count = ((control->ulControl >> 4) & 0x3ff) + 1;
+  unsigned long src_inc = control->ulControl & UDMA_SRC_INC_NONE;
+  unsigned long dst_inc = control->ulControl & UDMA_DST_INC_NONE;
+  uint8_t *src = (uint8_t *)control->pvSrcEndAddr;
+  uint8_t *dst = (uint8_t *)control->pvDstEndAddr;
+  if (src_inc != UDMA_SRC_INC_NONE) { src -= (count << (src_inc >> 26)) - 1; }
+  if (dst_inc != UDMA_DST_INC_NONE) { dst -= (count << (dst_inc >> 30)) - 1; }
+
+  if (udma_table && dst >= (uint8_t *)udma_table && dst < (uint8_t *)&udma_table[2*SIM_N_DMA_CHANNEL]) {
+    memcpy(dst, src, sizeof(tDMAControlTable));
+    return;
+  }
+  unsigned long i;
+  for (i=0; i<count; i++) {
+    uint32_t value;
+    memcpy(&value, src, sizeof(value));
+    if ((unsigned long)dst >= 0x40000000 && (unsigned long)dst < 0x44000000) {
+      udma_write_register((unsigned long)dst, value);
+    } else {
+      memcpy(dst, &value, sizeof(value));
+    }
+    if (src_inc != UDMA_SRC_INC_NONE) { src += 4; }
+    if (dst_inc != UDMA_DST_INC_NONE) { dst += 4; }
+  }
+}
+
+// Serves a request on a channel in scatter-gather mode. The primary structure copies the next task
+// to the alternate structure, which then runs. Memory tasks chain to the next task at once,
+// peripheral tasks end the request.
+static void udma_request(uint8_t channel)
+{
+  if (!udma_table || !(udma_enabled & (1UL << channel))) { return; }
+  tDMAControlTable *primary = &udma_table[channel];
+  tDMAControlTable *alternate = &udma_table[channel+SIM_N_DMA_CHANNEL];
+  for (;;) {
+    unsigned long mode = primary->ulControl & 0x7;
+    if (mode != UDMA_MODE_MEM_SCATTER_GATHER && mode != UDMA_MODE_PER_SCATTER_GATHER) { return; }
+    unsigned long words = ((primary->ulControl >> 4) & 0x3ff) + 1;
+    tDMAControlTable *last = (tDMAControlTable *)((uint8_t *)primary->pvSrcEndAddr - offsetof(tDMAControlTable, ulSpare));
+    *alternate = *(last - (words/4 - 1));
+    primary->ulControl &= ~0x3ff7UL;
+    if (words > 4) { primary->ulControl |= ((words-5) << 4) | mode; }
+
+    unsigned long task_mode = alternate->ulControl & 0x7;
+    alternate->ulControl &= ~0x7UL;
+    udma_transfer(alternate);
+    if (task_mode != (UDMA_MODE_MEM_SCATTER_GATHER | UDMA_MODE_ALT_SELECT)) { return; }
+  }
+}
+
+static void uart_update_interrupt()
+{
+  if (uart0.rx_count && (uart0.int_mask & (UART_INT_RX|UART_INT_RT))) {
+    if (!nvic[INT_UART0].pending) {
+      nvic[INT_UART0].pending = true;
+      nvic[INT_UART0].raised = sim_cycles;
+    }
+  }
+}
+
+void sim_advance(uint64_t cycles)
+{
+  uint64_t target = sim_cycles + cycles;
+  for (;;) {
+    // Find the next hardware event due before the target time.
+    uint64_t next = sim_host_next_transfer();
+    sim_timer_t *timer = NULL;
+    uint8_t i;
+    for (i=0; i<SIM_N_TIMER; i++) {
+      if (gptm[i].running && !gptm[i].pwm && gptm[i].deadline < next) {
+        next = gptm[i].deadline;
+        timer = &gptm[i];
+      }
+    }
+    if (next > target) { break; }
+    if (next > sim_cycles) { sim_cycles = next; }
+
+    if (timer) {
+      if (timer->periodic) {
+        timer->deadline += (timer->load ? timer->load : 1);
+      } else {
+        timer->running = false;
+      }
+      if (timer->int_enabled) { raise_interrupt(timer->irq, next); }
+      if (timer->dma_channel) { udma_request(timer->dma_channel-1); }
+    } else {
+      sim_host_transfer();
+    }
+    dispatch_interrupts();
+  }
+  if (target > sim_cycles) { sim_cycles = target; }
+  dispatch_interrupts();
+}
+
+void sim_uart_receive(uint8_t data)
+{
+  if (uart0.rx_count < SIM_UART_FIFO_SIZE) {
+    uart0.rx_fifo[(uart0.rx_head+uart0.rx_count) % SIM_UART_FIFO_SIZE] = data;
+    uart0.rx_count++;
+  } else {
+    uart0.overruns++; // The byte is lost, as on the real part.
+  }
+  uart_update_interrupt();
+}
+
+uint8_t sim_uart_rx_level() { return(uart0.rx_count); }
+
+uint64_t sim_uart_overruns() { return(uart0.overruns); }
+
+static void usb_raise_interrupt()
+{
+  if (!nvic[INT_USB0].pending) {
+    nvic[INT_USB0].pending = true;
+    nvic[INT_USB0].raised = sim_cycles;
+  }
+}
+
+uint8_t sim_usb_rx_free() { return(usb0.connected && usb0.rx_count == 0); }
+
+uint8_t sim_usb_rx_level() { return(usb0.rx_count - usb0.rx_read); }
+
+void sim_usb_receive(const uint8_t *data, uint8_t count)
+{
+  memcpy(usb0.rx_packet, data, count);
+  usb0.rx_count = count;
+  usb0.rx_read = 0;
+  usb0.rx_event = true;
+  usb_raise_interrupt();
+}
+
+void sim_hardware_init()
+{
+  memset(eeprom, 0xff, sizeof(eeprom)); // Erased, like a fresh part, so Grbl loads its defaults.
+}
+
+
+// System control
+void SysCtlPeripheralEnable(unsigned long ulPeripheral) { }
+void SysCtlClockSet(unsigned long ulConfig) { }
+unsigned long SysCtlClockGet(void) { return(F_CPU); }
+
+// SysCtlDelay() burns three core cycles per count.
+void SysCtlDelay(unsigned long ulCount) { sim_advance(3*(uint64_t)ulCount); }
+
+
+// GPIO
+void GPIOPinWrite(unsigned long ulPort, unsigned char ucPins, unsigned char ucVal)
+{
+  int i = port_index(ulPort);
+  if (i < 0) { return; }
+  uint8_t previous = gpio_data[i];
+  gpio_data[i] = (previous & ~ucPins) | (ucVal & ucPins);
+  if (gpio_data[i] != previous) {
+    sim_trace_port(ulPort, previous, gpio_data[i]);
+    ccp_update();
+  }
+}
+
+// Inputs all have their weak pull-ups enabled by Grbl, so they read high unless the simulated
+// machine pulls them low. High is the inactive level of the limit switches and the pinouts.
+long GPIOPinRead(unsigned long ulPort, unsigned char ucPins)
+{
+  int i = port_index(ulPort);
+  if (i < 0) { return(0); }
+  uint8_t inputs = gpio_input_mask[i] & ~sim_input_low(ulPort);
+  return((inputs | (gpio_data[i] & ~gpio_input_mask[i])) & ucPins);
+}
+
+void GPIOPinTypeGPIOOutput(unsigned long ulPort, unsigned char ucPins)
+{
+  int i = port_index(ulPort);
+  if (i >= 0) {
+    gpio_input_mask[i] &= ~ucPins;
+    gpio_timer_mask[i] &= ~ucPins;
+    ccp_update();
+  }
+}
+
+void GPIOPinTypeGPIOInput(unsigned long ulPort, unsigned char ucPins)
+{
+  int i = port_index(ulPort);
+  if (i >= 0) {
+    gpio_input_mask[i] |= ucPins;
+    gpio_timer_mask[i] &= ~ucPins;
+    ccp_update();
+  }
+}
+
+void GPIOPinTypeTimer(unsigned long ulPort, unsigned char ucPins)
+{
+  int i = port_index(ulPort);
+  if (i >= 0) {
+    gpio_input_mask[i] &= ~ucPins;
+    gpio_timer_mask[i] |= ucPins;
+    ccp_update();
+  }
+}
+
+void GPIOPinTypeUART(unsigned long ulPort, unsigned char ucPins) { }
+void GPIOPinTypeUSBAnalog(unsigned long ulPort, unsigned char ucPins) { }
+
+void GPIOPinConfigure(unsigned long ulPinConfig)
+{
+  uint8_t i;
+  for (i=0; i<SIM_N_CCP; i++) {
+    if (ccp[i].pin_config == ulPinConfig) { ccp[i].selected = true; }
+  }
+  ccp_update();
+}
+void GPIOPadConfigSet(unsigned long ulPort, unsigned char ucPins, unsigned long ulStrength,
+                      unsigned long ulPadType) { }
+void GPIOIntTypeSet(unsigned long ulPort, unsigned char ucPins, unsigned long ulIntType) { }
+void GPIOPinIntEnable(unsigned long ulPort, unsigned char ucPins) { }
+void GPIOPinIntDisable(unsigned long ulPort, unsigned char ucPins) { }
+void GPIOPinIntClear(unsigned long ulPort, unsigned char ucPins) { }
+
+void GPIOPortIntRegister(unsigned long ulPort, void (*pfnIntHandler)(void))
+{
+  int irq = port_irq(ulPort);
+  if (irq) {
+    nvic[irq].handler = pfnIntHandler;
+    nvic[irq].enabled = true;
+  }
+}
+
+
+// General purpose timers
+void TimerConfigure(unsigned long ulBase, unsigned long ulConfig)
+{
+  sim_timer_t *timer = find_timer(ulBase);
+  if (!timer) { return; }
+  timer->periodic = ((ulConfig & 0xff) == TIMER_CFG_A_PERIODIC_UP || (ulConfig & 0xff) == TIMER_CFG_A_PERIODIC);
+  timer->count_up = ((ulConfig & 0xff) == TIMER_CFG_A_PERIODIC_UP || (ulConfig & 0xff) == TIMER_CFG_A_ONE_SHOT_UP);
+  timer->pwm = ((ulConfig & 0xff) == TIMER_CFG_A_PWM);
+  timer->running = false;
+  timer->remaining = 0;
+  ccp_update();
+}
+
+void TimerControlStall(unsigned long ulBase, unsigned long ulTimer, tBoolean bStall) { }
+void TimerPrescaleSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue) { }
+
+void TimerEnable(unsigned long ulBase, unsigned long ulTimer)
+{
+  sim_timer_t *timer = find_timer(ulBase);
+  if (!timer || !(ulTimer & TIMER_A) || timer->running) { return; }
+  timer->running = true;
+  if (timer->remaining) {
+    timer->deadline = sim_cycles + timer->remaining;
+  } else {
+    timer->deadline = sim_cycles + (timer->load ? timer->load : 1);
+  }
+  timer->remaining = 0;
+  if (ulBase == TIMER1_BASE) { sim_trace_step_timer(true); }
+  if (timer->pwm) { ccp_update(); }
+}
+
+void TimerDisable(unsigned long ulBase, unsigned long ulTimer)
+{
+  sim_timer_t *timer = find_timer(ulBase);
+  if (!timer || !(ulTimer & TIMER_A) || !timer->running) { return; }
+  timer->running = false;
+  timer->remaining = (timer->deadline > sim_cycles) ? timer->deadline - sim_cycles : 0;
+  if (ulBase == TIMER1_BASE) { sim_trace_step_timer(false); }
+  if (timer->pwm) { ccp_update(); }
+}
+
+void TimerLoadSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue)
+{
+  sim_timer_t *timer = find_timer(ulBase);
+  if (timer && (ulTimer & TIMER_A)) {
+    timer->load = ulValue;
+    // A stopped down counter starts over from the new load value. An up counter keeps its count.
+    if (!timer->running && !timer->count_up) { timer->remaining = 0; }
+    if (timer->pwm) { ccp_update(); }
+  }
+}
+
+void TimerMatchSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue)
+{
+  sim_timer_t *timer = find_timer(ulBase);
+  if (timer && (ulTimer & TIMER_A)) {
+    timer->match = ulValue;
+    if (timer->pwm) { ccp_update(); }
+  }
+}
+
+void TimerIntRegister(unsigned long ulBase, unsigned long ulTimer, void (*pfnHandler)(void))
+{
+  sim_timer_t *timer = find_timer(ulBase);
+  if (!timer) { return; }
+  nvic[timer->irq].handler = pfnHandler;
+  nvic[timer->irq].enabled = true;
+}
+
+void TimerIntEnable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+  sim_timer_t *timer = find_timer(ulBase);
+  if (timer && (ulIntFlags & TIMER_TIMA_TIMEOUT)) { timer->int_enabled = true; }
+}
+
+void TimerIntClear(unsigned long ulBase, unsigned long ulIntFlags) { }
+
+
+// UART0
+void UARTConfigSetExpClk(unsigned long ulBase, unsigned long ulUARTClk, unsigned long ulBaud,
+                         unsigned long ulConfig) { }
+void UARTFIFOLevelSet(unsigned long ulBase, unsigned long ulTxLevel, unsigned long ulRxLevel) { }
+void UARTEnable(unsigned long ulBase) { }
+
+void UARTIntEnable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+  if (ulBase != UART0_BASE) { return; }
+  uart0.int_mask |= ulIntFlags;
+  uart_update_interrupt();
+}
+
+void UARTIntDisable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+  if (ulBase == UART0_BASE) { uart0.int_mask &= ~ulIntFlags; }
+}
+
+void UARTIntClear(unsigned long ulBase, unsigned long ulIntFlags) { }
+
+unsigned long UARTIntStatus(unsigned long ulBase, tBoolean bMasked)
+{
+  unsigned long status = 0;
+  if (ulBase == UART0_BASE && uart0.rx_count) { status = UART_INT_RX; }
+  if (bMasked) { status &= uart0.int_mask; }
+  return(status);
+}
+
+void UARTIntRegister(unsigned long ulBase, void (*pfnHandler)(void))
+{
+  if (ulBase != UART0_BASE) { return; }
+  nvic[INT_UART0].handler = pfnHandler;
+  nvic[INT_UART0].enabled = true;
+}
+
+tBoolean UARTCharsAvail(unsigned long ulBase)
+{
+  return(ulBase == UART0_BASE && uart0.rx_count);
+}
+
+long UARTCharGetNonBlocking(unsigned long ulBase)
+{
+  if (ulBase != UART0_BASE || !uart0.rx_count) { return(-1); }
+  uint8_t data = uart0.rx_fifo[uart0.rx_head];
+  uart0.rx_head = (uart0.rx_head+1) % SIM_UART_FIFO_SIZE;
+  uart0.rx_count--;
+  return(data);
+}
+
+tBoolean UARTSpaceAvail(unsigned long ulBase) { return(true); }
+tBoolean UARTBusy(unsigned long ulBase) { return(false); }
+void UARTFlowControlSet(unsigned long ulBase, unsigned long ulMode) { }
+
+tBoolean UARTCharPutNonBlocking(unsigned long ulBase, unsigned char ucData)
+{
+  if (ulBase == UART0_BASE) { sim_host_receive(ucData); }
+  return(true);
+}
+
+
+// Interrupt controller
+tBoolean IntMasterEnable(void)
+{
+  tBoolean was_disabled = !master_enable;
+  master_enable = true;
+  dispatch_interrupts();
+  return(was_disabled);
+}
+
+tBoolean IntMasterDisable(void)
+{
+  tBoolean was_disabled = !master_enable;
+  master_enable = false;
+  return(was_disabled);
+}
+
+void IntEnable(unsigned long ulInterrupt) { if (ulInterrupt < NUM_INTERRUPTS) { nvic[ulInterrupt].enabled = true; } }
+void IntDisable(unsigned long ulInterrupt) { if (ulInterrupt < NUM_INTERRUPTS) { nvic[ulInterrupt].enabled = false; } }
+void IntPendClear(unsigned long ulInterrupt) { if (ulInterrupt < NUM_INTERRUPTS) { nvic[ulInterrupt].pending = false; } }
+
+void IntPrioritySet(unsigned long ulInterrupt, unsigned char ucPriority)
+{
+  if (ulInterrupt < NUM_INTERRUPTS) { nvic[ulInterrupt].priority = ucPriority; }
+}
+
+void IntRegister(unsigned long ulInterrupt, void (*pfnHandler)(void))
+{
+  if (ulInterrupt < NUM_INTERRUPTS) { nvic[ulInterrupt].handler = pfnHandler; }
+}
+
+
+// USB library CDC serial device class
+void USBStackModeSet(unsigned long ulIndex, tUSBMode eUSBMode, tUSBModeCallback pfnCallback) { }
+
+void *USBDCDCInit(unsigned long ulIndex, const tUSBDCDCDevice *psDevice)
+{
+  usb0.device = psDevice;
+  usb0.connect_event = true;
+  nvic[INT_USB0].enabled = true;
+  usb_raise_interrupt();
+  return((void *)psDevice);
+}
+
+unsigned long USBDCDCRxPacketAvailable(void *pvInstance) { return(sim_usb_rx_level()); }
+
+unsigned long USBDCDCPacketRead(void *pvInstance, unsigned char *pcData, unsigned long ulLength,
+                                tBoolean bLast)
+{
+  unsigned long count = sim_usb_rx_level();
+  if (count > ulLength) { count = ulLength; }
+  memcpy(pcData, &usb0.rx_packet[usb0.rx_read], count);
+  usb0.rx_read += count;
+  if (bLast || usb0.rx_read == usb0.rx_count) { usb0.rx_count = usb0.rx_read = 0; } // Acknowledged
+  return(count);
+}
+
+unsigned long USBDCDCTxPacketAvailable(void *pvInstance)
+{
+  return((usb0.connected && !usb0.tx_busy) ? SIM_USB_PACKET_SIZE : 0);
+}
+
+unsigned long USBDCDCPacketWrite(void *pvInstance, unsigned char *pcData, unsigned long ulLength,
+                                 tBoolean bLast)
+{
+  if (!usb0.connected || usb0.tx_busy) { return(0); }
+  if (ulLength > SIM_USB_PACKET_SIZE) { ulLength = SIM_USB_PACKET_SIZE; }
+  unsigned long i;
+  for (i=0; i<ulLength; i++) { sim_host_receive(pcData[i]); }
+  usb0.tx_busy = true;
+  usb0.tx_event = true;
+  usb_raise_interrupt();
+  return(ulLength);
+}
+
+void USB0DeviceIntHandler(void)
+{
+  const tUSBDCDCDevice *device = usb0.device;
+  if (!device) { return; }
+  if (usb0.connect_event) {
+    usb0.connect_event = false;
+    usb0.connected = true;
+    device->pfnControlCallback(device->pvControlCBData, USB_EVENT_CONNECTED, 0, NULL);
+  }
+  if (usb0.tx_event) {
+    usb0.tx_event = false;
+    usb0.tx_busy = false;
+    device->pfnTxCallback(device->pvTxCBData, USB_EVENT_TX_COMPLETE, 0, NULL);
+  }
+  if (usb0.rx_event) {
+    usb0.rx_event = false;
+    device->pfnRxCallback(device->pvRxCBData, USB_EVENT_RX_AVAILABLE, sim_usb_rx_level(), NULL);
+  }
+}
+
+
+// Micro direct memory access controller
+void uDMAEnable(void) { }
+void uDMAControlBaseSet(void *pControlTable) { udma_table = (tDMAControlTable *)pControlTable; }
+
+void uDMAChannelAssign(unsigned long ulMapping)
+{
+  if (ulMapping == UDMA_CH4_TIMER2A) { find_timer(TIMER2_BASE)->dma_channel = (ulMapping & 0xff) + 1; }
+}
+
+void uDMAChannelAttributeDisable(unsigned long ulChannelNum, unsigned long ulAttr) { }
+
+void uDMAChannelScatterGatherSet(unsigned long ulChannelNum, unsigned ulTaskCount,
+                                 void *pvTaskList, unsigned long ulIsPeriphSG)
+{
+  tDMAControlTable *primary = &udma_table[ulChannelNum & 0x1f];
+  primary->pvSrcEndAddr = &((tDMAControlTable *)pvTaskList)[ulTaskCount-1].ulSpare;
+  primary->pvDstEndAddr = &udma_table[(ulChannelNum & 0x1f) + SIM_N_DMA_CHANNEL].ulSpare;
+  primary->ulControl = UDMA_SRC_INC_32 | UDMA_DST_INC_32 | UDMA_SIZE_32 | UDMA_ARB_4 |
+                       (((ulTaskCount*4) - 1) << 4) |
+                       (ulIsPeriphSG ? UDMA_MODE_PER_SCATTER_GATHER : UDMA_MODE_MEM_SCATTER_GATHER);
+}
+
+void uDMAChannelEnable(unsigned long ulChannelNum) { udma_enabled |= 1UL << (ulChannelNum & 0x1f); }
+void uDMAChannelDisable(unsigned long ulChannelNum) { udma_enabled &= ~(1UL << (ulChannelNum & 0x1f)); }
+
+unsigned long uDMAChannelSizeGet(unsigned long ulChannelStructIndex)
+{
+  tDMAControlTable *control = &udma_table[ulChannelStructIndex & 0x3f];
+  if (!(control->ulControl & 0x7)) { return(0); }
+  return(((control->ulControl >> 4) & 0x3ff) + 1);
+}
+
+
+// Direct register access
+volatile unsigned long *sim_register(unsigned long address)
+{
+  // Bring the cycle counter up to date with the enable bits as they were until now, since the
+  // caller may be about to change them.
+  if ((demcr & DEMCR_TRCENA) && (dwt_ctrl & DWT_CTRL_CYCCNTENA)) {
+    dwt_cyccnt += (unsigned long)(sim_cycles - dwt_updated);
+  }
+  dwt_updated = sim_cycles;
+  switch (address) {
+    case DEMCR_ADDRESS: return(&demcr);
+    case DWT_CTRL_ADDRESS: return(&dwt_ctrl);
+    case DWT_CYCCNT_ADDRESS: return(&dwt_cyccnt);
+  }
+  return(&unmodeled_register);
+}
+
+
+// Floating point unit
+void FPUEnable(void) { }
+void FPULazyStackingEnable(void) { }
+
+
+// Internal EEPROM
+unsigned long EEPROMInit(void) { return(0); }
+
+void EEPROMRead(unsigned long *pulData, unsigned long ulAddress, unsigned long ulCount)
+{
+  if (ulAddress + ulCount > SIM_EEPROM_SIZE) { return; }
+  memcpy(pulData, &eeprom[ulAddress], ulCount);
+}
+
+unsigned long EEPROMProgram(unsigned long *pulData, unsigned long ulAddress, unsigned long ulCount)
+{
+  if (ulAddress + ulCount > SIM_EEPROM_SIZE) { return(1); }
+  memcpy(&eeprom[ulAddress], pulData, ulCount);
+  return(0);
+}
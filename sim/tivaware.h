@@ -0,0 +1,338 @@
+/*
+  tivaware.h - host stand-in for the StellarisWare driver library used by Grbl
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Only the subset of the driver library that Grbl actually calls is provided. The register
+   base addresses and interrupt numbers match the LM4F120H5QR data sheet, so config.h needs no
+   changes to build for the host. The per-module headers in inc/ and driverlib/ all resolve
+   to this file. */
+
+#ifndef tivaware_h
+#define tivaware_h
+
+typedef unsigned char tBoolean;
+
+// Peripheral base addresses (inc/hw_memmap.h)
+#define GPIO_PORTA_BASE    0x40004000
+#define GPIO_PORTB_BASE    0x40005000
+#define GPIO_PORTC_BASE    0x40006000
+#define GPIO_PORTD_BASE    0x40007000
+#define GPIO_PORTE_BASE    0x40024000
+#define GPIO_PORTF_BASE    0x40025000
+#define UART0_BASE         0x4000C000
+#define UART1_BASE         0x4000D000
+#define TIMER0_BASE        0x40030000
+#define TIMER1_BASE        0x40031000
+#define TIMER2_BASE        0x40032000
+#define TIMER3_BASE        0x40033000
+#define TIMER4_BASE        0x40034000
+#define TIMER5_BASE        0x40035000
+
+// Register offsets (inc/hw_gpio.h, inc/hw_timer.h)
+#define GPIO_O_DATA        0x00000000
+#define TIMER_O_TAILR      0x00000028
+
+// Interrupt assignments (inc/hw_ints.h)
+#define INT_GPIOA          16
+#define INT_GPIOB          17
+#define INT_GPIOC          18
+#define INT_GPIOD          19
+#define INT_GPIOE          20
+#define INT_UART0          21
+#define INT_UART1          22
+#define INT_USB0           60
+#define INT_TIMER0A        35
+#define INT_TIMER0B        36
+#define INT_TIMER1A        37
+#define INT_TIMER1B        38
+#define INT_TIMER2A        39
+#define INT_TIMER2B        40
+#define INT_GPIOF          46
+#define INT_TIMER3A        51
+#define INT_TIMER3B        52
+#define INT_TIMER4A        86
+#define INT_TIMER4B        87
+#define INT_TIMER5A        108
+#define INT_TIMER5B        109
+#define NUM_INTERRUPTS     155
+
+// System control (driverlib/sysctl.h)
+#define SYSCTL_PERIPH_GPIOA   0x20000001
+#define SYSCTL_PERIPH_GPIOB   0x20000002
+#define SYSCTL_PERIPH_GPIOC   0x20000004
+#define SYSCTL_PERIPH_GPIOD   0x20000008
+#define SYSCTL_PERIPH_GPIOE   0x20000010
+#define SYSCTL_PERIPH_GPIOF   0x20000020
+#define SYSCTL_PERIPH_UART0   0x10000001
+#define SYSCTL_PERIPH_UART1   0x10000002
+#define SYSCTL_PERIPH_USB0    0x10100001
+#define SYSCTL_PERIPH_TIMER0  0x10100001
+#define SYSCTL_PERIPH_TIMER1  0x10100002
+#define SYSCTL_PERIPH_TIMER2  0x10100004
+#define SYSCTL_PERIPH_TIMER3  0x10100008
+#define SYSCTL_PERIPH_EEPROM0 0x10000020
+#define SYSCTL_PERIPH_UDMA    0x00002000
+#define SYSCTL_SYSDIV_4       0x01C00000
+#define SYSCTL_USE_PLL        0x00000000
+#define SYSCTL_XTAL_16MHZ     0x00000540
+#define SYSCTL_OSC_MAIN       0x00000000
+
+void SysCtlPeripheralEnable(unsigned long ulPeripheral);
+void SysCtlDelay(unsigned long ulCount);
+void SysCtlClockSet(unsigned long ulConfig);
+unsigned long SysCtlClockGet(void);
+
+// GPIO (driverlib/gpio.h, driverlib/pin_map.h)
+#define GPIO_PIN_0            0x00000001
+#define GPIO_PIN_1            0x00000002
+#define GPIO_PIN_2            0x00000004
+#define GPIO_PIN_3            0x00000008
+#define GPIO_PIN_4            0x00000010
+#define GPIO_PIN_5            0x00000020
+#define GPIO_PIN_6            0x00000040
+#define GPIO_PIN_7            0x00000080
+#define GPIO_FALLING_EDGE     0x00000000
+#define GPIO_RISING_EDGE      0x00000004
+#define GPIO_BOTH_EDGES       0x00000001
+#define GPIO_STRENGTH_2MA     0x00000001
+#define GPIO_PIN_TYPE_STD_WPU 0x0000000A
+#define GPIO_PA0_U0RX         0x00000001
+#define GPIO_PA1_U0TX         0x00000401
+#define GPIO_PB0_U1RX         0x00010001
+#define GPIO_PB1_U1TX         0x00010401
+#define GPIO_PC5_U1CTS        0x00021408
+#define GPIO_PB6_T0CCP0       0x00011807
+
+void GPIOPinWrite(unsigned long ulPort, unsigned char ucPins, unsigned char ucVal);
+long GPIOPinRead(unsigned long ulPort, unsigned char ucPins);
+void GPIOPinTypeGPIOOutput(unsigned long ulPort, unsigned char ucPins);
+void GPIOPinTypeGPIOInput(unsigned long ulPort, unsigned char ucPins);
+void GPIOPinTypeUART(unsigned long ulPort, unsigned char ucPins);
+void GPIOPinTypeUSBAnalog(unsigned long ulPort, unsigned char ucPins);
+void GPIOPinTypeTimer(unsigned long ulPort, unsigned char ucPins);
+void GPIOPinConfigure(unsigned long ulPinConfig);
+void GPIOPadConfigSet(unsigned long ulPort, unsigned char ucPins, unsigned long ulStrength,
+                      unsigned long ulPadType);
+void GPIOIntTypeSet(unsigned long ulPort, unsigned char ucPins, unsigned long ulIntType);
+void GPIOPinIntEnable(unsigned long ulPort, unsigned char ucPins);
+void GPIOPinIntDisable(unsigned long ulPort, unsigned char ucPins);
+void GPIOPinIntClear(unsigned long ulPort, unsigned char ucPins);
+void GPIOPortIntRegister(unsigned long ulPort, void (*pfnIntHandler)(void));
+
+// General purpose timers (driverlib/timer.h)
+#define TIMER_CFG_ONE_SHOT       0x00000021
+#define TIMER_CFG_ONE_SHOT_UP    0x00000031
+#define TIMER_CFG_PERIODIC       0x00000022
+#define TIMER_CFG_PERIODIC_UP    0x00000032
+#define TIMER_CFG_SPLIT_PAIR     0x04000000
+#define TIMER_CFG_A_ONE_SHOT     0x00000021
+#define TIMER_CFG_A_ONE_SHOT_UP  0x00000031
+#define TIMER_CFG_A_PERIODIC     0x00000022
+#define TIMER_CFG_A_PERIODIC_UP  0x00000032
+#define TIMER_CFG_A_PWM          0x0000000A
+#define TIMER_A                  0x000000ff
+#define TIMER_B                  0x0000ff00
+#define TIMER_BOTH               0x0000ffff
+#define TIMER_TIMA_TIMEOUT       0x00000001
+
+void TimerConfigure(unsigned long ulBase, unsigned long ulConfig);
+void TimerControlStall(unsigned long ulBase, unsigned long ulTimer, tBoolean bStall);
+void TimerEnable(unsigned long ulBase, unsigned long ulTimer);
+void TimerDisable(unsigned long ulBase, unsigned long ulTimer);
+void TimerLoadSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue);
+void TimerMatchSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue);
+void TimerPrescaleSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue);
+void TimerIntRegister(unsigned long ulBase, unsigned long ulTimer, void (*pfnHandler)(void));
+void TimerIntEnable(unsigned long ulBase, unsigned long ulIntFlags);
+void TimerIntClear(unsigned long ulBase, unsigned long ulIntFlags);
+
+// UART (driverlib/uart.h)
+#define UART_CONFIG_WLEN_8    0x00000060
+#define UART_CONFIG_STOP_ONE  0x00000000
+#define UART_CONFIG_PAR_NONE  0x00000000
+#define UART_FIFO_TX1_8       0x00000000
+#define UART_FIFO_RX1_8       0x00000000
+#define UART_FIFO_RX4_8       0x00000010
+#define UART_FLOWCONTROL_TX   0x00008000
+#define UART_INT_RT           0x040
+#define UART_INT_TX           0x020
+#define UART_INT_RX           0x010
+
+void UARTConfigSetExpClk(unsigned long ulBase, unsigned long ulUARTClk, unsigned long ulBaud,
+                         unsigned long ulConfig);
+void UARTFIFOLevelSet(unsigned long ulBase, unsigned long ulTxLevel, unsigned long ulRxLevel);
+void UARTEnable(unsigned long ulBase);
+void UARTIntEnable(unsigned long ulBase, unsigned long ulIntFlags);
+void UARTIntDisable(unsigned long ulBase, unsigned long ulIntFlags);
+void UARTIntClear(unsigned long ulBase, unsigned long ulIntFlags);
+unsigned long UARTIntStatus(unsigned long ulBase, tBoolean bMasked);
+void UARTIntRegister(unsigned long ulBase, void (*pfnHandler)(void));
+tBoolean UARTCharsAvail(unsigned long ulBase);
+tBoolean UARTSpaceAvail(unsigned long ulBase);
+long UARTCharGetNonBlocking(unsigned long ulBase);
+tBoolean UARTCharPutNonBlocking(unsigned long ulBase, unsigned char ucData);
+tBoolean UARTBusy(unsigned long ulBase);
+void UARTFlowControlSet(unsigned long ulBase, unsigned long ulMode);
+
+// Micro direct memory access controller (driverlib/udma.h). Only Timer2A requests on channel 4
+// are modeled, in peripheral scatter-gather mode.
+typedef struct {
+  volatile void *pvSrcEndAddr;
+  volatile void *pvDstEndAddr;
+  volatile unsigned long ulControl;
+  volatile unsigned long ulSpare;
+} tDMAControlTable;
+
+#define UDMA_DST_INC_8               0x00000000
+#define UDMA_DST_INC_16              0x40000000
+#define UDMA_DST_INC_32              0x80000000
+#define UDMA_DST_INC_NONE            0xc0000000
+#define UDMA_SRC_INC_8               0x00000000
+#define UDMA_SRC_INC_16              0x04000000
+#define UDMA_SRC_INC_32              0x08000000
+#define UDMA_SRC_INC_NONE            0x0c000000
+#define UDMA_SIZE_8                  0x00000000
+#define UDMA_SIZE_16                 0x11000000
+#define UDMA_SIZE_32                 0x22000000
+#define UDMA_ARB_1                   0x00000000
+#define UDMA_ARB_4                   0x00008000
+#define UDMA_MODE_STOP               0x00000000
+#define UDMA_MODE_BASIC              0x00000001
+#define UDMA_MODE_AUTO               0x00000002
+#define UDMA_MODE_PINGPONG           0x00000003
+#define UDMA_MODE_MEM_SCATTER_GATHER 0x00000004
+#define UDMA_MODE_PER_SCATTER_GATHER 0x00000006
+#define UDMA_MODE_ALT_SELECT         0x00000001
+#define UDMA_PRI_SELECT              0x00000000
+#define UDMA_ALT_SELECT              0x00000020
+#define UDMA_ATTR_ALL                0x00000f00
+#define UDMA_CH4_TIMER2A             0x00010004
+
+#define uDMATaskStructEntry(ulTransferCount, ulItemSize, pvSrcAddr, ulSrcIncrement,           \
+                            pvDstAddr, ulDstIncrement, ulArbSize, ulMode)                     \
+  {                                                                                           \
+    (((ulSrcIncrement) == UDMA_SRC_INC_NONE) ? (void *)(pvSrcAddr) :                          \
+      ((void *)(&((unsigned char *)(pvSrcAddr))[((ulTransferCount) <<                         \
+                                                  ((ulSrcIncrement) >> 26)) - 1]))),          \
+    (((ulDstIncrement) == UDMA_DST_INC_NONE) ? (void *)(pvDstAddr) :                          \
+      ((void *)(&((unsigned char *)(pvDstAddr))[((ulTransferCount) <<                         \
+                                                  ((ulDstIncrement) >> 30)) - 1]))),          \
+    (ulSrcIncrement) | (ulDstIncrement) | (ulItemSize) | (ulArbSize) |                        \
+      (((ulTransferCount) - 1) << 4) |                                                        \
+      ((((ulMode) == UDMA_MODE_MEM_SCATTER_GATHER) ||                                         \
+        ((ulMode) == UDMA_MODE_PER_SCATTER_GATHER)) ? (ulMode) | UDMA_MODE_ALT_SELECT : (ulMode)), \
+    0                                                                                         \
+  }
+
+void uDMAEnable(void);
+void uDMAControlBaseSet(void *pControlTable);
+void uDMAChannelAssign(unsigned long ulMapping);
+void uDMAChannelAttributeDisable(unsigned long ulChannelNum, unsigned long ulAttr);
+void uDMAChannelScatterGatherSet(unsigned long ulChannelNum, unsigned ulTaskCount,
+                                 void *pvTaskList, unsigned long ulIsPeriphSG);
+void uDMAChannelEnable(unsigned long ulChannelNum);
+void uDMAChannelDisable(unsigned long ulChannelNum);
+unsigned long uDMAChannelSizeGet(unsigned long ulChannelStructIndex);
+
+// Nested vectored interrupt controller (driverlib/interrupt.h)
+tBoolean IntMasterEnable(void);
+tBoolean IntMasterDisable(void);
+void IntEnable(unsigned long ulInterrupt);
+void IntDisable(unsigned long ulInterrupt);
+void IntPrioritySet(unsigned long ulInterrupt, unsigned char ucPriority);
+void IntPendClear(unsigned long ulInterrupt);
+void IntRegister(unsigned long ulInterrupt, void (*pfnHandler)(void));
+
+// Direct register access (inc/hw_types.h). Only the core debug registers of the DWT cycle counter
+// are modeled: DEMCR, DWT_CTRL and DWT_CYCCNT, which counts the simulated clock while enabled.
+// Other registers read back what was last written to any of them.
+volatile unsigned long *sim_register(unsigned long address);
+#define HWREG(x) (*sim_register(x))
+
+// Floating point unit (driverlib/fpu.h)
+void FPUEnable(void);
+void FPULazyStackingEnable(void);
+
+// Internal EEPROM (driverlib/eeprom.h)
+unsigned long EEPROMInit(void);
+void EEPROMRead(unsigned long *pulData, unsigned long ulAddress, unsigned long ulCount);
+unsigned long EEPROMProgram(unsigned long *pulData, unsigned long ulAddress, unsigned long ulCount);
+
+// USB library CDC serial device class (usblib/usblib.h, usblib/device/usbdcdc.h). The device is
+// configured by the host at once and takes one bulk OUT packet at a time from the host.
+typedef unsigned long (*tUSBCallback)(void *pvCBData, unsigned long ulEvent, unsigned long ulMsgParam,
+                                      void *pvMsgData);
+typedef enum { USB_MODE_HOST_VBUS, USB_MODE_HOST, USB_MODE_DEVICE_VBUS, USB_MODE_DEVICE,
+               USB_MODE_OTG, USB_MODE_NONE, USB_MODE_FORCE_HOST, USB_MODE_FORCE_DEVICE } tUSBMode;
+typedef void (*tUSBModeCallback)(unsigned long ulIndex, tUSBMode eMode);
+
+typedef struct {
+  unsigned long ulRate;
+  unsigned char ucStop;
+  unsigned char ucParity;
+  unsigned char ucDatabits;
+} __attribute__((packed)) tLineCoding;
+
+typedef struct { unsigned long ulPrivate[24]; } tCDCSerInstance;
+
+typedef struct {
+  unsigned short usVID;
+  unsigned short usPID;
+  unsigned short usMaxPowermA;
+  unsigned char ucPwrAttributes;
+  tUSBCallback pfnControlCallback;
+  void *pvControlCBData;
+  tUSBCallback pfnRxCallback;
+  void *pvRxCBData;
+  tUSBCallback pfnTxCallback;
+  void *pvTxCBData;
+  const unsigned char * const *ppStringDescriptors;
+  unsigned long ulNumStringDescriptors;
+  tCDCSerInstance *psPrivateData;
+} tUSBDCDCDevice;
+
+#define USBShort(usValue)     ((usValue) & 0xff), ((usValue) >> 8)
+#define USB_DTYPE_STRING      3
+#define USB_LANG_EN_US        0x0409
+#define USB_VID_STELLARIS     0x1cbe
+#define USB_PID_SERIAL        0x0002
+#define USB_CONF_ATTR_SELF_PWR 0xC0
+#define USB_CDC_STOP_BITS_1   0x00
+#define USB_CDC_PARITY_NONE   0x00
+
+#define USB_EVENT_CONNECTED       0x0000
+#define USB_EVENT_DISCONNECTED    0x0001
+#define USB_EVENT_RX_AVAILABLE    0x0002
+#define USB_EVENT_DATA_REMAINING  0x0003
+#define USB_EVENT_TX_COMPLETE     0x0005
+#define USBD_CDC_EVENT_SEND_BREAK             0x6000
+#define USBD_CDC_EVENT_CLEAR_BREAK            0x6001
+#define USBD_CDC_EVENT_SET_CONTROL_LINE_STATE 0x6002
+#define USBD_CDC_EVENT_SET_LINE_CODING        0x6003
+#define USBD_CDC_EVENT_GET_LINE_CODING        0x6004
+
+void USBStackModeSet(unsigned long ulIndex, tUSBMode eUSBMode, tUSBModeCallback pfnCallback);
+void *USBDCDCInit(unsigned long ulIndex, const tUSBDCDCDevice *psDevice);
+unsigned long USBDCDCRxPacketAvailable(void *pvInstance);
+unsigned long USBDCDCPacketRead(void *pvInstance, unsigned char *pcData, unsigned long ulLength,
+                                tBoolean bLast);
+unsigned long USBDCDCTxPacketAvailable(void *pvInstance);
+unsigned long USBDCDCPacketWrite(void *pvInstance, unsigned char *pcData, unsigned long ulLength,
+                                 tBoolean bLast);
+void USB0DeviceIntHandler(void);
+
+#endif
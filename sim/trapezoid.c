@@ -0,0 +1,328 @@
+/*
+  trapezoid.c - host check of the integer block trapezoid against the float version
+  Part of Grbl
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Runs calculate_trapezoid_for_block() of planner.c, which computes the rates and step indices in
+   integers with Q32 entry and exit factors, side by side with the float version it replaced, over
+   edge case blocks and pseudo-random ones. The planner source is included here, so its static
+   functions are reachable; nothing else of the firmware is linked.
+
+   The integer version rounds exactly, the float one does not, so both are also checked against the
+   exact trapezoid, computed from the same factors in 64 bit integers and long double. The check
+   fails if a step index (accelerate_until, decelerate_after) of the integer version differs from
+   the float or exact one by more than one step event, or if its initial or final rate is more than
+   one step/min below theirs, or above the exact one at all. The Q32 factors are truncated, which
+   can only lower a rate.
+
+   With a jerk setting, the step indices come from the S-curve ramps instead. Those are checked for
+   consistency: the acceleration section must reach the nominal rate where the block cruises, the
+   deceleration section must brake from the rate reached to the final rate, within a step event,
+   and neither may be shorter than its linear counterpart.
+
+   make check builds and runs it over a million random blocks, ./trapezoid_check N over N. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "planner.c"
+
+// The planner state and runtime hooks the included planner refers to
+settings_t settings;
+system_t sys;
+void protocol_execute_runtime() { }
+void st_cycle_start() { }
+
+// The float trapezoid math as it was before the integer version
+static float estimate_acceleration_distance(float initial_rate, float target_rate, float acceleration)
+{
+  return( (target_rate*target_rate-initial_rate*initial_rate)/(2*acceleration) );
+}
+
+static float intersection_distance(float initial_rate, float final_rate, float acceleration, float distance)
+{
+  return( (2*acceleration*distance-initial_rate*initial_rate+final_rate*final_rate)/(4*acceleration) );
+}
+
+// calculate_trapezoid_for_block() as it was before the integer version, with the nominal rate
+// taken from plan_get_nominal_rate() like the current one
+static void float_trapezoid_for_block(block_t *block, float entry_factor, float exit_factor)
+{
+  uint32_t nominal_rate = plan_get_nominal_rate(block);
+  block->initial_rate = ceil(nominal_rate*entry_factor); // (step/min)
+  block->final_rate = ceil(nominal_rate*exit_factor); // (step/min)
+  int32_t acceleration_per_minute = block->rate_delta*ACCELERATION_TICKS_PER_SECOND*60.0; // (step/min^2)
+  int32_t accelerate_steps =
+    ceil(estimate_acceleration_distance(block->initial_rate, nominal_rate, acceleration_per_minute));
+  int32_t decelerate_steps =
+    floor(estimate_acceleration_distance(nominal_rate, block->final_rate, -acceleration_per_minute));
+  int32_t plateau_steps = block->step_event_count-accelerate_steps-decelerate_steps;
+  if (plateau_steps < 0) {
+    accelerate_steps = ceil(
+      intersection_distance(block->initial_rate, block->final_rate, acceleration_per_minute, block->step_event_count));
+    accelerate_steps = max(accelerate_steps,0); // Check limits due to numerical round-off
+    accelerate_steps = min(accelerate_steps,block->step_event_count);
+    plateau_steps = 0;
+  }
+  block->accelerate_until = accelerate_steps;
+  block->decelerate_after = accelerate_steps+plateau_steps;
+}
+
+// The exact trapezoid, from the float factors as they are, with exact rounding. The squared rates
+// are exact in 64 bit integers, the rates in long double.
+static void exact_trapezoid_for_block(block_t *block, float entry_factor, float exit_factor)
+{
+  uint32_t nominal_rate = plan_get_nominal_rate(block);
+  if (entry_factor > 1.0f) { entry_factor = 1.0f; }
+  if (exit_factor > 1.0f) { exit_factor = 1.0f; }
+  block->initial_rate = ceill((long double)nominal_rate*entry_factor); // (step/min)
+  block->final_rate = ceill((long double)nominal_rate*exit_factor); // (step/min)
+  int64_t acceleration_x2 = 2*(int64_t)block->rate_delta*ACCELERATION_TICKS_PER_SECOND*60; // (step/min^2)
+  int64_t nominal_rate_sq = (int64_t)nominal_rate*nominal_rate;
+  int64_t initial_rate_sq = (int64_t)block->initial_rate*block->initial_rate;
+  int64_t final_rate_sq = (int64_t)block->final_rate*block->final_rate;
+  int64_t accelerate_steps = (nominal_rate_sq-initial_rate_sq+acceleration_x2-1)/acceleration_x2;
+  int64_t decelerate_steps = (nominal_rate_sq-final_rate_sq)/acceleration_x2;
+  int64_t plateau_steps = block->step_event_count-accelerate_steps-decelerate_steps;
+  if (plateau_steps < 0) {
+    int64_t intersection = acceleration_x2*block->step_event_count-initial_rate_sq+final_rate_sq;
+    if (intersection <= 0) { accelerate_steps = 0; }
+    else { accelerate_steps = (intersection+2*acceleration_x2-1)/(2*acceleration_x2); }
+    accelerate_steps = min(accelerate_steps,block->step_event_count);
+    plateau_steps = 0;
+  }
+  block->accelerate_until = accelerate_steps;
+  block->decelerate_after = accelerate_steps+plateau_steps;
+}
+
+// Deterministic xorshift, so a failure can be reproduced
+static uint32_t random_state = 2463534242UL;
+
+static uint32_t random_u32()
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return(random_state);
+}
+
+static float random_float(float low, float high)
+{
+  return(low + (high-low)*(random_u32()/4294967296.0f));
+}
+
+// Differences of one trapezoid from another: the larger of the step index differences, and how
+// far the initial and final rates are below (positive) or above (negative) the other's.
+typedef struct {
+  long index;
+  long rate_low;
+  long rate_high;
+} difference_t;
+
+static difference_t compare(block_t *block, block_t *other)
+{
+  difference_t d;
+  d.index = max(labs((long)block->accelerate_until-(long)other->accelerate_until),
+                labs((long)block->decelerate_after-(long)other->decelerate_after));
+  long initial_low = (long)other->initial_rate-(long)block->initial_rate;
+  long final_low = (long)other->final_rate-(long)block->final_rate;
+  d.rate_low = max(initial_low, final_low);
+  d.rate_high = max(-initial_low, -final_low);
+  return(d);
+}
+
+static void print_block(const char *label, block_t *block)
+{
+  printf("  %-8s initial %lu final %lu accelerate until %lu decelerate after %lu\n", label,
+         (unsigned long)block->initial_rate, (unsigned long)block->final_rate,
+         (unsigned long)block->accelerate_until, (unsigned long)block->decelerate_after);
+}
+
+static unsigned long checked, compared, failed, float_off;
+static difference_t worst_exact, worst_float;
+
+static void track(difference_t *worst, difference_t d)
+{
+  worst->index = max(worst->index, d.index);
+  worst->rate_low = max(worst->rate_low, d.rate_low);
+  worst->rate_high = max(worst->rate_high, d.rate_high);
+}
+
+// Sets up a block the way plan_buffer_line() does, from its step count, length, speed and
+// acceleration, and checks the integer trapezoid of it for the given factors.
+static void check_block(uint32_t step_event_count, float millimeters, float nominal_speed,
+                        float acceleration, float entry_factor, float exit_factor)
+{
+  block_t block, reference, exact;
+  memset(&block, 0, sizeof(block));
+  block.step_event_count = step_event_count;
+  block.millimeters = millimeters;
+  block.nominal_speed = nominal_speed;
+  block.acceleration = acceleration;
+  block.rate_delta = ceilf(step_event_count/millimeters*acceleration/(60*ACCELERATION_TICKS_PER_SECOND));
+  reference = block;
+  exact = block;
+
+  calculate_trapezoid_for_block(&block, entry_factor, exit_factor);
+  float_trapezoid_for_block(&reference, entry_factor, exit_factor);
+  exact_trapezoid_for_block(&exact, entry_factor, exit_factor);
+  checked++;
+
+  // Against the exact trapezoid everywhere
+  difference_t d_exact = compare(&block, &exact);
+  track(&worst_exact, d_exact);
+  uint8_t fail = (d_exact.index > 1 || d_exact.rate_low > 1 || d_exact.rate_high > 0);
+
+  // Against the float version where it worked: rates within the 24 bits of a float mantissa and
+  // accelerations within its int32_t step/min^2. Above, it was off by far more than the integer one.
+  // Within, its squared rates still round, so the integer version may differ from it by more than
+  // one only as far as the float version is off from the exact trapezoid itself.
+  uint8_t float_range = (plan_get_nominal_rate(&block) < (1UL << 24) &&
+                         block.rate_delta*ACCELERATION_TICKS_PER_SECOND*60 <= INT32_MAX);
+  difference_t float_error = compare(&reference, &exact);
+  if (float_error.index || float_error.rate_low || float_error.rate_high) { float_off++; }
+  if (float_range) {
+    compared++;
+    difference_t d_float = compare(&block, &reference);
+    track(&worst_float, d_float);
+    if (d_float.index > max(1, float_error.index) || d_float.rate_low > max(1, float_error.rate_high)) {
+      fail = true;
+    }
+  }
+
+  if (fail && failed++ < 10) {
+    printf("FAIL steps %lu mm %.9g speed %.9g acceleration %.9g entry %.9g exit %.9g\n",
+           (unsigned long)step_event_count, millimeters, nominal_speed, acceleration, entry_factor,
+           exit_factor);
+    print_block("integer", &block);
+    print_block("float", &reference);
+    print_block("exact", &exact);
+  }
+}
+
+static unsigned long scurve_checked, scurve_failed;
+
+// Sets up a block like check_block() and checks its S-curve trapezoid at the given jerk (mm/min^3)
+static void check_scurve_block(uint32_t step_event_count, float millimeters, float nominal_speed,
+                               float acceleration, float jerk, float entry_factor, float exit_factor)
+{
+  block_t block, linear;
+  memset(&block, 0, sizeof(block));
+  block.step_event_count = step_event_count;
+  block.millimeters = millimeters;
+  block.nominal_speed = nominal_speed;
+  block.acceleration = acceleration;
+  block.rate_delta = ceilf(step_event_count/millimeters*acceleration/(60*ACCELERATION_TICKS_PER_SECOND));
+  linear = block;
+
+  settings.jerk = 0.0f;
+  calculate_trapezoid_for_block(&linear, entry_factor, exit_factor);
+  settings.jerk = jerk;
+  calculate_trapezoid_for_block(&block, entry_factor, exit_factor);
+  scurve_checked++;
+
+  // The step indices are rounded outward, by less than a step event each. The rate reached one step
+  // event before the end of acceleration must be within reach of the deceleration one step longer.
+  float nominal_rate = plan_get_nominal_rate(&block);
+  uint32_t decelerate_steps = step_event_count-block.decelerate_after;
+  float peak_rate = plan_get_ramp_rate(&block, block.initial_rate, block.accelerate_until);
+  float least_peak_rate = min(nominal_rate, plan_get_ramp_rate(&block, block.initial_rate,
+                                                                 max(block.accelerate_until,1)-1));
+  float brake_rate = plan_get_ramp_rate(&block, block.final_rate, decelerate_steps+1);
+  uint8_t fail = (block.accelerate_until > block.decelerate_after || block.decelerate_after > step_event_count);
+  if (block.decelerate_after > block.accelerate_until && peak_rate < 0.99999f*nominal_rate) { fail = true; }
+  if (least_peak_rate > block.final_rate && brake_rate < 0.99999f*least_peak_rate) { fail = true; }
+  if (block.decelerate_after > block.accelerate_until &&
+      (block.accelerate_until+1 < linear.accelerate_until || block.decelerate_after > linear.decelerate_after+1)) {
+    fail = true;
+  }
+
+  if (fail && scurve_failed++ < 10) {
+    printf("FAIL S-curve steps %lu mm %.9g speed %.9g acceleration %.9g jerk %.9g entry %.9g exit %.9g\n",
+           (unsigned long)step_event_count, millimeters, nominal_speed, acceleration, jerk, entry_factor,
+           exit_factor);
+    print_block("S-curve", &block);
+    print_block("linear", &linear);
+    printf("  peak %.9g nominal %.9g brake %.9g\n", least_peak_rate, nominal_rate, brake_rate);
+  }
+  settings.jerk = 0.0f;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long n_random = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+  static const float factors[] = { 0.0f, 1e-6f, 0.001f, 0.1f, 0.25f, 0.5f, 0.5f+1e-6f, 0.75f,
+                                   0.999999f, 1.0f };
+  static const uint32_t steps[] = { 1, 2, 3, 10, 250, 4000, 100000, 2000000 };
+  static const float speeds[] = { 1.0f, 25.0f, 500.0f, 6000.0f, 30000.0f };
+  uint8_t i, j, k, l;
+
+  // Edge cases: single step blocks, factors at and next to 0, 0.5 and 1, slow and fast moves
+  for (i=0; i<sizeof(steps)/sizeof(steps[0]); i++) {
+    for (j=0; j<sizeof(speeds)/sizeof(speeds[0]); j++) {
+      for (k=0; k<sizeof(factors)/sizeof(factors[0]); k++) {
+        for (l=0; l<sizeof(factors)/sizeof(factors[0]); l++) {
+          check_block(steps[i], steps[i]/250.0f, speeds[j], 36000.0f, factors[k], factors[l]);
+          check_block(steps[i], steps[i]/40.0f, speeds[j], 3600000.0f, factors[k], factors[l]);
+        }
+      }
+    }
+  }
+
+  // Random blocks over the range of machines and jobs Grbl runs
+  unsigned long n;
+  for (n=0; n<n_random; n++) {
+    uint32_t step_event_count = 1 + random_u32()%(1 + (random_u32()%3 ? 5000 : 500000));
+    float steps_per_mm = random_float(5.0f, 2000.0f);
+    float nominal_speed = random_float(1.0f, 20000.0f);
+    float acceleration = random_float(600.0f, 3600000.0f);
+    float entry_factor = random_float(0.0f, 1.0f);
+    float exit_factor = random_float(0.0f, 1.0f);
+    check_block(step_event_count, step_event_count/steps_per_mm, nominal_speed, acceleration,
+                entry_factor, exit_factor);
+  }
+
+  // S-curve trapezoids over the same range, with jerks from a fraction of a second to a few
+  // milliseconds to full acceleration
+  for (n=0; n<n_random/10; n++) {
+    uint32_t step_event_count = 1 + random_u32()%(1 + (random_u32()%3 ? 5000 : 500000));
+    float steps_per_mm = random_float(5.0f, 2000.0f);
+    float nominal_speed = random_float(1.0f, 20000.0f);
+    float acceleration = random_float(600.0f, 3600000.0f);
+    float jerk = acceleration*60*random_float(2.0f, 500.0f);
+    float millimeters = step_event_count/steps_per_mm;
+    float entry_factor = random_float(0.0f, 1.0f);
+    float exit_factor = random_float(0.0f, 1.0f);
+    // The planner only plans speed changes the block can make
+    settings.jerk = jerk;
+    exit_factor = min(exit_factor,
+      max_allowable_speed(acceleration, entry_factor*nominal_speed, millimeters)/nominal_speed);
+    entry_factor = min(entry_factor,
+      max_allowable_speed(acceleration, exit_factor*nominal_speed, millimeters)/nominal_speed);
+    check_scurve_block(step_event_count, millimeters, nominal_speed, acceleration, jerk, entry_factor,
+                       exit_factor);
+  }
+
+  printf("%lu blocks, %lu failed\n", checked, failed);
+  printf("integer against exact:  step indices off by at most %ld, rates at most %ld step/min low, %ld high\n",
+         worst_exact.index, worst_exact.rate_low, worst_exact.rate_high);
+  printf("integer against float:  step indices off by at most %ld, rates at most %ld step/min low, %ld high"
+         " (%lu blocks within the float range)\n",
+         worst_float.index, worst_float.rate_low, worst_float.rate_high, compared);
+  printf("float against exact:    %lu blocks off\n", float_off);
+  printf("S-curve:                %lu blocks, %lu failed\n", scurve_checked, scurve_failed);
+  return((failed || scurve_failed) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
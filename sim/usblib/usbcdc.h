@@ -0,0 +1,2 @@
+// usblib/usbcdc.h - host stand-in. Everything Grbl uses is declared in sim/tivaware.h.
+#include "../tivaware.h"
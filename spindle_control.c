@@ -24,13 +24,19 @@
   #include "inc/hw_memmap.h"
   #include "driverlib/sysctl.h"
   #include "driverlib/gpio.h"
+  #include "driverlib/pin_map.h"
+  #include "driverlib/timer.h"
 #endif
 
 #include "settings.h"
 #include "spindle_control.h"
 #include "planner.h"
+#include "nuts_bolts.h"
 
-static uint8_t current_direction;
+static int8_t current_direction; // Direction the spindle output is set to
+#ifdef VARIABLE_SPINDLE
+  static uint16_t current_pwm;   // PWM duty cycle the spindle output is set to, in timer counts
+#endif
 
 void spindle_init()
 {
@@ -45,6 +51,22 @@ void spindle_init()
   SysCtlDelay(26); ///give time delay 1 microsecond for GPIO module to start
   GPIOPinTypeGPIOOutput( SPINDLE_DIRECTION_PORT, (1<<SPINDLE_DIRECTION_BIT) );
 
+  #ifdef VARIABLE_SPINDLE
+    // Timer0A counts down the PWM period. The output goes high as it reloads and low at the match
+    // value. The pin starts out as a GPIO held low, for a duty cycle of zero.
+    current_pwm = 0;
+    SysCtlPeripheralEnable( SPINDLE_PWM_TIMER_PERIPH );
+    SysCtlPeripheralEnable( SPINDLE_PWM_PERIPH );
+    SysCtlDelay(26); ///give time delay 1 microsecond for GPIO module to start
+    GPIOPinConfigure( SPINDLE_PWM_PIN_CONFIG );
+    GPIOPinTypeGPIOOutput( SPINDLE_PWM_PORT, (1<<SPINDLE_PWM_BIT) );
+    GPIOPinWrite( SPINDLE_PWM_PORT, (1<<SPINDLE_PWM_BIT), 0 );
+    TimerConfigure( SPINDLE_PWM_TIMER, TIMER_CFG_SPLIT_PAIR|TIMER_CFG_A_PWM );
+    TimerLoadSet( SPINDLE_PWM_TIMER, TIMER_A, SPINDLE_PWM_PERIOD );
+    TimerMatchSet( SPINDLE_PWM_TIMER, TIMER_A, SPINDLE_PWM_PERIOD );
+    TimerEnable( SPINDLE_PWM_TIMER, TIMER_A );
+  #endif
+
   spindle_stop();
 }
 
@@ -52,12 +74,16 @@ void spindle_stop()
 {
   ///SPINDLE_ENABLE_PORT &= ~(1<<SPINDLE_ENABLE_BIT);
   GPIOPinWrite( SPINDLE_ENABLE_PORT, SPINDLE_ENABLE_BIT, 0 );
+  #ifdef VARIABLE_SPINDLE
+    spindle_set_pwm(0);
+  #endif
 }
 
-void spindle_run(int8_t direction) //, uint16_t rpm)
+// Switches the spindle output right away. Called by the stepper interrupt as each block starts, and
+// by the main program while no motion is in progress. Only writes the pins on a change.
+void spindle_set_state(int8_t direction)
 {
   if (direction != current_direction) {
-    plan_synchronize();
     if (direction) {
       if(direction > 0) {
         ///SPINDLE_DIRECTION_PORT &= ~(1<<SPINDLE_DIRECTION_BIT);
@@ -74,3 +100,55 @@ void spindle_run(int8_t direction) //, uint16_t rpm)
     current_direction = direction;
   }
 }
+
+#ifdef VARIABLE_SPINDLE
+
+// Returns the PWM duty cycle in timer counts for a spindle speed in rpm, with the spindle override
+// applied. A running spindle turns at least at the min rpm ($32), the max rpm ($31) is full duty.
+uint16_t spindle_compute_pwm(float rpm)
+{
+  if (rpm <= 0.0f) { return(0); }
+  rpm *= 0.01f*sys.spindle_override;
+  if (rpm < settings.spindle_min_rpm) { rpm = settings.spindle_min_rpm; }
+  if (rpm >= settings.spindle_max_rpm) { return(SPINDLE_PWM_PERIOD); }
+  return(lroundf(SPINDLE_PWM_PERIOD*rpm/settings.spindle_max_rpm));
+}
+
+// Sets the PWM duty cycle in timer counts right away. Called by the stepper interrupt as each step
+// segment starts. Only writes the timer on a change.
+void spindle_set_pwm(uint16_t pwm)
+{
+  if (pwm != current_pwm) {
+    if (pwm == 0) {
+      // A match at the load value still leaves a glitch each period. Hold the pin low instead.
+      GPIOPinTypeGPIOOutput( SPINDLE_PWM_PORT, (1<<SPINDLE_PWM_BIT) );
+      GPIOPinWrite( SPINDLE_PWM_PORT, (1<<SPINDLE_PWM_BIT), 0 );
+    } else {
+      TimerMatchSet( SPINDLE_PWM_TIMER, TIMER_A, SPINDLE_PWM_PERIOD-pwm );
+      if (current_pwm == 0) { GPIOPinTypeTimer( SPINDLE_PWM_PORT, (1<<SPINDLE_PWM_BIT) ); }
+    }
+    current_pwm = pwm;
+  }
+}
+
+#endif
+
+// Switches the spindle right away, while no motion is in progress. In laser mode the laser only
+// fires along with motion, so its power stays off until the next move.
+void spindle_apply(int8_t direction, float rpm)
+{
+  spindle_set_state(direction);
+  #ifdef VARIABLE_SPINDLE
+    if (direction && bit_isfalse(settings.flags,BITFLAG_LASER_MODE)) { spindle_set_pwm(spindle_compute_pwm(rpm)); }
+    else { spindle_set_pwm(0); }
+  #endif
+}
+
+// Sets the spindle for the motion programmed from now on. The planner carries the direction and
+// speed with each block, so the buffered motion keeps running. With nothing buffered or moving, the
+// spindle switches right away; otherwise when the next block starts, or at the end of the cycle.
+void spindle_run(int8_t direction, float rpm)
+{
+  plan_set_spindle(direction, rpm);
+  if (plan_get_current_block() == NULL && sys.state != STATE_CYCLE) { spindle_apply(direction, rpm); }
+}
@@ -22,8 +22,24 @@
 #ifndef spindle_control_h
 #define spindle_control_h
 
+#include "nuts_bolts.h"
+
+#ifdef VARIABLE_SPINDLE
+  #define SPINDLE_PWM_PERIOD (F_CPU/SPINDLE_PWM_FREQUENCY) // Timer counts of a PWM period
+  #if SPINDLE_PWM_PERIOD > 0xffff
+    #error "SPINDLE_PWM_FREQUENCY too low for the 16 bit PWM timer"
+  #endif
+#endif
+
 void spindle_init();
-void spindle_run(int8_t direction); //, uint16_t rpm);
+void spindle_run(int8_t direction, float rpm);
+void spindle_apply(int8_t direction, float rpm);
+void spindle_set_state(int8_t direction);
 void spindle_stop();
 
+#ifdef VARIABLE_SPINDLE
+  uint16_t spindle_compute_pwm(float rpm);
+  void spindle_set_pwm(uint16_t pwm);
+#endif
+
 #endif
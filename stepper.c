@@ -31,36 +31,117 @@
 #include "driverlib/sysctl.h"
 #include "driverlib/timer.h"
 #include "driverlib/gpio.h"
+#ifdef STEP_PULSE_DMA
+  #include "inc/hw_gpio.h"
+  #include "inc/hw_timer.h"
+  #include "driverlib/udma.h"
+#endif
 
 #include "stepper.h"
 #include "config.h"
 #include "settings.h"
 #include "planner.h"
+#include "spindle_control.h"
+#include "coolant_control.h"
+#include "profile.h"
 
 // Some useful constants
 #define TICKS_PER_MICROSECOND (F_CPU/1000000) ///16 on avr, 80 on arm
 ///#define CYCLES_PER_ACCELERATION_TICK (F_CPU/ACCELERATION_TICKS_PER_SECOND)
 #define CYCLES_PER_ACCELERATION_TICK ((TICKS_PER_MICROSECOND*1000000)/ACCELERATION_TICKS_PER_SECOND) ///320000 on AVR, same on ARM
+#define DWELL_CYCLES_PER_STEP_EVENT (F_CPU/DWELL_STEP_EVENTS_PER_SECOND)
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+  #define AMASS_CYCLES_CUTOFF (F_CPU/AMASS_CUTOFF_FREQUENCY) // Step period above which AMASS engages
+#endif
+
+// Stepper block data. The segment preparation copies the Bresenham data of each planner block
+// here, so that the planner may discard the block as soon as it is fully segmented, while the
+// stepper interrupt is still tracing it. With AMASS, the step counts are pre-scaled by the
+// maximum AMASS level, so the interrupt can scale them down to any level with a bit shift.
+typedef struct {
+  uint32_t direction_bits;            // The direction bit set for this block
+  uint32_t steps_x, steps_y, steps_z; // Step count along each axis
+  uint32_t step_event_count;          // The number of step events of the original block
+  int8_t spindle_direction;           // Spindle and coolant during the block, switched as it starts
+  uint8_t coolant_mode;
+} st_block_t;
+
+// Step segment. A short, fixed-time piece of a block, stepped at a constant rate. The segment
+// preparation computes the step timer reload value ahead of time, so the stepper interrupt
+// only loads it.
+typedef struct {
+  uint32_t cycles_per_step_event; // The number of machine cycles between each step event
+  uint32_t n_step;                // The number of stepper interrupts in this segment
+  uint8_t st_block_index;         // Index of the stepper block data traced by this segment
+  float feed_rate;                // Speed of the segment (mm/min), for the status report
+  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    uint8_t amass_level;          // The interrupt over-drive of this segment, as a power of two
+  #endif
+  #ifdef VARIABLE_SPINDLE
+    uint16_t spindle_pwm;         // Spindle PWM duty cycle during this segment, in timer counts
+  #endif
+} segment_t;
 
-// Stepper state variable. Contains running data and trapezoid variables.
+// Stepper state variable. Contains running data of the stepper interrupt.
 typedef struct {
   // Used by the bresenham line algorithm
   int32_t counter_x,        // Counter variables for the bresenham line tracer
           counter_y,
           counter_z;
-  uint32_t event_count;
-  uint32_t step_events_completed;  // The number of step events left in current motion
-
-  // Used by the trapezoid generator
-  uint32_t cycles_per_step_event;        // The number of machine cycles between each step event
-  uint32_t trapezoid_tick_cycle_counter; // The cycles since last trapezoid_tick. Used to generate ticks at a steady
-                                              // pace without allocating a separate timer
-  uint32_t trapezoid_adjusted_rate;      // The current rate of step_events according to the trapezoid generator
-  uint32_t min_safe_rate;  // Minimum safe rate for full deceleration rate reduction step. Otherwise halves step_rate.
+  uint32_t steps_x,         // Counter increments of the current segment
+           steps_y,
+           steps_z;
+  uint32_t segment_steps;   // The number of stepper interrupts left in the current segment
+  uint32_t cycles_per_step_event; // The number of machine cycles between each stepper interrupt
+  st_block_t *exec_block;   // Pointer to the stepper block data being traced
+  float feed_rate;          // Speed of the current segment (mm/min). Zero when stopped.
+  uint32_t block_count;     // The number of blocks started since reset
 } stepper_t;
 
 static stepper_t st;
-static block_t *current_block;  // A pointer to the block currently being traced
+
+// Sequence count of the machine state published by the stepper interrupt: sys.position and the
+// feed rate and block count in st. Advanced after every change. The interrupt is never interrupted
+// by the main program, so a copy taken between two equal readings of the count is consistent.
+static volatile uint32_t snapshot_sequence;
+
+// True when the feed hold deceleration has been fully segmented. Set by the segment preparation,
+// read by the stepper interrupt to tell the end of the hold from a late preparation.
+static volatile uint8_t hold_complete;
+
+// Homing motion. The stepper interrupt reads the limit pins on every step event of it.
+static volatile uint8_t homing_axes;    // Axes still looking for their limit switch state (bit per axis)
+static uint8_t homing_invert;           // LIMIT_MASK when leaving the switches, zero when approaching
+static volatile uint8_t homing_running; // True until the homing motion has stopped
+
+// Segment preparation state. Only used by the main program.
+typedef struct {
+  uint8_t st_block_index;         // Index of the stepper block data of the block being segmented
+  uint8_t block_loaded;           // True when the planner tail block is being segmented
+  uint32_t step_events_completed; // The number of step events of the planner block segmented so far
+  float current_rate;             // The step rate at the end of the last segment (step/min)
+  float exit_speed;               // Speed above its final rate the last block ended at, or zero (mm/min)
+
+  // S-curve ramp in progress, when settings.jerk is set
+  uint8_t ramp;                   // Trapezoid section of the ramp. RAMP_NONE if there is none.
+  float ramp_start_rate;          // Step rate at the start of the ramp (step/min)
+  float ramp_end_rate;            // Step rate at the end of the ramp (step/min)
+  float ramp_ticks;               // Duration of the ramp in acceleration ticks
+  float ramp_time;                // Acceleration ticks since the start of the ramp
+  float ramp_corner;              // Fraction of the ramp duration at either end spent changing acceleration
+} st_prep_t;
+
+#define RAMP_NONE 0
+#define RAMP_ACCEL 1
+#define RAMP_DECEL 2
+
+static st_prep_t prep;
+
+static st_block_t st_block_buffer[SEGMENT_BUFFER_SIZE];
+static segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
+static volatile uint8_t segment_buffer_tail;
+static volatile uint8_t segment_buffer_head;
+static uint8_t segment_next_head;
 
 // Used by the stepper driver interrupt
 ///static uint8_t step_pulse_time; // Step pulse reset time after step rise
@@ -68,10 +149,43 @@ static uint32_t step_pulse_time; // Step pulse reset time after step rise
 static uint32_t out_bits;        // The next stepping-bits to be output
 static volatile uint8_t busy;   // True when SIG_OUTPUT_COMPARE1A is being serviced. Used to avoid retriggering that handler.
 
+#if defined(ISR_PROFILE) && !defined(STEP_PULSE_DMA)
+  static uint32_t step_timer_load; // Period last given to config_step_timer()
+#endif
+
 #if STEP_PULSE_DELAY > 0
   static uint8_t step_bits;  // Stores out_bits output to complete the step pulse delay
 #endif
 
+#ifdef STEP_PULSE_DMA
+  // Port word ring streamed to the stepping port by the uDMA. Each Timer2 timeout requests the
+  // uDMA to write the port word of the next entry and then the timer load value stored with it.
+  // The load value only takes effect at the following timeout, so every entry holds the duration
+  // of the entry after it. Timer1 refills the ring at a fixed, low rate with the same bresenham
+  // tracer the stepper driver interrupt uses otherwise. Step pulses end by a port word of their
+  // own, so there is no port reset interrupt. The ring is filled only two service periods ahead,
+  // so feed holds still take effect within a millisecond.
+  #define STEP_DMA_CHANNEL 4 // Timer2A requests, uDMA channel 4 encoding 1
+  #define STEP_DMA_TASKS (2*STEP_DMA_RING_SIZE+1) // Two tasks per entry, one to restart the list
+  #define STEP_DMA_IDLE_CYCLES (F_CPU/(8*STEP_DMA_SERVICE_FREQUENCY)) // Port word time while waiting
+  #define STEP_DMA_LOOKAHEAD_CYCLES (2*F_CPU/STEP_DMA_SERVICE_FREQUENCY) // Ring fill limit in time
+  typedef struct {
+    uint32_t port;  // Stepping port word
+    uint32_t load;  // Timer2 load value, the duration of the next entry
+  } step_word_t;
+
+  static step_word_t step_ring[STEP_DMA_RING_SIZE];
+  static uint8_t step_ring_head;   // Next entry to write
+  static uint8_t step_ring_tail;   // Next entry the uDMA writes, as of the last refill
+  static uint8_t step_ring_drain;  // Entries left until the last step is out. Zero while stepping.
+  static uint32_t step_ring_cycles; // Time until the uDMA reaches the head entry, as of the last refill
+  static uint32_t step_ring_last;   // Duration of the head entry. Its load value is not known yet.
+  static uint32_t step_pulse_cycles;
+  static tDMAControlTable step_task_list[STEP_DMA_TASKS];
+  static tDMAControlTable step_task_restart; // Copy of the primary control structure of the list
+  static tDMAControlTable dma_control_table[64] __attribute__ ((aligned(1024)));
+#endif
+
 //         __________________________
 //        /|                        |\     _________________         ^
 //       / |                        | \   /|               |\        |
@@ -86,15 +200,26 @@ static volatile uint8_t busy;   // True when SIG_OUTPUT_COMPARE1A is being servi
 //  The trapezoid is the shape the speed curve over time. It starts at block->initial_rate, accelerates by block->rate_delta
 //  during the first block->accelerate_until step_events_completed, then keeps going at constant speed until
 //  step_events_completed reaches block->decelerate_after after which it decelerates until the trapezoid generator is reset.
-//  The slope of acceleration is always +/- block->rate_delta and is applied at a constant rate following the midpoint rule
-//  by the trapezoid generator, which is called ACCELERATION_TICKS_PER_SECOND times per second.
+//  The slope of acceleration is always +/- block->rate_delta per acceleration tick. The segment preparation in the main
+//  program cuts the trapezoid into segments of one acceleration tick each, stepped at the midpoint rate of the segment.
+
+#ifdef STEP_PULSE_DMA
+  static void step_ring_start();
+#else
+  static uint32_t config_step_timer(uint32_t cycles);
+#endif
 
-static void set_step_events_per_minute(uint32_t steps_per_minute);
+// Results of a stepper interrupt tick
+#define ST_EVENT_STEP 0 // A step event of the current segment was traced
+#define ST_EVENT_WAIT 1 // No segment prepared yet. The planner still has blocks.
+#define ST_EVENT_DONE 2 // Nothing more to step. Cycle or feed hold complete.
 
 // Stepper state initialization. Cycle should only start if the st.cycle_start flag is
 // enabled. Startup init and limits call this function but shouldn't start the cycle.
 void st_wake_up()
 {
+  // Cancel a pending stepper idle lock timeout
+  TimerDisable( TIMER3_BASE, TIMER_A );
   // Enable steppers by resetting the stepper disable port
   if (bit_istrue(settings.flags,BITFLAG_INVERT_ST_ENABLE)) {
 ///    STEPPERS_DISABLE_PORT |= (1<<STEPPERS_DISABLE_BIT);
@@ -103,7 +228,7 @@ void st_wake_up()
 ///    STEPPERS_DISABLE_PORT &= ~(1<<STEPPERS_DISABLE_BIT);
     GPIOPinWrite( STEPPERS_DISABLE_PORT, STEPPERS_DISABLE_BIT, 0x00 );
   }
-  if (sys.state == STATE_CYCLE) {
+  if (sys.state == STATE_CYCLE || sys.state == STATE_HOMING) {
     // Initialize stepper output bits
     out_bits = (0) ^ (settings.invert_mask);
     // Initialize step pulse timing from settings. Here to ensure updating after re-writing.
@@ -118,10 +243,29 @@ void st_wake_up()
       ///step_pulse_time = -(((settings.pulse_microseconds-2)*TICKS_PER_MICROSECOND) >> 3);
       step_pulse_time = ( settings.pulse_microseconds - 2 ) * TICKS_PER_MICROSECOND;
     #endif
-    // Enable stepper driver interrupt
-    ///TIMSK1 |= (1<<OCIE1A);
-    TimerLoadSet( TIMER2_BASE, TIMER_A, step_pulse_time );
-    TimerEnable( TIMER1_BASE, TIMER_A );
+    #ifdef STEP_PULSE_DMA
+      step_ring_start();
+    #else
+      #ifdef ISR_PROFILE
+        profile_step_restart();
+      #endif
+      // Enable stepper driver interrupt
+      ///TIMSK1 |= (1<<OCIE1A);
+      TimerLoadSet( TIMER2_BASE, TIMER_A, step_pulse_time );
+      TimerEnable( TIMER1_BASE, TIMER_A );
+    #endif
+  }
+}
+
+// Sets the stepper disable port
+static void st_disable_steppers()
+{
+  if (bit_istrue(settings.flags,BITFLAG_INVERT_ST_ENABLE)) {
+///    STEPPERS_DISABLE_PORT &= ~(1<<STEPPERS_DISABLE_BIT);
+    GPIOPinWrite( STEPPERS_DISABLE_PORT, STEPPERS_DISABLE_BIT, 0 );
+  } else {
+///    STEPPERS_DISABLE_PORT |= (1<<STEPPERS_DISABLE_BIT);
+    GPIOPinWrite( STEPPERS_DISABLE_PORT, STEPPERS_DISABLE_BIT, 0xFF );
   }
 }
 
@@ -133,47 +277,184 @@ void st_go_idle()
   /// If we disable interrupt, the timer will continue to work. When you will switch on it again, what value will it have?
   ///Maybe it is better to disconnect the clock source?
   TimerDisable( TIMER1_BASE, TIMER_A );
+  #ifdef STEP_PULSE_DMA
+    // Stop the port word stream. Any words still in the ring are dropped.
+    TimerDisable( TIMER2_BASE, TIMER_A );
+    uDMAChannelDisable( STEP_DMA_CHANNEL );
+  #endif
   /// No function to write value into the timer, though the timer supports this! Texas Instruments, are you crazy?
 ///todo  HWREG( TIMER0_BASE + 0x0050 ) = (uint32_t) 0;
+  homing_running = false;
   // Disable steppers only upon system alarm activated or by user setting to not be kept enabled.
-  if ((settings.stepper_idle_lock_time != 0xff) || bit_istrue(sys.execute,EXEC_ALARM)) {
+  // The homing cycle keeps them enabled between its motions.
+  if ((settings.stepper_idle_lock_time != 0xff && sys.state != STATE_HOMING) || bit_istrue(sys.execute,EXEC_ALARM)) {
     // Force stepper dwell to lock axes for a defined amount of time to ensure the axes come to a complete
     // stop and not drift from residual inertial forces at the end of the last movement.
-    delay_ms(settings.stepper_idle_lock_time);
-    if (bit_istrue(settings.flags,BITFLAG_INVERT_ST_ENABLE)) {
-///      STEPPERS_DISABLE_PORT &= ~(1<<STEPPERS_DISABLE_BIT);
-      GPIOPinWrite( STEPPERS_DISABLE_PORT, STEPPERS_DISABLE_BIT, 0 );
+    // NOTE: Timed by Timer3 rather than a delay. This usually runs inside the stepper interrupt,
+    // which would hold off the serial receive interrupt for the whole dwell.
+    if (settings.stepper_idle_lock_time == 0) {
+      st_disable_steppers();
     } else {
-///      STEPPERS_DISABLE_PORT |= (1<<STEPPERS_DISABLE_BIT);
-      GPIOPinWrite( STEPPERS_DISABLE_PORT, STEPPERS_DISABLE_BIT, 0xFF );
+      TimerLoadSet( TIMER3_BASE, TIMER_A, settings.stepper_idle_lock_time*(F_CPU/1000) );
+      TimerEnable( TIMER3_BASE, TIMER_A );
     }
   }
 }
 
-// This function determines an acceleration velocity change every CYCLES_PER_ACCELERATION_TICK by
-// keeping track of the number of elapsed cycles during a de/ac-celeration. The code assumes that
-// step_events occur significantly more often than the acceleration velocity iterations.
-inline static uint8_t iterate_trapezoid_cycle_counter()
+// Disables the stepper drivers at the end of the stepper idle lock time
+void timer3_idle_lock_interrupt( void )
 {
-  st.trapezoid_tick_cycle_counter += st.cycles_per_step_event;
-  if(st.trapezoid_tick_cycle_counter > CYCLES_PER_ACCELERATION_TICK) {
-    st.trapezoid_tick_cycle_counter -= CYCLES_PER_ACCELERATION_TICK;
-    return(true);
-  } else {
-    return(false);
+  TimerIntClear( TIMER3_BASE, TIMER_TIMA_TIMEOUT ); /// clear interrupt flag
+  st_disable_steppers();
+}
+
+// Stops the homing axes whose limit pin reads the state they look for, latching their position, and
+// keeps the stopped axes from stepping on. Returns true once all of them have stopped.
+// NOTE: With STEP_PULSE_DMA, this runs as the ring is filled. The steps already in the ring still
+// go out, so an axis stops up to STEP_DMA_LOOKAHEAD_CYCLES after its switch.
+static uint8_t st_homing_check()
+{
+  uint32_t limit_state = GPIOPinRead( LIMIT_PORT, LIMIT_MASK ) ^ homing_invert; // Low on the switch
+  if ((homing_axes & (1<<X_AXIS)) && !(limit_state & (1<<X_LIMIT_BIT))) {
+    homing_axes &= ~(1<<X_AXIS);
+    sys.homing_latch[X_AXIS] = sys.position[X_AXIS];
+  }
+  if ((homing_axes & (1<<Y_AXIS)) && !(limit_state & (1<<Y_LIMIT_BIT))) {
+    homing_axes &= ~(1<<Y_AXIS);
+    sys.homing_latch[Y_AXIS] = sys.position[Y_AXIS];
+  }
+  if ((homing_axes & (1<<Z_AXIS)) && !(limit_state & (1<<Z_LIMIT_BIT))) {
+    homing_axes &= ~(1<<Z_AXIS);
+    sys.homing_latch[Z_AXIS] = sys.position[Z_AXIS];
+  }
+  if (!(homing_axes & (1<<X_AXIS))) { st.steps_x = 0; }
+  if (!(homing_axes & (1<<Y_AXIS))) { st.steps_y = 0; }
+  if (!(homing_axes & (1<<Z_AXIS))) { st.steps_z = 0; }
+  return(homing_axes == 0);
+}
+
+// Traces one stepper interrupt tick by the bresenham line algorithm, popping the next step segment
+// from the segment_buffer when the current one is finished. Leaves the direction and step bits of
+// the tick in out_bits, not yet inverted. Returns whether the tick stepped, is waiting for the
+// segment preparation, or there is nothing left to step.
+inline static uint8_t st_step_event()
+{
+  // If the current segment is finished, attempt to pop the next one from the segment buffer
+  if (st.segment_steps == 0) {
+    if (segment_buffer_head != segment_buffer_tail) {
+      segment_t *segment = &segment_buffer[segment_buffer_tail];
+      st.cycles_per_step_event = segment->cycles_per_step_event;
+      #ifndef STEP_PULSE_DMA
+        config_step_timer(st.cycles_per_step_event);
+      #endif
+      st.segment_steps = segment->n_step;
+      // Initialize the bresenham line tracer when the segment starts a new block. Segments of
+      // a block resumed after a feed hold keep the same stepper block and counters.
+      if (st.exec_block != &st_block_buffer[segment->st_block_index]) {
+        st.exec_block = &st_block_buffer[segment->st_block_index];
+        st.block_count++;
+        st.counter_x = -(st.exec_block->step_event_count >> 1);
+        st.counter_y = st.counter_x;
+        st.counter_z = st.counter_x;
+        // Switch the spindle and coolant with the block, in step with the motion. With STEP_PULSE_DMA
+        // this runs as the ring is filled, up to STEP_DMA_LOOKAHEAD_CYCLES early.
+        spindle_set_state(st.exec_block->spindle_direction);
+        coolant_set_state(st.exec_block->coolant_mode);
+      }
+      #ifdef VARIABLE_SPINDLE
+        spindle_set_pwm(segment->spindle_pwm);
+      #endif
+      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        // Scale the counter increments down by the segment level. The interrupt runs that much
+        // more often, so every axis steps at the same average rate as without AMASS.
+        st.steps_x = st.exec_block->steps_x >> segment->amass_level;
+        st.steps_y = st.exec_block->steps_y >> segment->amass_level;
+        st.steps_z = st.exec_block->steps_z >> segment->amass_level;
+      #else
+        st.steps_x = st.exec_block->steps_x;
+        st.steps_y = st.exec_block->steps_y;
+        st.steps_z = st.exec_block->steps_z;
+      #endif
+      st.feed_rate = segment->feed_rate;
+      uint8_t tail = segment_buffer_tail + 1;
+      if (tail == SEGMENT_BUFFER_SIZE) { tail = 0; }
+      segment_buffer_tail = tail;
+    } else {
+      out_bits = (st.exec_block != NULL) ? st.exec_block->direction_bits : 0; // Hold the direction pins
+      #ifdef VARIABLE_SPINDLE
+        // A laser standing still would burn through. A spindle keeps turning.
+        if (bit_istrue(settings.flags,BITFLAG_LASER_MODE)) { spindle_set_pwm(0); }
+      #endif
+      // Nothing more to step, if either the feed hold deceleration or the program is complete.
+      // Otherwise the segment preparation is running late and the steppers wait for it, also
+      // while it is still segmenting the hold deceleration.
+      if ((sys.state == STATE_HOLD && hold_complete) || plan_get_current_block() == NULL) {
+        st.feed_rate = 0;
+        snapshot_sequence++;
+        return(ST_EVENT_DONE);
+      }
+      return(ST_EVENT_WAIT);
+    }
+  }
+
+  // Stop the homing axes that found their switch state before they step again. The remaining
+  // homing motion is dropped once they all have.
+  if (sys.state == STATE_HOMING && st_homing_check()) {
+    out_bits = st.exec_block->direction_bits;
+    st.feed_rate = 0;
+    snapshot_sequence++;
+    return(ST_EVENT_DONE);
   }
+
+  // Execute step displacement profile by bresenham line algorithm
+  out_bits = st.exec_block->direction_bits;
+  st.counter_x += st.steps_x;
+  if (st.counter_x > 0) {
+    out_bits |= (1<<X_STEP_BIT);
+    st.counter_x -= st.exec_block->step_event_count;
+    if (out_bits & (1<<X_DIRECTION_BIT)) { sys.position[X_AXIS]--; }
+    else { sys.position[X_AXIS]++; }
+  }
+  st.counter_y += st.steps_y;
+  if (st.counter_y > 0) {
+    out_bits |= (1<<Y_STEP_BIT);
+    st.counter_y -= st.exec_block->step_event_count;
+    if (out_bits & (1<<Y_DIRECTION_BIT)) { sys.position[Y_AXIS]--; }
+    else { sys.position[Y_AXIS]++; }
+  }
+  st.counter_z += st.steps_z;
+  if (st.counter_z > 0) {
+    out_bits |= (1<<Z_STEP_BIT);
+    st.counter_z -= st.exec_block->step_event_count;
+    if (out_bits & (1<<Z_DIRECTION_BIT)) { sys.position[Z_AXIS]--; }
+    else { sys.position[Z_AXIS]++; }
+  }
+  st.segment_steps--;
+  snapshot_sequence++;
+  return(ST_EVENT_STEP);
 }
 
+#ifndef STEP_PULSE_DMA
+
 // "The Stepper Driver Interrupt" - This timer interrupt is the workhorse of Grbl. It is executed at the rate set with
-// config_step_timer. It pops blocks from the block_buffer and executes them by pulsing the stepper pins appropriately.
+// config_step_timer. It pops step segments from the segment_buffer and executes them by pulsing the stepper pins
+// appropriately. All rate computations are done ahead of time by st_prep_buffer() in the main program.
 // It is supported by The Stepper Port Reset Interrupt which it uses to reset the stepper port after each pulse.
 // The bresenham line tracer algorithm controls all three stepper outputs simultaneously with these two interrupts.
 ///ISR(TIMER1_COMPA_vect)
 void timer1_compare_interrupt( void )
 {
+  PROFILE_START(profile_entry);
   TimerIntClear( TIMER1_BASE, TIMER_TIMA_TIMEOUT ); /// clear interrupt flag
+  #ifdef ISR_PROFILE
+    profile_step_entry(profile_entry, step_timer_load);
+  #endif
 
-  if (busy) { return; } // The busy-flag is used to avoid reentering this interrupt
+  // The busy-flag is used to avoid reentering this interrupt. The overrun still counts in the profile.
+  if (busy) {
+    PROFILE_END(profile_entry, PROFILE_STEP);
+    return;
+  }
 
   // Set the direction pins a couple of nanoseconds before we step the steppers
   ///STEPPING_PORT = (STEPPING_PORT & ~DIRECTION_MASK) | (out_bits & DIRECTION_MASK);
@@ -201,149 +482,13 @@ void timer1_compare_interrupt( void )
   ///sei();
 ///  IntMasterEnable();
 
-  // If there is no current block, attempt to pop one from the buffer
-  if (current_block == NULL) {
-    // Anything in the buffer? If so, initialize next motion.
-    current_block = plan_get_current_block();
-    if (current_block != NULL) {
-      if (sys.state == STATE_CYCLE) {
-        // During feed hold, do not update rate and trap counter. Keep decelerating.
-        st.trapezoid_adjusted_rate = current_block->initial_rate;
-        set_step_events_per_minute(st.trapezoid_adjusted_rate); // Initialize cycles_per_step_event
-        st.trapezoid_tick_cycle_counter = CYCLES_PER_ACCELERATION_TICK/2; // Start halfway for midpoint rule.
-      }
-      st.min_safe_rate = current_block->rate_delta + (current_block->rate_delta >> 1); // 1.5 x rate_delta
-      st.counter_x = -(current_block->step_event_count >> 1);
-      st.counter_y = st.counter_x;
-      st.counter_z = st.counter_x;
-      st.event_count = current_block->step_event_count;
-      st.step_events_completed = 0;
-    } else {
-      st_go_idle();
-      bit_true(sys.execute,EXEC_CYCLE_STOP); // Flag main program for cycle end
-    }
-  }
-
-  if (current_block != NULL) {
-    // Execute step displacement profile by bresenham line algorithm
-    out_bits = current_block->direction_bits;
-    st.counter_x += current_block->steps_x;
-    if (st.counter_x > 0) {
-      out_bits |= (1<<X_STEP_BIT);
-      st.counter_x -= st.event_count;
-      if (out_bits & (1<<X_DIRECTION_BIT)) { sys.position[X_AXIS]--; }
-      else { sys.position[X_AXIS]++; }
-    }
-    st.counter_y += current_block->steps_y;
-    if (st.counter_y > 0) {
-      out_bits |= (1<<Y_STEP_BIT);
-      st.counter_y -= st.event_count;
-      if (out_bits & (1<<Y_DIRECTION_BIT)) { sys.position[Y_AXIS]--; }
-      else { sys.position[Y_AXIS]++; }
-    }
-    st.counter_z += current_block->steps_z;
-    if (st.counter_z > 0) {
-      out_bits |= (1<<Z_STEP_BIT);
-      st.counter_z -= st.event_count;
-      if (out_bits & (1<<Z_DIRECTION_BIT)) { sys.position[Z_AXIS]--; }
-      else { sys.position[Z_AXIS]++; }
-    }
-
-    st.step_events_completed++; // Iterate step events
-
-    // While in block steps, check for de/ac-celeration events and execute them accordingly.
-    if (st.step_events_completed < current_block->step_event_count) {
-      if (sys.state == STATE_HOLD) {
-        // Check for and execute feed hold by enforcing a steady deceleration from the moment of
-        // execution. The rate of deceleration is limited by rate_delta and will never decelerate
-        // faster or slower than in normal operation. If the distance required for the feed hold
-        // deceleration spans more than one block, the initial rate of the following blocks are not
-        // updated and deceleration is continued according to their corresponding rate_delta.
-        // NOTE: The trapezoid tick cycle counter is not updated intentionally. This ensures that
-        // the deceleration is smooth regardless of where the feed hold is initiated and if the
-        // deceleration distance spans multiple blocks.
-        if ( iterate_trapezoid_cycle_counter() ) {
-          // If deceleration complete, set system flags and shutdown steppers.
-          if (st.trapezoid_adjusted_rate <= current_block->rate_delta) {
-            // Just go idle. Do not NULL current block. The bresenham algorithm variables must
-            // remain intact to ensure the stepper path is exactly the same. Feed hold is still
-            // active and is released after the buffer has been reinitialized.
-            st_go_idle();
-            bit_true(sys.execute,EXEC_CYCLE_STOP); // Flag main program that feed hold is complete.
-          } else {
-            st.trapezoid_adjusted_rate -= current_block->rate_delta;
-            set_step_events_per_minute(st.trapezoid_adjusted_rate);
-          }
-        }
-
-      } else {
-        // The trapezoid generator always checks step event location to ensure de/ac-celerations are
-        // executed and terminated at exactly the right time. This helps prevent over/under-shooting
-        // the target position and speed.
-        // NOTE: By increasing the ACCELERATION_TICKS_PER_SECOND in config.h, the resolution of the
-        // discrete velocity changes increase and accuracy can increase as well to a point. Numerical
-        // round-off errors can effect this, if set too high. This is important to note if a user has
-        // very high acceleration and/or feedrate requirements for their machine.
-        if (st.step_events_completed < current_block->accelerate_until) {
-          // Iterate cycle counter and check if speeds need to be increased.
-          if ( iterate_trapezoid_cycle_counter() ) {
-            st.trapezoid_adjusted_rate += current_block->rate_delta;
-            if (st.trapezoid_adjusted_rate >= current_block->nominal_rate) {
-              // Reached nominal rate a little early. Cruise at nominal rate until decelerate_after.
-              st.trapezoid_adjusted_rate = current_block->nominal_rate;
-            }
-            set_step_events_per_minute(st.trapezoid_adjusted_rate);
-          }
-        } else if (st.step_events_completed >= current_block->decelerate_after) {
-          // Reset trapezoid tick cycle counter to make sure that the deceleration is performed the
-          // same every time. Reset to CYCLES_PER_ACCELERATION_TICK/2 to follow the midpoint rule for
-          // an accurate approximation of the deceleration curve. For triangle profiles, down count
-          // from current cycle counter to ensure exact deceleration curve.
-          if (st.step_events_completed == current_block->decelerate_after) {
-            if (st.trapezoid_adjusted_rate == current_block->nominal_rate) {
-              st.trapezoid_tick_cycle_counter = CYCLES_PER_ACCELERATION_TICK/2; // Trapezoid profile
-            } else {
-              st.trapezoid_tick_cycle_counter = CYCLES_PER_ACCELERATION_TICK-st.trapezoid_tick_cycle_counter; // Triangle profile
-            }
-          } else {
-            // Iterate cycle counter and check if speeds need to be reduced.
-            if ( iterate_trapezoid_cycle_counter() ) {
-              // NOTE: We will only do a full speed reduction if the result is more than the minimum safe
-              // rate, initialized in trapezoid reset as 1.5 x rate_delta. Otherwise, reduce the speed by
-              // half increments until finished. The half increments are guaranteed not to exceed the
-              // CNC acceleration limits, because they will never be greater than rate_delta. This catches
-              // small errors that might leave steps hanging after the last trapezoid tick or a very slow
-              // step rate at the end of a full stop deceleration in certain situations. The half rate
-              // reductions should only be called once or twice per block and create a nice smooth
-              // end deceleration.
-              if (st.trapezoid_adjusted_rate > st.min_safe_rate) {
-                st.trapezoid_adjusted_rate -= current_block->rate_delta;
-              } else {
-                st.trapezoid_adjusted_rate >>= 1; // Bit shift divide by 2
-              }
-              if (st.trapezoid_adjusted_rate < current_block->final_rate) {
-                // Reached final rate a little early. Cruise to end of block at final rate.
-                st.trapezoid_adjusted_rate = current_block->final_rate;
-              }
-              set_step_events_per_minute(st.trapezoid_adjusted_rate);
-            }
-          }
-        } else {
-          // No accelerations. Make sure we cruise exactly at the nominal rate.
-          if (st.trapezoid_adjusted_rate != current_block->nominal_rate) {
-            st.trapezoid_adjusted_rate = current_block->nominal_rate;
-            set_step_events_per_minute(st.trapezoid_adjusted_rate);
-          }
-        }
-      }
-    } else {
-      // If current block is finished, reset pointer
-      current_block = NULL;
-      plan_discard_current_block();
-    }
+  if (st_step_event() == ST_EVENT_DONE) {
+    st_go_idle();
+    bit_true(sys.execute,EXEC_CYCLE_STOP); // Flag main program for cycle end
   }
   out_bits ^= settings.invert_mask;  // Apply step and direction invert mask
   busy = false;
+  PROFILE_END(profile_entry, PROFILE_STEP);
 }
 
 // This interrupt is set up by ISR_TIMER1_COMPA when it sets the motor port bits. It resets
@@ -355,6 +500,7 @@ void timer1_compare_interrupt( void )
 ///ISR(TIMER2_OVF_vect)
 void timer2_overflow_interrupt( void )
 {
+  PROFILE_START(profile_entry);
   TimerIntClear( TIMER2_BASE, TIMER_TIMA_TIMEOUT ); /// clear interrupt flag
 
   // Reset stepping pins (leave the direction pins)
@@ -363,6 +509,7 @@ void timer2_overflow_interrupt( void )
   ///TCCR2B = 0; // Disable Timer2 to prevent re-entering this interrupt when it's not needed.
 //  TimerDisable( TIMER0_BASE, TIMER_B );
   ///HWREG( TIMER0_BASE + 0x054 ) = (uint32_t) 0;
+  PROFILE_END(profile_entry, PROFILE_STEP_RESET);
 }
 
 #ifdef STEP_PULSE_DELAY
@@ -379,12 +526,114 @@ void timer2_compare_interrupt ( void )
 }
 #endif
 
+#else // STEP_PULSE_DMA
+
+// Appends a port word, lasting the given number of cycles, to the port word ring. This completes the
+// previous entry, which the uDMA must not reach before.
+static void step_ring_put(uint32_t port, uint32_t cycles)
+{
+  uint8_t previous = (step_ring_head == 0) ? STEP_DMA_RING_SIZE-1 : step_ring_head-1;
+  step_ring[previous].load = cycles;
+  step_ring[step_ring_head].port = port;
+  step_ring_cycles += step_ring_last;
+  step_ring_last = cycles;
+  if (++step_ring_head == STEP_DMA_RING_SIZE) { step_ring_head = 0; }
+}
+
+// Traces step events into the port word ring until it is full or holds STEP_DMA_LOOKAHEAD_CYCLES.
+// A step event takes two entries, the step pulse and the rest of the interrupt tick. Ticks without
+// a step take one entry. One entry always stays free, since head and tail must differ.
+static void step_ring_fill()
+{
+  while ((uint8_t)(step_ring_head + STEP_DMA_RING_SIZE - step_ring_tail) % STEP_DMA_RING_SIZE < STEP_DMA_RING_SIZE-2 &&
+         step_ring_cycles < STEP_DMA_LOOKAHEAD_CYCLES) {
+    uint8_t event = ST_EVENT_WAIT;
+    if (!step_ring_drain) { event = st_step_event(); }
+    if (event == ST_EVENT_STEP) {
+      uint32_t cycles = st.cycles_per_step_event;
+      if (out_bits & STEP_MASK) {
+        step_ring_put( out_bits ^ settings.invert_mask, step_pulse_cycles );
+        out_bits &= ~STEP_MASK;
+        if (cycles > step_pulse_cycles + TICKS_PER_MICROSECOND) { cycles -= step_pulse_cycles; }
+        else { cycles = TICKS_PER_MICROSECOND; }
+      }
+      step_ring_put( out_bits ^ settings.invert_mask, cycles );
+    } else {
+      if (event == ST_EVENT_DONE) {
+        // Everything already in the ring still has to go out. Keep the ring filled with idle
+        // words meanwhile, so the uDMA never repeats old entries.
+        step_ring_drain = (uint8_t)(step_ring_head + STEP_DMA_RING_SIZE - step_ring_tail) % STEP_DMA_RING_SIZE;
+        if (step_ring_drain == 0) { step_ring_drain = 1; }
+      }
+      step_ring_put( out_bits ^ settings.invert_mask, STEP_DMA_IDLE_CYCLES );
+    }
+  }
+}
+
+// Fills the port word ring and starts streaming it from the first entry.
+static void step_ring_start()
+{
+  step_pulse_cycles = settings.pulse_microseconds*TICKS_PER_MICROSECOND;
+  step_ring_head = 0;
+  step_ring_tail = 0;
+  step_ring_drain = 0;
+  step_ring_cycles = 0;
+  step_ring_last = 0;
+  step_ring_put( out_bits, STEP_DMA_IDLE_CYCLES );
+  step_ring_fill();
+
+  uDMAChannelScatterGatherSet( STEP_DMA_CHANNEL, STEP_DMA_TASKS, step_task_list, true );
+  step_task_restart = dma_control_table[STEP_DMA_CHANNEL];
+  uDMAChannelEnable( STEP_DMA_CHANNEL );
+  TimerLoadSet( TIMER2_BASE, TIMER_A, STEP_DMA_IDLE_CYCLES );
+  TimerEnable( TIMER2_BASE, TIMER_A );
+  TimerEnable( TIMER1_BASE, TIMER_A );
+}
+
+// "The Stepper Ring Interrupt" - Refills the port word ring at STEP_DMA_SERVICE_FREQUENCY. The
+// position of the uDMA in the ring follows from the tasks left in its scatter-gather list.
+// NOTE: The ring must hold STEP_DMA_LOOKAHEAD_CYCLES worth of port words at the highest step
+// rate, otherwise the uDMA catches up with the refill and steps slower than planned.
+///ISR(TIMER1_COMPA_vect)
+void timer1_compare_interrupt( void )
+{
+  PROFILE_START(profile_entry);
+  TimerIntClear( TIMER1_BASE, TIMER_TIMA_TIMEOUT ); /// clear interrupt flag
+
+  uint32_t tasks_done = STEP_DMA_TASKS - (uDMAChannelSizeGet( STEP_DMA_CHANNEL | UDMA_PRI_SELECT ) >> 2);
+  uint8_t tail = (tasks_done >> 1) % STEP_DMA_RING_SIZE;
+  // Retire the entries written out since the last refill
+  while (step_ring_tail != tail) {
+    step_ring_cycles -= step_ring[(step_ring_tail == 0) ? STEP_DMA_RING_SIZE-1 : step_ring_tail-1].load;
+    if (++step_ring_tail == STEP_DMA_RING_SIZE) { step_ring_tail = 0; }
+    if (step_ring_drain) {
+      // Shut down once the last step of the cycle is out.
+      if (--step_ring_drain == 0) {
+        st_go_idle();
+        bit_true(sys.execute,EXEC_CYCLE_STOP); // Flag main program for cycle end
+        PROFILE_END(profile_entry, PROFILE_STEP);
+        return;
+      }
+    }
+  }
+  step_ring_fill();
+  PROFILE_END(profile_entry, PROFILE_STEP);
+}
+
+#endif // STEP_PULSE_DMA
+
 // Reset and clear stepper subsystem variables
 void st_reset()
 {
   memset(&st, 0, sizeof(st));
-  set_step_events_per_minute(MINIMUM_STEPS_PER_MINUTE);
-  current_block = NULL;
+  memset(&prep, 0, sizeof(prep));
+  hold_complete = false;
+  #ifndef STEP_PULSE_DMA
+    config_step_timer((F_CPU/MINIMUM_STEPS_PER_MINUTE)*60);
+  #endif
+  segment_buffer_tail = 0;
+  segment_buffer_head = 0;
+  segment_next_head = 1;
   busy = false;
 }
 
@@ -441,7 +690,39 @@ void st_init()
   TimerIntClear( TIMER1_BASE, 0xFFFF ); //disable timer1 immediate interrupt (bug of ARM?)
   IntPendClear( INT_TIMER1A );
   TimerIntEnable( TIMER1_BASE, TIMER_TIMA_TIMEOUT );
+#ifdef STEP_PULSE_DMA
+  TimerLoadSet( TIMER1_BASE, TIMER_A, F_CPU/STEP_DMA_SERVICE_FREQUENCY ); // Ring refill rate
+
+  // Configure Timer2 as the port word clock. Its timeouts request the uDMA, no interrupt.
+  SysCtlPeripheralEnable( SYSCTL_PERIPH_TIMER2 );
+  SysCtlDelay(26); // give time delay 1 microsecond for timer2 module to start
+  TimerConfigure( TIMER2_BASE, TIMER_CFG_PERIODIC ); // Full width, step events can be long
+  TimerControlStall( TIMER2_BASE, TIMER_A, true ); //timer2 will stall in debug mode
 
+  // Configure the uDMA. The task list is fixed: for each ring entry, write its port word to the
+  // stepping port and continue, then write its load value to Timer2 and wait for the next
+  // request. The last task copies the primary control structure back, restarting the list.
+  SysCtlPeripheralEnable( SYSCTL_PERIPH_UDMA );
+  SysCtlDelay(26);
+  uDMAEnable();
+  uDMAControlBaseSet( dma_control_table );
+  uDMAChannelAssign( UDMA_CH4_TIMER2A );
+  uDMAChannelAttributeDisable( STEP_DMA_CHANNEL, UDMA_ATTR_ALL );
+  uint8_t i;
+  for (i=0; i<STEP_DMA_RING_SIZE; i++) {
+    step_task_list[2*i] = (tDMAControlTable) uDMATaskStructEntry( 1, UDMA_SIZE_32,
+      &step_ring[i].port, UDMA_SRC_INC_NONE,
+      (void *)(STEPPING_PORT + GPIO_O_DATA + (STEPPING_MASK << 2)), UDMA_DST_INC_NONE,
+      UDMA_ARB_1, UDMA_MODE_MEM_SCATTER_GATHER );
+    step_task_list[2*i+1] = (tDMAControlTable) uDMATaskStructEntry( 1, UDMA_SIZE_32,
+      &step_ring[i].load, UDMA_SRC_INC_NONE,
+      (void *)(TIMER2_BASE + TIMER_O_TAILR), UDMA_DST_INC_NONE,
+      UDMA_ARB_1, (i < STEP_DMA_RING_SIZE-1) ? UDMA_MODE_PER_SCATTER_GATHER : UDMA_MODE_MEM_SCATTER_GATHER );
+  }
+  step_task_list[STEP_DMA_TASKS-1] = (tDMAControlTable) uDMATaskStructEntry( 4, UDMA_SIZE_32,
+    &step_task_restart, UDMA_SRC_INC_32, &dma_control_table[STEP_DMA_CHANNEL], UDMA_DST_INC_32,
+    UDMA_ARB_4, UDMA_MODE_PER_SCATTER_GATHER );
+#else
   // Configure Timer2
   SysCtlPeripheralEnable( SYSCTL_PERIPH_TIMER2 );
   SysCtlDelay(26); // give time delay 1 microsecond for timer2 module to start
@@ -453,16 +734,33 @@ void st_init()
   IntPendClear( INT_TIMER2A );
   TimerIntEnable( TIMER2_BASE, TIMER_TIMA_TIMEOUT );
 
+#endif
+
+  // Configure Timer3 as the stepper idle lock timer
+  SysCtlPeripheralEnable( SYSCTL_PERIPH_TIMER3 );
+  SysCtlDelay(26); // give time delay 1 microsecond for timer3 module to start
+  TimerConfigure( TIMER3_BASE, TIMER_CFG_ONE_SHOT );
+  IntPrioritySet( INT_TIMER3A, 32 ); // same priority as Timer1, which usually starts it
+  TimerControlStall( TIMER3_BASE, TIMER_A, true ); //timer3 will stall in debug mode
+  TimerIntRegister( TIMER3_BASE, TIMER_A, timer3_idle_lock_interrupt );
+  TimerIntClear( TIMER3_BASE, 0xFFFF );
+  IntPendClear( INT_TIMER3A );
+  TimerIntEnable( TIMER3_BASE, TIMER_TIMA_TIMEOUT );
+
   // Start in the idle state, but first wake up to check for keep steppers enabled option.
   st_wake_up();
   st_go_idle();
 }
 
+#ifndef STEP_PULSE_DMA
 // Configures the prescaler and ceiling of timer 1 to produce the given rate as accurately as possible.
 // Returns the actual number of cycles per interrupt
 static uint32_t config_step_timer(uint32_t cycles)
 {
   TimerLoadSet( TIMER1_BASE, TIMER_A, cycles );
+  #ifdef ISR_PROFILE
+    step_timer_load = cycles;
+  #endif
   return cycles;
 /*  uint16_t ceiling;
   ///uint8_t prescaler;
@@ -518,24 +816,39 @@ static uint32_t config_step_timer(uint32_t cycles)
   return(actual_cycles);
   */
 }
-
-static void set_step_events_per_minute(uint32_t steps_per_minute)
-{
-  if (steps_per_minute < MINIMUM_STEPS_PER_MINUTE) { steps_per_minute = MINIMUM_STEPS_PER_MINUTE; }
-  ///st.cycles_per_step_event = config_step_timer((TICKS_PER_MICROSECOND*1000000*60)/steps_per_minute);
-  st.cycles_per_step_event = config_step_timer((F_CPU/steps_per_minute)*60); ///avoid values more than 4 billion...
-}
+#endif
 
 // Planner external interface to start stepper interrupt and execute the blocks in queue. Called
 // by the main program functions: planner auto-start and run-time command execution.
 void st_cycle_start()
 {
   if (sys.state == STATE_QUEUED) {
+    st_prep_buffer(); // Make sure the first segments are ready before the interrupt starts.
     sys.state = STATE_CYCLE;
     st_wake_up();
   }
 }
 
+// Starts the homing motion in the planner buffer. Called by the homing cycle in the main program.
+void st_homing_start(uint8_t axis_mask, uint8_t leave)
+{
+  homing_axes = axis_mask;
+  homing_invert = leave ? LIMIT_MASK : 0;
+  homing_running = true;
+  st_prep_buffer(); // Make sure the first segments are ready before the interrupt starts.
+  st_wake_up();
+}
+
+uint8_t st_homing_running()
+{
+  return(homing_running);
+}
+
+uint8_t st_homing_axes()
+{
+  return(homing_axes);
+}
+
 // Execute a feed hold with deceleration, only during cycle. Called by main program.
 void st_feed_hold()
 {
@@ -552,16 +865,331 @@ void st_feed_hold()
 // Only the planner de/ac-celerations profiles and stepper rates have been updated.
 void st_cycle_reinitialize()
 {
-  if (current_block != NULL) {
-    // Replan buffer from the feed hold stop location.
-    plan_cycle_reinitialize(current_block->step_event_count - st.step_events_completed);
-    // Update initial rate and timers after feed hold.
-    st.trapezoid_adjusted_rate = 0; // Resumes from rest
-    set_step_events_per_minute(st.trapezoid_adjusted_rate);
-    st.trapezoid_tick_cycle_counter = CYCLES_PER_ACCELERATION_TICK/2; // Start halfway for midpoint rule.
-    st.step_events_completed = 0;
+  if (sys.state == STATE_HOMING) { return; } // The homing cycle clears up after its own motions.
+  block_t *block = plan_get_current_block();
+  if (block != NULL) {
+    if (sys.state == STATE_HOLD) {
+      // Replan buffer from the feed hold stop location. The planner tail block is the block
+      // being segmented, so the remaining step events are those not yet segmented.
+      plan_cycle_reinitialize(block->step_event_count - prep.step_events_completed, 0);
+      // Update segment preparation after feed hold. Resumes from rest.
+      prep.step_events_completed = 0;
+      prep.current_rate = 0;
+      prep.exit_speed = 0;
+      hold_complete = false;
+      prep.ramp = RAMP_NONE;
+    }
     sys.state = STATE_QUEUED;
   } else {
+    // Program complete. Apply a spindle or coolant change programmed after the last block.
+    spindle_apply(plan_get_spindle_direction(), plan_get_spindle_speed());
+    coolant_set_state(plan_get_coolant_mode());
     sys.state = STATE_IDLE;
   }
 }
+
+// Copies the state published by the stepper interrupt, repeating until no step event came in
+// between. The reads go through volatile pointers, so they stay between the readings of the count.
+// NOTE: Only the main program changes the planner buffer count, so it needs no such care.
+void st_get_snapshot(st_snapshot_t *snapshot)
+{
+  volatile int32_t *position = sys.position;
+  volatile stepper_t *stepper = &st;
+  uint32_t sequence;
+  uint8_t i;
+  do {
+    sequence = snapshot_sequence;
+    for (i=0; i<N_AXIS; i++) { snapshot->position[i] = position[i]; }
+    snapshot->feed_rate = stepper->feed_rate;
+    snapshot->block_count = stepper->block_count;
+  } while (sequence != snapshot_sequence);
+  snapshot->buffer_count = plan_get_block_buffer_count();
+}
+
+// Replans the buffer for changed feed or rapid overrides, without stopping. As after a feed hold,
+// the block being segmented continues from where its segmentation has come to, but at the rate
+// reached there. The segments prepared from then on carry the spindle override, if it changed.
+// Called by runtime command execution in the main program.
+// NOTE: During a feed hold, only the nominal speeds change. The resume replans from rest.
+void st_update_overrides()
+{
+  if (sys.state == STATE_HOMING) { return; } // The homing motion keeps its planned rate.
+  block_t *block = plan_get_current_block();
+  if (block != NULL && prep.block_loaded && sys.state != STATE_HOLD) {
+    plan_cycle_reinitialize(block->step_event_count - prep.step_events_completed, prep.current_rate);
+    prep.step_events_completed = 0;
+    prep.ramp = RAMP_NONE;
+  }
+  plan_update_overrides();
+  // Without motion, no step segment carries a spindle override change to the output
+  if (block == NULL && sys.state == STATE_IDLE) {
+    spindle_apply(plan_get_spindle_direction(), plan_get_spindle_speed());
+  }
+}
+
+
+// Returns the rate of the S-curve ramp in progress the given number of acceleration ticks after its
+// start. The acceleration rises linearly over the first ramp_corner of the ramp duration, holds
+// and falls linearly over the last. The ramp duration is set so that it peaks at the planner
+// acceleration at most.
+static float st_ramp_rate(float ticks)
+{
+  float u = (ticks < prep.ramp_ticks) ? ticks/prep.ramp_ticks : 1.0f; // Fraction of the ramp duration
+  float k = prep.ramp_corner;
+  float peak = 1.0f/(1.0f-k); // Peak acceleration relative to the mean over the ramp
+  float fraction; // Fraction of the rate change
+  if (u < k) { fraction = 0.5f*peak*u*u/k; }
+  else if (u > 1.0f-k) { fraction = 1.0f - 0.5f*peak*(1.0f-u)*(1.0f-u)/k; }
+  else { fraction = peak*(u-0.5f*k); }
+  return(prep.ramp_start_rate + fraction*(prep.ramp_end_rate-prep.ramp_start_rate));
+}
+
+// Stores a step segment of the planner tail block and advances the segment buffer head. Discards
+// the planner block once it is fully segmented.
+static void st_prep_segment(block_t *block, uint32_t cycles_per_step_event, uint32_t n_step, float feed_rate)
+{
+  segment_t *segment = &segment_buffer[segment_buffer_head];
+  segment->cycles_per_step_event = cycles_per_step_event;
+  segment->n_step = n_step;
+  segment->st_block_index = prep.st_block_index;
+  segment->feed_rate = feed_rate;
+  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    // Over-drive the interrupt at low step rates. Each level halves the interrupt period and
+    // doubles the number of interrupts in the segment. Dwells have no steps to smooth.
+    uint8_t amass_level = 0;
+    while (!block->dwell && amass_level < MAX_AMASS_LEVEL &&
+           (cycles_per_step_event >> amass_level) > AMASS_CYCLES_CUTOFF) {
+      amass_level++;
+    }
+    segment->cycles_per_step_event = cycles_per_step_event >> amass_level;
+    segment->n_step = n_step << amass_level;
+    segment->amass_level = amass_level;
+  #endif
+  #ifdef VARIABLE_SPINDLE
+    // In laser mode the power follows the speed of the segment relative to the programmed speed,
+    // so the ramps get as much energy per mm as the rest of the path. Rapids, dwells and homing
+    // never fire.
+    uint16_t pwm = 0;
+    if (block->spindle_direction) {
+      if (bit_isfalse(settings.flags,BITFLAG_LASER_MODE)) {
+        pwm = spindle_compute_pwm(block->spindle_speed);
+      } else if (!block->rapid_motion && !block->dwell && sys.state != STATE_HOMING) {
+        pwm = spindle_compute_pwm(block->spindle_speed);
+        if (feed_rate < block->programmed_speed) { pwm = pwm*feed_rate/block->programmed_speed; }
+      }
+    }
+    segment->spindle_pwm = pwm;
+  #endif
+  segment_buffer_head = segment_next_head;
+  segment_next_head++;
+  if (segment_next_head == SEGMENT_BUFFER_SIZE) { segment_next_head = 0; }
+
+  // Discard the planner block once it is fully segmented. Done after the segment is stored,
+  // so that the stepper interrupt never sees both buffers empty while motion remains.
+  prep.step_events_completed += n_step;
+  if (prep.step_events_completed >= block->step_event_count) {
+    // A lowered override can leave a block too short to slow down to its final rate. The next
+    // block carries on slowing down from the speed it ends at.
+    prep.exit_speed = 0;
+    if (!block->dwell && prep.current_rate > block->final_rate+block->rate_delta) {
+      prep.exit_speed = prep.current_rate*block->millimeters/block->step_event_count;
+    }
+    plan_discard_current_block();
+    prep.block_loaded = false;
+    prep.step_events_completed = 0;
+  }
+}
+
+// Prepares step segments from the planner buffer until the segment buffer is full. Called
+// continuously by the main program through the runtime command execution. Each segment is one
+// acceleration tick long, or as many step events as fit in it, and its rate is the midpoint
+// rate of the trapezoid over the segment. The planner tail block is discarded as soon as it
+// is fully segmented, so the planner block data is only ever read here, never in an interrupt.
+// NOTE: The planner may still update the exit speed of the block being segmented, while new
+// blocks are added. The trapezoid parameters are therefore read anew for every segment.
+void st_prep_buffer()
+{
+  while (segment_next_head != segment_buffer_tail) {
+    // Do not segment anything more after a feed hold deceleration until it is resumed.
+    if (hold_complete) { return; }
+
+    block_t *block = plan_get_current_block();
+    if (block == NULL) { return; } // Nothing to segment.
+
+    // Initialize a new block. Copy the data needed by the bresenham line tracer.
+    if (!prep.block_loaded) {
+      prep.st_block_index++;
+      if (prep.st_block_index == SEGMENT_BUFFER_SIZE) { prep.st_block_index = 0; }
+      st_block_t *st_block = &st_block_buffer[prep.st_block_index];
+      st_block->direction_bits = block->direction_bits;
+      st_block->spindle_direction = block->spindle_direction;
+      st_block->coolant_mode = block->coolant_mode;
+      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        st_block->steps_x = block->steps_x << MAX_AMASS_LEVEL;
+        st_block->steps_y = block->steps_y << MAX_AMASS_LEVEL;
+        st_block->steps_z = block->steps_z << MAX_AMASS_LEVEL;
+        st_block->step_event_count = block->step_event_count << MAX_AMASS_LEVEL;
+      #else
+        st_block->steps_x = block->steps_x;
+        st_block->steps_y = block->steps_y;
+        st_block->steps_z = block->steps_z;
+        st_block->step_event_count = block->step_event_count;
+      #endif
+      prep.step_events_completed = 0;
+      // During feed hold, do not update rate. Keep decelerating.
+      if (sys.state != STATE_HOLD) {
+        prep.current_rate = block->initial_rate;
+        if (!block->dwell && prep.exit_speed*block->step_event_count > prep.current_rate*block->millimeters) {
+          prep.current_rate = prep.exit_speed*block->step_event_count/block->millimeters;
+        }
+      }
+      prep.ramp = RAMP_NONE;
+      prep.block_loaded = true;
+    }
+
+    // A dwell is traced as step events without steps, one per millisecond, in segments of about an
+    // acceleration tick like any motion. A feed hold pauses it right away; the steppers are at rest.
+    if (block->dwell) {
+      if (sys.state == STATE_HOLD) {
+        hold_complete = true;
+        return;
+      }
+      uint32_t n_step = CYCLES_PER_ACCELERATION_TICK/DWELL_CYCLES_PER_STEP_EVENT;
+      if (n_step > block->step_event_count - prep.step_events_completed) {
+        n_step = block->step_event_count - prep.step_events_completed;
+      }
+      st_prep_segment(block, DWELL_CYCLES_PER_STEP_EVENT, n_step, 0);
+      continue;
+    }
+
+    // Determine the trapezoid section the next segment starts in, the rate change over one
+    // acceleration tick and the number of step events left until the section ends.
+    uint32_t nominal_rate = plan_get_nominal_rate(block);
+    uint32_t step_events_remaining = block->step_event_count - prep.step_events_completed;
+    uint32_t step_events_section;
+    float rate_delta = block->rate_delta;
+    uint8_t ramp = RAMP_NONE;
+    uint8_t slow_down = false;
+    if (sys.state == STATE_HOLD) {
+      // Execute feed hold by enforcing a steady deceleration from the current rate. The rate of
+      // deceleration is limited by rate_delta and will never decelerate faster or slower than
+      // in normal operation. If the deceleration spans more than one block, it is continued
+      // according to the rate_delta of the following blocks.
+      if (prep.current_rate <= rate_delta) {
+        hold_complete = true; // Stepper interrupt goes idle after the last segment.
+        return;
+      }
+      rate_delta = -rate_delta;
+      step_events_section = step_events_remaining;
+      prep.ramp = RAMP_NONE;
+    } else if (prep.current_rate > nominal_rate && prep.step_events_completed < block->decelerate_after) {
+      // A lowered override has put the nominal rate below the current rate. Slow down to it at the
+      // block acceleration before cruising.
+      rate_delta = -rate_delta;
+      step_events_section = block->decelerate_after - prep.step_events_completed;
+      slow_down = true;
+    } else if (prep.step_events_completed < block->accelerate_until) {
+      step_events_section = block->accelerate_until - prep.step_events_completed;
+      ramp = RAMP_ACCEL;
+    } else if (prep.step_events_completed < block->decelerate_after) {
+      // No accelerations. Make sure we cruise exactly at the nominal rate.
+      prep.current_rate = nominal_rate;
+      rate_delta = 0;
+      step_events_section = block->decelerate_after - prep.step_events_completed;
+    } else {
+      rate_delta = -rate_delta;
+      step_events_section = step_events_remaining;
+      ramp = RAMP_DECEL;
+    }
+
+    float step_rate;
+    uint32_t cycles_per_step_event;
+    uint32_t n_step;
+    if (ramp != RAMP_NONE && settings.jerk > 0) {
+      // S-curve ramp. The rate follows the ramp in time, with the acceleration rising and falling
+      // at the jerk setting instead of jumping, and never above the planner acceleration. The ramp
+      // takes longer than the linear one, and the planner has laid out the trapezoid for it.
+      float ramp_end_rate = block->final_rate;
+      if (ramp == RAMP_ACCEL) {
+        // The rate the planner reaches at the end of acceleration: the nominal rate, or less where
+        // the block decelerates right away.
+        ramp_end_rate = plan_get_ramp_rate(block, block->initial_rate, block->accelerate_until);
+        if (ramp_end_rate > nominal_rate) { ramp_end_rate = nominal_rate; }
+      }
+      // Start a new ramp on entering the section, or when the planner has changed its end rate.
+      if (prep.ramp != ramp || prep.ramp_end_rate != ramp_end_rate) {
+        float delta_rate = fabsf(ramp_end_rate - prep.current_rate);
+        prep.ramp = ramp;
+        prep.ramp_start_rate = prep.current_rate;
+        prep.ramp_end_rate = ramp_end_rate;
+        prep.ramp_time = 0;
+        // With a rate change above the jerk rate, the acceleration reaches the planner acceleration
+        // and holds it. Below, it rises and falls in a triangle, peaking lower.
+        float jerk_rate = plan_get_jerk_rate(block);
+        if (delta_rate > jerk_rate) {
+          prep.ramp_ticks = (delta_rate+jerk_rate)/block->rate_delta;
+          prep.ramp_corner = jerk_rate/(delta_rate+jerk_rate);
+        } else {
+          prep.ramp_ticks = 2*sqrtf(delta_rate*jerk_rate)/block->rate_delta;
+          prep.ramp_corner = 0.5f;
+        }
+      }
+
+      // Rate at the middle of a segment of one acceleration tick, then the time the segment takes.
+      step_rate = st_ramp_rate(prep.ramp_time + 0.5f);
+      if (step_rate < block->rate_delta) { step_rate = block->rate_delta; }
+      if (step_rate > nominal_rate && ramp == RAMP_ACCEL) { step_rate = nominal_rate; }
+      if (step_rate < MINIMUM_STEPS_PER_MINUTE) { step_rate = MINIMUM_STEPS_PER_MINUTE; }
+      cycles_per_step_event = (60.0f*F_CPU)/step_rate;
+      n_step = CYCLES_PER_ACCELERATION_TICK/cycles_per_step_event;
+      if (n_step == 0) { n_step = 1; }
+      if (n_step > step_events_section) { n_step = step_events_section; }
+      prep.ramp_time += ((float)n_step*cycles_per_step_event)/CYCLES_PER_ACCELERATION_TICK;
+      prep.current_rate = st_ramp_rate(prep.ramp_time);
+    } else {
+      // Compute the segment rate by the midpoint rule and fit as many step events into one
+      // acceleration tick as the rate allows. At very low rates, a single step event may take
+      // longer than an acceleration tick.
+      // NOTE: Ramps are never stepped slower than rate_delta, the rate change of a single tick.
+      // This avoids very slow first and last step events when starting from or stopping at rest.
+      step_rate = prep.current_rate + 0.5f*rate_delta;
+      if (rate_delta != 0 && step_rate < block->rate_delta) { step_rate = block->rate_delta; }
+      if (step_rate > nominal_rate && !slow_down) { step_rate = nominal_rate; }
+      if (step_rate < MINIMUM_STEPS_PER_MINUTE) { step_rate = MINIMUM_STEPS_PER_MINUTE; }
+      cycles_per_step_event = (60.0f*F_CPU)/step_rate;
+      n_step = CYCLES_PER_ACCELERATION_TICK/cycles_per_step_event;
+      if (n_step == 0) { n_step = 1; }
+      if (n_step > step_events_section) { n_step = step_events_section; }
+
+      // Update the rate at the end of the segment, scaled by the time the segment actually takes.
+      if (rate_delta != 0) {
+        float rate = prep.current_rate +
+          (rate_delta*n_step*cycles_per_step_event)/CYCLES_PER_ACCELERATION_TICK;
+        if (rate_delta > 0) {
+          if (rate > nominal_rate) { rate = nominal_rate; } // Reached nominal rate early.
+        } else if (sys.state == STATE_HOLD) {
+          if (rate < 0) { rate = 0; }
+        } else if (slow_down) {
+          if (rate < nominal_rate) { rate = nominal_rate; } // Reached the nominal rate early.
+        } else {
+          // Follow the deceleration ramp by the remaining distance, so the block reaches its final
+          // rate exactly on its last step event, without trailing slow steps from round-off. Above
+          // the ramp, after a lowered override, keep to the block acceleration and leave the rest
+          // of the slow-down to the next block.
+          float acceleration_per_minute = block->rate_delta*ACCELERATION_TICKS_PER_SECOND*60.0f; // (step/min^2)
+          float ramp_rate = sqrtf( (float)block->final_rate*block->final_rate +
+            2*acceleration_per_minute*(step_events_remaining-n_step) );
+          if (ramp_rate > rate) { rate = ramp_rate; }
+          if (rate > prep.current_rate) { rate = prep.current_rate; }
+          step_rate = 0.5f*(prep.current_rate + rate);
+          if (step_rate < block->rate_delta) { step_rate = block->rate_delta; }
+          if (step_rate < MINIMUM_STEPS_PER_MINUTE) { step_rate = MINIMUM_STEPS_PER_MINUTE; }
+          cycles_per_step_event = (60.0f*F_CPU)/step_rate;
+        }
+        prep.current_rate = rate;
+      }
+    }
+
+    st_prep_segment(block, cycles_per_step_event, n_step, step_rate*block->millimeters/block->step_event_count);
+  }
+}
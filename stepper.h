@@ -23,6 +23,21 @@
 #define stepper_h
 
 //#include <avr/io.h>
+#include "nuts_bolts.h"
+
+// The number of step segments prepared ahead of the stepper interrupt. Each segment lasts about
+// one acceleration tick, so this sets how long the main program may be busy elsewhere.
+#ifndef SEGMENT_BUFFER_SIZE
+  #define SEGMENT_BUFFER_SIZE 10
+#endif
+
+// Machine state as traced by the stepper interrupt, taken in one piece for the status report
+typedef struct {
+  int32_t position[N_AXIS]; // Machine position in steps, as sys.position
+  float feed_rate;          // Speed of the step segment being traced (mm/min). Zero when stopped.
+  uint32_t block_count;     // The number of planner blocks the stepper interrupt has started since reset
+  uint8_t buffer_count;     // The number of blocks in the planner buffer
+} st_snapshot_t;
 
 // Initialize and setup the stepper motor subsystem
 void st_init();
@@ -42,7 +57,28 @@ void st_cycle_start();
 // Reinitializes the buffer after a feed hold for a resume.
 void st_cycle_reinitialize();
 
+// Starts the homing motion in the planner buffer. The stepper interrupt reads the limit pins on every
+// step event and stops each axis of the mask on its own, as its pin goes active, or inactive again
+// with leave set. It latches the position of the axis there in sys.homing_latch.
+void st_homing_start(uint8_t axis_mask, uint8_t leave);
+
+// Returns true until the homing motion has stopped, with all axes at their switch state, at the end
+// of the planned motion, or by a reset
+uint8_t st_homing_running();
+
+// Returns the axes of the homing motion that have not reached their switch state
+uint8_t st_homing_axes();
+
 // Initiates a feed hold of the running program
 void st_feed_hold();
 
+// Replans the buffered motion for changed feed, rapid or spindle overrides, without stopping
+void st_update_overrides();
+
+// Copies the machine state consistently, while the stepper interrupt keeps running. Main program only.
+void st_get_snapshot(st_snapshot_t *snapshot);
+
+// Fills the segment buffer from the planner buffer. Called continuously by the main program.
+void st_prep_buffer();
+
 #endif